@@ -0,0 +1,170 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "AckTracker.h"
+#include "Config.h"
+
+#include <stdio.h>
+
+AckTracker::Stats::Stats() : count(0), errors(0), timeouts(0), outliers(0),
+                             min(0), max(0), total(0), srtt(0), rttvar(0),
+                             rtt(0), errorCount(0), timeoutCount(0),
+                             outlierCount(0)
+{
+}
+
+AckTracker::AckTracker(int panel) : mPanel(panel), mPending(-1), mSentAt(0)
+{
+}
+
+/**
+  The stats for a command, registering its metrics the first time it
+  is sent.
+*/
+AckTracker::Stats &
+AckTracker::getStats(int code)
+{
+  std::map<int, Stats>::iterator s = mStats.find(code);
+  if (s != mStats.end()) { return s->second; }
+
+  Stats &stats = mStats[code];
+  const char *name = Config::getConfig().commandIntToName(code);
+  char labels[96];
+  if (name && name[0])
+  {
+    snprintf(labels, sizeof(labels), "panel=\"%d\",command=\"%s\"",
+             mPanel, name);
+  }
+  else
+  {
+    snprintf(labels, sizeof(labels), "panel=\"%d\",command=\"%03d\"",
+             mPanel, code);
+  }
+
+  Metrics &metrics = Metrics::getMetrics();
+  stats.rtt = &metrics.histogram("dscd_ack_seconds",
+    "Time from sending a command to the panel's reply", labels);
+  stats.errorCount = &metrics.counter("dscd_command_errors_total",
+    "Commands the panel answered with COMMAND_ERROR", labels);
+  stats.timeoutCount = &metrics.counter("dscd_ack_timeouts_total",
+    "Commands the panel didn't answer in time", labels);
+  stats.outlierCount = &metrics.counter("dscd_ack_outliers_total",
+    "Replies much slower than usual for the command", labels);
+  return stats;
+}
+
+void
+AckTracker::sent(int code, uint64_t now)
+{
+  getStats(code);
+  mPending = code;
+  mSentAt = now;
+}
+
+void
+AckTracker::replied(bool error, uint64_t now)
+{
+  if (mPending < 0) { return; }
+
+  Stats &stats = getStats(mPending);
+  uint64_t rtt = now - mSentAt;
+  mPending = -1;
+
+  if (error)
+  {
+    stats.errors++;
+    stats.errorCount->increment();
+  }
+
+  stats.rtt->observe(rtt);
+  if (!stats.count || rtt < stats.min) { stats.min = rtt; }
+  if (rtt > stats.max) { stats.max = rtt; }
+  stats.total += rtt;
+
+  // RFC 6298 smoothing; the first sample seeds it
+  double sample = (double)rtt;
+  if (!stats.count)
+  {
+    stats.srtt = sample;
+    stats.rttvar = sample / 2;
+  }
+  else
+  {
+    if (stats.count >= MIN_SAMPLES &&
+        sample > stats.srtt + 4 * stats.rttvar)
+    {
+      stats.outliers++;
+      stats.outlierCount->increment();
+    }
+    double delta = sample > stats.srtt ? sample - stats.srtt
+                                       : stats.srtt - sample;
+    stats.rttvar += (delta - stats.rttvar) / 4;
+    stats.srtt += (sample - stats.srtt) / 8;
+  }
+  stats.count++;
+}
+
+void
+AckTracker::timedOut()
+{
+  if (mPending < 0) { return; }
+
+  Stats &stats = getStats(mPending);
+  stats.timeouts++;
+  stats.timeoutCount->increment();
+  mPending = -1;
+}
+
+std::string
+AckTracker::format() const
+{
+  std::string out = "[";
+  char buffer[192];
+  std::map<int, Stats>::const_iterator s;
+  for (s = mStats.begin(); s != mStats.end(); s++)
+  {
+    const Stats &stats = s->second;
+    const char *name = Config::getConfig().commandIntToName(s->first);
+    snprintf(buffer, sizeof(buffer),
+             "%s[%d,'%s',%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu]",
+             out.length() > 1 ? "," : "", s->first, name ? name : "",
+             (unsigned long long)stats.count,
+             (unsigned long long)stats.errors,
+             (unsigned long long)stats.timeouts,
+             (unsigned long long)stats.outliers,
+             (unsigned long long)(stats.min / 1000),
+             (unsigned long long)(stats.count ?
+                                  stats.total / stats.count / 1000 : 0),
+             (unsigned long long)(stats.max / 1000),
+             (unsigned long long)(stats.srtt / 1000));
+    out += buffer;
+  }
+  out += "]";
+  return out;
+}
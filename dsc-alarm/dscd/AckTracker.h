@@ -0,0 +1,102 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _ACK_TRACKER_H
+#define _ACK_TRACKER_H 1
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+#include "Metrics.h"
+
+/**
+  Round trip times from sending a command to the panel until its
+  COMMAND_ACKNOWLEDGE (500) or COMMAND_ERROR (501), kept per command.
+
+  The IT-100 takes one command at a time, so there is at most one
+  outstanding. Besides count, minimum, mean and maximum, each command
+  keeps a smoothed RTT and deviation the way TCP does; once there are
+  enough samples, a reply slower than srtt + 4 * rttvar is counted as
+  an outlier. Timeouts are decided by the caller, which knows whether
+  it is going to resend.
+*/
+
+class AckTracker
+{
+  public:
+    struct Stats
+    {
+      Stats();
+
+      uint64_t count;
+      uint64_t errors;
+      uint64_t timeouts;
+      uint64_t outliers;
+      uint64_t min;
+      uint64_t max;
+      uint64_t total;
+      double srtt;
+      double rttvar;
+
+      Metrics::Histogram *rtt;
+      Metrics::Counter *errorCount;
+      Metrics::Counter *timeoutCount;
+      Metrics::Counter *outlierCount;
+    };
+
+    explicit AckTracker(int panel);
+
+    void sent(int code, uint64_t now);
+    void replied(bool error, uint64_t now);
+    void timedOut();
+    void cancel() { mPending = -1; }
+
+    bool isPending() const { return mPending >= 0; }
+    int getPending() const { return mPending; }
+    uint64_t getSentAt() const { return mSentAt; }
+
+    // [[code,'NAME',count,errors,timeouts,outliers,min,mean,max,srtt],...]
+    // with times in microseconds
+    std::string format() const;
+
+  private:
+    enum { MIN_SAMPLES = 8 };
+
+    Stats &getStats(int code);
+
+  private:
+    int mPanel;
+    int mPending;
+    uint64_t mSentAt;
+    std::map<int, Stats> mStats;
+};
+
+#endif
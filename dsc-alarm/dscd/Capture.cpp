@@ -0,0 +1,209 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#include "Capture.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+
+static const char captureMagic[8] = {'D','S','C','C','A','P','0','1'};
+
+uint64_t
+Capture::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+Capture::Capture()
+  : mDescriptor(-1), mFile(0), mStart(0), mBase(0), mLast(0), mEnd(0)
+{
+}
+
+Capture::~Capture()
+{
+  close();
+}
+
+void
+Capture::close()
+{
+  if (mDescriptor >= 0) { ::close(mDescriptor); mDescriptor = -1; }
+  if (mFile) { fclose(mFile); mFile = 0; }
+}
+
+bool
+Capture::create(const std::string &filename)
+{
+  close();
+
+  // A new session goes after whatever is there already, so restarting
+  // never loses the capture of an incident
+  mDescriptor = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+  if (mDescriptor < 0)
+  {
+    std::cerr << "Could not create capture file: " << filename << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(mDescriptor, &st) == 0 && st.st_size > 0)
+  {
+    Capture existing;
+    Record r;
+    if (!existing.open(filename))
+    {
+      std::cerr << "Not overwriting " << filename << std::endl;
+      close();
+      return false;
+    }
+    while (existing.next(r)) {;}
+    if (existing.mEnd < st.st_size &&
+        ftruncate(mDescriptor, existing.mEnd) < 0)
+    {
+      close();
+      return false;
+    }
+  }
+
+  char header[16];
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint64_t wall = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  memcpy(header, captureMagic, 8);
+  memcpy(header + 8, &wall, 8);
+  mStart = now();
+
+  if (write(mDescriptor, header, sizeof(header)) != sizeof(header))
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void
+Capture::record(direction_t direction, const char *frame, size_t length)
+{
+  if (mDescriptor < 0) { return; }
+  if (length > 0xffff) { length = 0xffff; }
+
+  // One write per record, so a crash never leaves a partial header
+  // followed by someone else's frame.
+  char buffer[12 + 256];
+  uint64_t offset = now() - mStart;
+  uint16_t len = length;
+  memcpy(buffer, &offset, 8);
+  buffer[8] = direction;
+  buffer[9] = 0;
+  memcpy(buffer + 10, &len, 2);
+
+  if (length <= sizeof(buffer) - 12)
+  {
+    memcpy(buffer + 12, frame, length);
+    write(mDescriptor, buffer, 12 + length);
+  }
+  else
+  {
+    std::string big(buffer, 12);
+    big.append(frame, length);
+    write(mDescriptor, big.data(), big.length());
+  }
+}
+
+bool
+Capture::open(const std::string &filename)
+{
+  close();
+
+  mFile = fopen(filename.c_str(), "rb");
+  if (!mFile)
+  {
+    std::cerr << "Could not open capture file: " << filename << std::endl;
+    return false;
+  }
+
+  char header[16];
+  if (fread(header, 1, sizeof(header), mFile) != sizeof(header) ||
+      memcmp(header, captureMagic, 8))
+  {
+    std::cerr << "Not a capture file: " << filename << std::endl;
+    close();
+    return false;
+  }
+  mBase = mLast = 0;
+  mEnd = sizeof(header);
+  return true;
+}
+
+bool
+Capture::next(Record &record)
+{
+  if (!mFile) { return false; }
+
+  char header[16];
+  uint16_t length;
+  if (fread(header, 1, 12, mFile) != 12)
+  {
+    return false;
+  }
+
+  // The start of a later session; its offsets begin again from zero
+  while (!memcmp(header, captureMagic, 8))
+  {
+    if (fread(header + 12, 1, 4, mFile) != 4 ||
+        fread(header, 1, 12, mFile) != 12)
+    {
+      return false;
+    }
+    mEnd += 16;
+    mBase = mLast;
+  }
+  memcpy(&record.offset, header, 8);
+  record.offset += mBase;
+  record.direction = static_cast<direction_t>(header[8]);
+  memcpy(&length, header + 10, 2);
+
+  record.frame.resize(length);
+  if (length && fread(&record.frame[0], 1, length, mFile) != length)
+  {
+    // Truncated by a crash while recording; treat as end of capture
+    return false;
+  }
+  mLast = record.offset;
+  mEnd += 12 + length;
+  return true;
+}
@@ -0,0 +1,99 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+/**
+  Append-only binary record of the serial traffic to and from an
+  IT-100, for replaying real incidents later.
+
+  File layout (all integers little-endian as written by the host), one
+  session after another, each begun by a header:
+
+    header:  char magic[8] = "DSCCAP01"
+             uint64_t start  -- wall clock at open, ns since the epoch
+    records: uint64_t offset -- monotonic ns since the header was written
+             uint8_t direction (0 = from panel, 1 = to panel)
+             uint8_t reserved
+             uint16_t length
+             char frame[length] -- without the trailing CR/LF
+
+  create() adds a session to an existing capture rather than replacing
+  it, after cutting off any record left torn by a crash. The reader
+  plays sessions back to back: offsets carry on from the end of the
+  one before.
+*/
+
+class Capture
+{
+  public:
+    typedef enum { INBOUND = 0, OUTBOUND = 1 } direction_t;
+
+    struct Record
+    {
+      uint64_t offset;
+      direction_t direction;
+      std::string frame;
+    };
+
+    static uint64_t now();
+
+    Capture();
+    ~Capture();
+
+    // Writing
+    bool create(const std::string &filename);
+    void record(direction_t direction, const char *frame, size_t length);
+
+    // Reading
+    bool open(const std::string &filename);
+    bool next(Record &record);
+
+    bool isOpen() const { return mDescriptor >= 0 || mFile; }
+    void close();
+
+  private:
+    int mDescriptor;
+    FILE *mFile;
+    uint64_t mStart;
+
+    // Reading: where earlier sessions left off, and the end of the last
+    // complete record
+    uint64_t mBase;
+    uint64_t mLast;
+    long mEnd;
+};
+
+#endif
@@ -31,12 +31,18 @@
 #include "Command.h"
 #include "Config.h"
 #include "It100.h"
+#include "Log.h"
+#include "Metrics.h"
 
 #include <iostream>
 #include <iomanip>
 #include <sstream>
 #include <assert.h>
+#include <ctype.h>
+#include <string.h>
 #include <stdexcept>
+#include <stdarg.h>
+#include <stdio.h>
 
 std::map<int,Command::creator_t> &
 Command::creators()
@@ -45,6 +51,8 @@ Command::creators()
   return creatorMap;
 }
 
+static void countFailure(It100 &it100, const char *name, const char *help);
+
 /**
   Factory method for commands
 */
@@ -64,8 +72,11 @@ Command::makeCommand (It100 &it100, std::string command)
 
   if (localChecksum != remoteChecksum)
   {
-    std::cout << "Bad checksum: remote = " << remoteChecksum 
-              << "local = " << localChecksum << std::endl;
+    Log::getLog().write(Log::CONSOLE, -1,
+                        "Bad checksum: remote = %d local = %d",
+                        remoteChecksum, localChecksum);
+    countFailure(it100, "dscd_checksum_failures_total",
+                 "Frames dropped because of a bad checksum");
     return 0;
   }
 
@@ -79,40 +90,141 @@ Command::makeCommand (It100 &it100, std::string command)
     return cmd;
   }
 
+  countFailure(it100, "dscd_unknown_frames_total",
+               "Frames dropped because the command isn't known");
   return 0;
 }
 
+// State placeholder names, in ZoneState::condition_t order
+static const char *conditionNames[] =
+  { "open", "alarm", "tamper", "fault", "bypass" };
+
 /**
-  Format a command for printing
+  One %{...} placeholder: [N:]CONDITION, [N:]CONDITION_count, N:state
+  or panel. Returns false, leaving the text alone, for anything else.
 */
-void
-Command::dump(std::ostream &os) const
+static bool
+expandState(const std::string &name, It100 &it100, std::string &out)
 {
-  os << getName() << '(';
+  char value[24];
+  int partition = 0;
+  std::string::size_type at = 0;
+  if (name.length() > 2 && name[0] >= '1' && name[0] <= '8' &&
+      name[1] == ':')
+  {
+    partition = name[0] - '0';
+    at = 2;
+  }
+
+  if (partition && name.compare(at, std::string::npos, "state") == 0)
+  {
+    out += PartitionState::getStateName(
+      it100.getPartitionState(partition).state);
+    return true;
+  }
+  if (!partition && name == "panel")
+  {
+    snprintf(value, sizeof(value), "%d", it100.getPanel());
+    out += value;
+    return true;
+  }
+
+  const ZoneState &zones = it100.getZones();
+  for (int i = 0; i < ZoneState::NUM_CONDITIONS; i++)
+  {
+    size_t length = strlen(conditionNames[i]);
+    if (name.compare(at, length, conditionNames[i]) != 0) { continue; }
+
+    ZoneState::condition_t condition =
+      static_cast<ZoneState::condition_t>(i);
+    if (name.length() == at + length)
+    {
+      snprintf(value, sizeof(value), "%016llx",
+               (unsigned long long)zones.get(condition, partition));
+    }
+    else if (name.compare(at + length, std::string::npos, "_count") == 0)
+    {
+      snprintf(value, sizeof(value), "%d",
+               zones.count(condition, partition));
+    }
+    else
+    {
+      return false;
+    }
+    out += value;
+    return true;
+  }
+  return false;
+}
+
+// Only on the failure paths, so the registry lookup is no burden
+static void
+countFailure(It100 &it100, const char *name, const char *help)
+{
+  char labels[24];
+  snprintf(labels, sizeof(labels), "panel=\"%d\"", it100.getPanel());
+  Metrics::getMetrics().counter(name, help, labels).increment();
+}
+
+// snprintf at the end of what's already in the buffer; on overflow
+// the text is cut short and length stops at the terminator.
+static void
+append(char *buffer, size_t size, size_t &length, const char *format, ...)
+{
+  if (length + 1 >= size) { return; }
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer + length, size - length, format, args);
+  va_end(args);
+  if (n > 0) { length += n; }
+  if (length >= size) { length = size - 1; }
+}
+
+/**
+  Format a command for printing into a caller-supplied buffer, which
+  is always terminated. Returns the length of the formatted text.
+*/
+size_t
+Command::format(char *buffer, size_t size) const
+{
+  size_t length = 0;
+  buffer[0] = 0;
+
+  append(buffer, size, length, "%s(", getName().c_str());
   for (int i = 0; i < getNumParams(); i++)
   {
     if (displayParamName(i))
     {
-      os << getParamName(i) << " = ";
+      append(buffer, size, length, "%s = ", getParamName(i).c_str());
     }
 
     std::string param = getStringParam(i);
     if (param.length() > 0 && 
         param.find_first_not_of("0123456789") == std::string::npos)
     {
-      os << getIntParam(i);
+      append(buffer, size, length, "%d", getIntParam(i));
     }
     else
     {
-      os << '"' << param << '"';
+      append(buffer, size, length, "\"%s\"", param.c_str());
     }
 
     if (i+1 < getNumParams())
     {
-      os << ", ";
+      append(buffer, size, length, ", ");
     }
   }
-  os << ')';
+  append(buffer, size, length, ")");
+
+  return length;
+}
+
+void
+Command::dump(std::ostream &os) const
+{
+  char buffer[256];
+  format(buffer, sizeof(buffer));
+  os << buffer;
 }
 
 std::string
@@ -149,74 +261,116 @@ Command::getInt(std::string::size_type index, std::string::size_type length)
 std::string
 Command::getShellAction() const
 {
-  std::string action = Config::getConfig().getEventAction(getCommandNumber());
-  int pos;
-
-  //   %c              - The command name
-  while ((pos = action.find("%c")) != std::string::npos)
-  {
-    action.replace(pos,2,getName());
-  }
-
-  //   %n              - The command code as a number
-  while ((pos = action.find("%n")) != std::string::npos)
-  {
-    std::stringstream s;
-    s << getCommandNumber();
-    action.replace(pos,2,s.str());
-  }
-
-  //   %d              - Current contents of LCD display
-  while ((pos = action.find("%d")) != std::string::npos)
-  {
-    action.replace(pos,2,mIt100.getLcd());
-  }
-
-  //   %z              - 64-bit hex represntation of open zones
-  while ((pos = action.find("%z")) != std::string::npos)
+  const std::string &format =
+    Config::getConfig().getEventAction(getCommandNumber());
+  if (format.length() == 0)
   {
-    std::stringstream s;
-    s << std::hex << std::setfill('0') << std::setw(16) 
-      << mIt100.getZoneStatus();
-    action.replace(pos,2,s.str());
+    return format;
   }
+  return expand(format);
+}
 
-  int i;
+/**
+  Fills in the placeholders of an [actions] command or a rule's
+  argument from this event and the panel's state. It's one pass from
+  left to right, so what goes in (the LCD text, say) is never expanded
+  again, and a % that isn't a placeholder is left as it is for the
+  command to see.
+*/
+std::string
+Command::expand(const std::string &format) const
+{
+  std::string action;
+  action.reserve(format.length() + 64);
+  char value[24];
 
-  //   %1i through %9i - Integer representation of parameters 1 through 9
-  for (i = 1; i <= 9; i++)
+  for (std::string::size_type i = 0; i < format.length(); i++)
   {
-    std::stringstream search;
-    search << "%" << i << "i";
-    while ((pos = action.find(search.str())) != std::string::npos)
+    if (format[i] != '%' || i + 1 == format.length())
     {
-      std::stringstream s;
-      s << getIntParam(i-1);
-      action.replace(pos,3,s.str());
+      action += format[i];
+      continue;
     }
-  }
 
-  //   %1s through %9s - String representation of parameters 1 through 9
-  for (i = 1; i <= 9; i++)
-  {
-    std::stringstream search;
-    search << "%" << i << "s";
-    while ((pos = action.find(search.str())) != std::string::npos)
+    char c = format[i + 1];
+    char d = i + 2 < format.length() ? format[i + 2] : 0;
+    switch (c)
     {
-      action.replace(pos,3,getStringParam(i-1));
-    }
-  }
+      //   %%              - A single %
+      case '%':
+        action += '%';
+        i++;
+        break;
+
+      //   %c              - The command name
+      case 'c':
+        action += getName();
+        i++;
+        break;
+
+      //   %n              - The command code as a number
+      case 'n':
+        snprintf(value, sizeof(value), "%d", getCommandNumber());
+        action += value;
+        i++;
+        break;
+
+      //   %d              - Current contents of LCD display
+      case 'd':
+        action += mIt100.getLcd();
+        i++;
+        break;
+
+      //   %z              - 64-bit hex representation of open zones
+      case 'z':
+        snprintf(value, sizeof(value), "%016llx",
+                 (unsigned long long)mIt100.getZoneStatus());
+        action += value;
+        i++;
+        break;
+
+      //   %{...}          - Zone and partition state; see expandState()
+      case '{':
+      {
+        std::string::size_type end = format.find('}', i + 2);
+        if (end != std::string::npos &&
+            expandState(format.substr(i + 2, end - i - 2), mIt100, action))
+        {
+          i = end;
+        }
+        else
+        {
+          action += '%';
+        }
+        break;
+      }
 
-  //   %1l through %9l - Keypad status for LEDs 1 through 9
-  for (i = 1; i <= 9; i++)
-  {
-    std::stringstream search;
-    search << "%" << i << "l";
-    while ((pos = action.find(search.str())) != std::string::npos)
-    {
-      std::stringstream s;
-      s << mIt100.getLedState(static_cast<It100::led_t>(i));
-      action.replace(pos,3,s.str());
+      //   %1i through %9i - Integer representation of parameters 1 through 9
+      //   %1s through %9s - String representation of parameters 1 through 9
+      //   %1l through %9l - Keypad status for LEDs 1 through 9
+      default:
+        if (c >= '1' && c <= '9' && d == 'i')
+        {
+          snprintf(value, sizeof(value), "%d", getIntParam(c - '1'));
+          action += value;
+        }
+        else if (c >= '1' && c <= '9' && d == 's')
+        {
+          action += getStringParam(c - '1');
+        }
+        else if (c >= '1' && c <= '9' && d == 'l')
+        {
+          snprintf(value, sizeof(value), "%d",
+                   mIt100.getLedState(static_cast<It100::led_t>(c - '0')));
+          action += value;
+        }
+        else
+        {
+          action += '%';
+          break;
+        }
+        i += 2;
+        break;
     }
   }
 
@@ -1510,6 +1664,69 @@ ZoneRestored::getParamName(int number) const
 bool registeredZoneRestored = 
   Command::addCreator(Command::ZONE_RESTORED,  ZoneRestored::create);
 
+/** *******************************************************************
+ * Command 616 (Bypassed Zones Bitfield Dump)
+ * Parameters: 16 bytes (8 hex bytes)
+ *********************************************************************/
+
+uint64_t
+BypassedZonesBitfieldDump::getZones() const
+{
+  uint64_t zones = 0;
+  for (size_t i = 0; i < 8 && 3 + 2 * i + 2 <= mCommand.length(); i++)
+  {
+    uint64_t byte = strtol(mCommand.substr(3 + 2 * i, 2).c_str(), 0, 16);
+    zones |= byte << (8 * i);
+  }
+  return zones;
+}
+
+int
+BypassedZonesBitfieldDump::getIntParam(int number) const
+{
+  switch (number)
+  {
+    case 0: return __builtin_popcountll(getZones()); // Number bypassed
+  }
+  return 0;
+}
+
+std::string
+BypassedZonesBitfieldDump::getStringParam(int number) const
+{
+  switch (number)
+  {
+    case 0:
+      {
+        std::stringstream s;
+        uint64_t zones = getZones();
+        for (int zone = 1; zone <= 64; zone++)
+        {
+          if (zones & ZoneState::bit(zone))
+          {
+            if (s.tellp() > 0) { s << ","; }
+            s << zone;
+          }
+        }
+        return s.str();
+      }
+  }
+  return "";
+}
+
+std::string
+BypassedZonesBitfieldDump::getParamName(int number) const
+{
+  switch (number)
+  {
+    case 0: return "Zones";
+  }
+  return "";
+}
+
+bool registeredBypassedZonesBitfieldDump = 
+  Command::addCreator(Command::BYPASSED_ZONES_BITFIELD_DUMP,  BypassedZonesBitfieldDump::create);
+
 /** *******************************************************************
  * Command 620 (Duress Alarm)
  * Parameters: 4 bytes (0000)
@@ -2351,7 +2568,7 @@ WirelessKeyLowBatteryTrouble::getStringParam(int number) const
 {
   switch (number)
   {
-    case 0: return Config::getConfig().getKeyName(getIntParam(0));
+    case 0: return mIt100.getKeyName(getIntParam(0));
   }
   return "";
 }
@@ -2379,7 +2596,7 @@ WirelessKeyLowBatteryTroubleRestore::getStringParam(int number) const
 {
   switch (number)
   {
-    case 0: return Config::getConfig().getKeyName(getIntParam(0));
+    case 0: return mIt100.getKeyName(getIntParam(0));
   }
   return "";
 }
@@ -2407,7 +2624,7 @@ HandheldKeypadLowBatteryTrouble::getStringParam(int number) const
 {
   switch (number)
   {
-    case 0: return Config::getConfig().getKeypadName(getIntParam(0));
+    case 0: return mIt100.getKeypadName(getIntParam(0));
   }
   return "";
 }
@@ -2435,7 +2652,7 @@ HandheldKeypadLowBatteryTroubleRestore::getStringParam(int number) const
 {
   switch (number)
   {
-    case 0: return Config::getConfig().getKeypadName(getIntParam(0));
+    case 0: return mIt100.getKeypadName(getIntParam(0));
   }
   return "";
 }
@@ -54,9 +54,12 @@ class Command
 
     virtual void processStateChange() const {;}
     std::string getCommandWithChecksum() const;
+    const char *getParameters() const { return mCommand.c_str() + 3; }
     int getSyslogPriority() const;
     std::string getShellAction() const;
+    std::string expand(const std::string &format) const;
 
+    size_t format(char *buffer, size_t size) const;
     virtual void dump(std::ostream &os) const;
 
   protected:
@@ -122,6 +125,7 @@ class Command
       ZONE_FAULT_RESTORE                          = 606,
       ZONE_OPEN                                   = 609,
       ZONE_RESTORED                               = 610,
+      BYPASSED_ZONES_BITFIELD_DUMP                = 616,
       DURESS_ALARM                                = 620,
       F_KEY_ALARM                                 = 621,
       F_KEY_RESTORAL                              = 622,
@@ -737,6 +741,8 @@ class CommandError : public CommandWithNoParameters
     virtual std::string getName() const { return "Command Error"; }
     virtual int getCommandNumber() const { return COMMAND_ERROR; }
 
+    virtual void processStateChange() const {mIt100.sendPendingCommand();}
+
   protected:
     CommandError(It100 &it100, std::string command)
       : CommandWithNoParameters(it100, command){;}
@@ -966,6 +972,10 @@ class ZoneAlarm : public Command
     virtual std::string getName() const { return "Zone Alarm"; }
     virtual int getCommandNumber() const { return ZONE_ALARM; }
 
+    virtual void processStateChange() const
+      {mIt100.setZoneCondition(ZoneState::ALARM, getIntParam(0),
+                            getIntParam(1), true);}
+
   protected:
     ZoneAlarm(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -990,6 +1000,10 @@ class ZoneAlarmRestore : public Command
     virtual std::string getName() const { return "Zone Alarm Restore"; }
     virtual int getCommandNumber() const { return ZONE_ALARM_RESTORE; }
 
+    virtual void processStateChange() const
+      {mIt100.setZoneCondition(ZoneState::ALARM, getIntParam(0),
+                            getIntParam(1), false);}
+
   protected:
     ZoneAlarmRestore(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1014,6 +1028,10 @@ class ZoneTamper : public Command
     virtual std::string getName() const { return "Zone Tamper"; }
     virtual int getCommandNumber() const { return ZONE_TAMPER; }
 
+    virtual void processStateChange() const
+      {mIt100.setZoneCondition(ZoneState::TAMPER, getIntParam(0),
+                            getIntParam(1), true);}
+
   protected:
     ZoneTamper(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1038,6 +1056,10 @@ class ZoneTamperRestore : public Command
     virtual std::string getName() const { return "Zone Tamper Restore"; }
     virtual int getCommandNumber() const { return ZONE_TAMPER_RESTORE; }
 
+    virtual void processStateChange() const
+      {mIt100.setZoneCondition(ZoneState::TAMPER, getIntParam(0),
+                            getIntParam(1), false);}
+
   protected:
     ZoneTamperRestore(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1062,6 +1084,9 @@ class ZoneFault : public Command
     virtual std::string getName() const { return "Zone Fault"; }
     virtual int getCommandNumber() const { return ZONE_FAULT; }
 
+    virtual void processStateChange() const
+      {mIt100.setZoneCondition(ZoneState::FAULT, 0, getIntParam(0), true);}
+
   protected:
     ZoneFault(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1086,6 +1111,10 @@ class ZoneFaultRestore : public Command
     virtual std::string getName() const { return "Zone Fault Restore"; }
     virtual int getCommandNumber() const { return ZONE_FAULT_RESTORE; }
 
+    virtual void processStateChange() const
+      {mIt100.setZoneCondition(ZoneState::FAULT, 0, getIntParam(0),
+                            false);}
+
   protected:
     ZoneFaultRestore(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1145,6 +1174,38 @@ class ZoneRestored : public Command
       : Command(it100, command){;}
 };
 
+/** *******************************************************************
+ * Command 616 (Bypassed Zones Bitfield Dump)
+ * Parameters: 16 bytes (8 hex bytes, zones 1-8 in the first, lowest
+ * zone in the least significant bit)
+ *********************************************************************/
+
+class BypassedZonesBitfieldDump : public Command
+{
+  public:
+    static Command *create(It100 &it100, std::string command)
+      { return new BypassedZonesBitfieldDump(it100, command); }
+
+    /* 1 parameter, 16 bytes -- (Bypassed zones) */
+    virtual int getNumParams() const { return 1; }
+    virtual int getIntParam(int number) const;
+    virtual std::string getStringParam(int number) const;
+    virtual std::string getParamName(int number) const;
+    virtual std::string getName() const
+      { return "Bypassed Zones Bitfield Dump"; }
+    virtual int getCommandNumber() const
+      { return BYPASSED_ZONES_BITFIELD_DUMP; }
+
+    virtual void processStateChange() const
+      {mIt100.setBypassedZones(getZones());}
+
+    uint64_t getZones() const;
+
+  protected:
+    BypassedZonesBitfieldDump(It100 &it100, std::string command)
+      : Command(it100, command){;}
+};
+
 /** *******************************************************************
  * Command 620 (Duress Alarm)
  * Parameters: 4 bytes (0000)
@@ -1340,6 +1401,9 @@ class PartitionReady : public Command
     virtual std::string getName() const { return "Partition Ready"; }
     virtual int getCommandNumber() const { return PARTITION_READY; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     PartitionReady(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1364,6 +1428,9 @@ class PartitionNotReady : public Command
     virtual std::string getName() const { return "Partition Not Ready"; }
     virtual int getCommandNumber() const { return PARTITION_NOT_READY; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     PartitionNotReady(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1388,6 +1455,10 @@ class PartitionArmedDescriptiveMode : public Command
     virtual std::string getName() const { return "Partition Armed - Descriptive Mode"; }
     virtual int getCommandNumber() const { return PARTITION_ARMED_DESCRIPTIVE_MODE; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0),
+                                getIntParam(1));}
+
   protected:
     PartitionArmedDescriptiveMode(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1412,6 +1483,9 @@ class PartitioninReadytoForceArm : public Command
     virtual std::string getName() const { return "Partition in Ready to Force Arm"; }
     virtual int getCommandNumber() const { return PARTITION_IN_READY_TO_FORCE_ARM; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     PartitioninReadytoForceArm(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1436,6 +1510,9 @@ class PartitionInAlarm : public Command
     virtual std::string getName() const { return "Partition In Alarm"; }
     virtual int getCommandNumber() const { return PARTITION_IN_ALARM; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     PartitionInAlarm(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1460,6 +1537,9 @@ class PartitionDisarmed : public Command
     virtual std::string getName() const { return "Partition Disarmed"; }
     virtual int getCommandNumber() const { return PARTITION_DISARMED; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     PartitionDisarmed(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1484,6 +1564,9 @@ class ExitDelayinProgress : public Command
     virtual std::string getName() const { return "Exit Delay in Progress"; }
     virtual int getCommandNumber() const { return EXIT_DELAY_IN_PROGRESS; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     ExitDelayinProgress(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1508,6 +1591,9 @@ class EntryDelayinProgress : public Command
     virtual std::string getName() const { return "Entry Delay in Progress"; }
     virtual int getCommandNumber() const { return ENTRY_DELAY_IN_PROGRESS; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     EntryDelayinProgress(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1676,6 +1762,9 @@ class PartitionBusy : public Command
     virtual std::string getName() const { return "Partition Busy"; }
     virtual int getCommandNumber() const { return PARTITION_BUSY; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     PartitionBusy(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1700,6 +1789,10 @@ class UserClosing : public Command
     virtual std::string getName() const { return "User Closing"; }
     virtual int getCommandNumber() const { return USER_CLOSING; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0),
+                                getIntParam(1));}
+
   protected:
     UserClosing(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1724,6 +1817,9 @@ class SpecialClosing : public Command
     virtual std::string getName() const { return "Special Closing"; }
     virtual int getCommandNumber() const { return SPECIAL_CLOSING; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     SpecialClosing(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1748,6 +1844,9 @@ class PartialClosing : public Command
     virtual std::string getName() const { return "Partial Closing"; }
     virtual int getCommandNumber() const { return PARTIAL_CLOSING; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     PartialClosing(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1772,6 +1871,10 @@ class UserOpening : public Command
     virtual std::string getName() const { return "User Opening"; }
     virtual int getCommandNumber() const { return USER_OPENING; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0),
+                                getIntParam(1));}
+
   protected:
     UserOpening(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -1796,6 +1899,9 @@ class SpecialOpening : public Command
     virtual std::string getName() const { return "Special Opening"; }
     virtual int getCommandNumber() const { return SPECIAL_OPENING; }
 
+    virtual void processStateChange() const
+      {mIt100.setPartitionState(getCommandNumber(), getIntParam(0));}
+
   protected:
     SpecialOpening(It100 &it100, std::string command)
       : Command(it100, command){;}
@@ -30,16 +30,29 @@
 
 #include "CommandProcessor.h"
 #include "It100.h"
+#include "Config.h"
 
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <unistd.h> 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <iostream>
+#include <string>
 
-CommandProcessor::CommandProcessor(int descriptor, It100 &it100)
-  : mDescriptor(descriptor), mIt100(it100), mBufferSize(0), mDone(false),
-    mWaitingEtag(0), mWaitForStateChange(0)
+// Upper bound for open-ended history queries
+static const uint64_t FOREVER = ~(uint64_t)0;
+
+static void appendQuoted(std::string &out, const char *text, size_t length);
+
+CommandProcessor::CommandProcessor(int descriptor,
+                                   std::vector<It100*> &panels)
+  : mDescriptor(descriptor), mPanels(panels), mIt100(panels.front()),
+    mBufferSize(0), mDone(false), mWaitingEtag(0), mWaitForStateChange(0),
+    mFollowing(false), mFollowFrom(0), mSubscribed(false),
+    mSubscribeFrom(0)
 {
   char one=1;
   ioctl(mDescriptor, FIONBIO, (char *)&one);
@@ -53,11 +66,41 @@ void
 CommandProcessor::process()
 {
   if (mDone) { return; }
+  flush();
 
-  if (mWaitForStateChange && mWaitingEtag != mIt100.getKeypadEtag())
+  if (mWaitForStateChange && mWaitingEtag != mIt100->getKeypadEtag())
   {
     mWaitForStateChange = false;
     sendKeypadStatus();
+    mIt100->clientNotified();
+  }
+
+  if (mFollowing && mIt100->getHistory().getNewest() >= mFollowFrom)
+  {
+    std::vector<Journal::Record> events;
+    bool more;
+    uint64_t next;
+    mIt100->getHistory().find(0, mIt100->getPanel(), mFollowFilter,
+                              mFollowFrom, FOREVER, PAGE_SIZE,
+                              events, more, next);
+    if (events.size())
+    {
+      mFollowing = false;
+      sendEvents(events, more, mFollowFrom);
+    }
+    else
+    {
+      // Nothing matched; don't look at those again
+      mFollowFrom = mIt100->getHistory().getNewest() + 1;
+    }
+  }
+
+  // While earlier pushes are still queued, let events pile up into
+  // one bigger push rather than adding to the queue
+  if (mSubscribed && mOutput.length() < MAX_BACKLOG &&
+      mIt100->getHistory().getNewest() >= mSubscribeFrom)
+  {
+    pushEvents();
   }
 
   char c;
@@ -102,6 +145,21 @@ CommandProcessor::process()
 void
 CommandProcessor::processBuffer()
 {
+  if (mBufferSize && mBuffer[0] == '@' && selectPanel())
+  {
+    // Rest of the line is a command for the newly selected panel
+    processBuffer();
+    return;
+  }
+
+  if (mBufferSize > 1 && mBuffer[0] >= 'a' && mBuffer[0] <= 'z')
+  {
+    mBuffer[mBufferSize] = 0;
+    processQuery();
+    mBufferSize = 0;
+    return;
+  }
+
   if (mBufferSize == 1)
   {
     switch(mBuffer[0])
@@ -111,9 +169,9 @@ CommandProcessor::processBuffer()
       case '*': case '#': case 'F': case 'A': case 'P':
       case 'a': case 'b': case 'c': case 'd': case 'e':
       case '<': case '>': case '=': case '^':
-        mIt100.keyPressed(mBuffer[0]);
-        write(mDescriptor, mBuffer, 1);
-        write(mDescriptor, "\n", 1);
+        mIt100->keyPressed(mBuffer[0]);
+        send(mBuffer, 1);
+        send("\n", 1);
         break;
 
       case '?':
@@ -127,9 +185,9 @@ CommandProcessor::processBuffer()
   }
   else if (mBuffer[0] == '?')
   {
-    write(mDescriptor, mBuffer, mBufferSize);
+    send(mBuffer, mBufferSize);
     mWaitingEtag = strtol(mBuffer+1,0,10);
-    write(mDescriptor, "\n", 1);
+    send("\n", 1);
     mWaitForStateChange = true;
   }
   mBufferSize = 0;
@@ -143,23 +201,439 @@ CommandProcessor::sendKeypadStatus()
     snprintf(buffer, sizeof(buffer)-1, "[%u,%d,%d,%d,%d,%d,%d,%d,%d,%d,"
                                        "'%s','%s',%d,%d,%d,"
                                        "%d,%d,%d,%d,%d,%d]\n",
-            mIt100.getKeypadEtag(),
-            mIt100.getLedState(It100::READY),
-            mIt100.getLedState(It100::ARMED),
-            mIt100.getLedState(It100::MEMORY),
-            mIt100.getLedState(It100::BYPASS),
-            mIt100.getLedState(It100::TROUBLE),
-            mIt100.getLedState(It100::PROGRAM),
-            mIt100.getLedState(It100::FIRE),
-            mIt100.getLedState(It100::BACKLIGHT),
-            mIt100.getLedState(It100::AC),
-            std::string(mIt100.getLcd(),16).c_str(),
-            mIt100.getLcd()+16,
-            mIt100.getCursorType(),
-            mIt100.getCursorLine(),
-            mIt100.getCursorColumn(),
+            mIt100->getKeypadEtag(),
+            mIt100->getLedState(It100::READY),
+            mIt100->getLedState(It100::ARMED),
+            mIt100->getLedState(It100::MEMORY),
+            mIt100->getLedState(It100::BYPASS),
+            mIt100->getLedState(It100::TROUBLE),
+            mIt100->getLedState(It100::PROGRAM),
+            mIt100->getLedState(It100::FIRE),
+            mIt100->getLedState(It100::BACKLIGHT),
+            mIt100->getLedState(It100::AC),
+            std::string(mIt100->getLcd(),16).c_str(),
+            mIt100->getLcd()+16,
+            mIt100->getCursorType(),
+            mIt100->getCursorLine(),
+            mIt100->getCursorColumn(),
             // TODO -- Add the audio stuff in here
             0,0,0,0,0,0
             );
-  write(mDescriptor, buffer, buflen);
+  send(buffer, buflen);
+}
+
+/**
+  Handles "@N[command]" and "@*". Returns true if there's a command
+  left in the buffer to process.
+*/
+bool
+CommandProcessor::selectPanel()
+{
+  mBuffer[mBufferSize] = 0;
+
+  if (mBuffer[1] == '*')
+  {
+    sendPanelSummary();
+    mBufferSize = 0;
+    return false;
+  }
+
+  char *end;
+  int id = strtol(mBuffer + 1, &end, 10);
+  It100 *selected = 0;
+  for (size_t i = 0; i < mPanels.size(); i++)
+  {
+    if (mPanels[i]->getPanel() == id) { selected = mPanels[i]; }
+  }
+
+  if (!selected)
+  {
+    send("@?\n", 3);
+    mBufferSize = 0;
+    return false;
+  }
+
+  if (selected != mIt100)
+  {
+    mIt100 = selected;
+    mWaitForStateChange = false;
+    mFollowing = false;
+    mSubscribed = false;
+  }
+
+  size_t consumed = end - mBuffer;
+  if (consumed >= mBufferSize)
+  {
+    char reply[16];
+    send(reply, snprintf(reply, sizeof(reply), "@%d\n", id));
+    mBufferSize = 0;
+    return false;
+  }
+
+  memmove(mBuffer, end, mBufferSize - consumed + 1);
+  mBufferSize -= consumed;
+  return true;
+}
+
+/**
+  One line covering every panel:
+  [[panel,'name',etag,'open zones',ready,armed,trouble,ac,connected],...]
+*/
+void
+CommandProcessor::sendPanelSummary()
+{
+  std::string summary = "[";
+  for (size_t i = 0; i < mPanels.size(); i++)
+  {
+    It100 *it = mPanels[i];
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s[%d,'%s',%u,'%016llx',%d,%d,%d,%d,%d]",
+             i ? "," : "",
+             it->getPanel(),
+             it->getPanelName().c_str(),
+             it->getKeypadEtag(),
+             (unsigned long long)it->getZoneStatus(),
+             it->getLedState(It100::READY),
+             it->getLedState(It100::ARMED),
+             it->getLedState(It100::TROUBLE),
+             it->getLedState(It100::AC),
+             it->isConnected() ? 1 : 0);
+    summary += buffer;
+  }
+  summary += "]\n";
+  send(summary.data(), summary.length());
+}
+
+/**
+  Zone conditions for the selected panel; partition 0 is all of it.
+*/
+void
+CommandProcessor::sendZones(int partition)
+{
+  const ZoneState &zones = mIt100->getZones();
+  char buffer[256];
+  int length = snprintf(buffer, sizeof(buffer), "[%d,'%016llx'", partition,
+                        (unsigned long long)zones.getMembers(partition));
+  for (int c = 0; c < ZoneState::NUM_CONDITIONS; c++)
+  {
+    length += snprintf(buffer + length, sizeof(buffer) - length, ",'%016llx'",
+      (unsigned long long)zones.get((ZoneState::condition_t)c, partition));
+  }
+  for (int c = 0; c < ZoneState::NUM_CONDITIONS; c++)
+  {
+    length += snprintf(buffer + length, sizeof(buffer) - length, ",%d",
+                       zones.count((ZoneState::condition_t)c, partition));
+  }
+  length += snprintf(buffer + length, sizeof(buffer) - length, "]\n");
+  send(buffer, length);
+}
+
+/**
+  Zone activity for the selected panel; zone 0 is all that have any.
+*/
+void
+CommandProcessor::sendZoneStats(int zone)
+{
+  const ZoneStats &stats = mIt100->getZoneStats();
+  uint64_t open = mIt100->getZoneStatus();
+  uint64_t now = Journal::now();
+
+  std::string reply = "[";
+  for (int z = zone ? zone : 1; z <= (zone ? zone : ZoneStats::NUM_ZONES);
+       z++)
+  {
+    const ZoneStats::Zone &s = stats.zone[z - 1];
+    if (!zone && !s.lastChange) { continue; }
+
+    bool isOpen = open & ZoneState::bit(z);
+    uint64_t openFor = stats.getOpenFor(z, isOpen, now);
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer), "%s[%d,", reply.length() > 1 ? "," : "",
+             z);
+    reply += buffer;
+    const std::string &name = mIt100->getZoneName(z);
+    appendQuoted(reply, name.data(), name.length());
+    snprintf(buffer, sizeof(buffer), ",%d,%llu,%llu,%llu,%llu,[",
+             isOpen ? 1 : 0, (unsigned long long)s.opens,
+             (unsigned long long)((s.openTime + openFor) / 1000000),
+             (unsigned long long)(openFor / 1000000),
+             (unsigned long long)(s.lastChange / 1000000));
+    reply += buffer;
+    for (int h = 0; h < ZoneStats::HOURS; h++)
+    {
+      snprintf(buffer, sizeof(buffer), "%s%u", h ? "," : "", s.hourly[h]);
+      reply += buffer;
+    }
+    reply += "]]";
+  }
+  reply += "]\n";
+  send(reply.data(), reply.length());
+}
+
+/**
+  Partition states for the selected panel.
+*/
+void
+CommandProcessor::sendPartitions()
+{
+  std::string reply = "[";
+  for (int p = 1; p <= ZoneState::NUM_PARTITIONS; p++)
+  {
+    const PartitionState &state = mIt100->getPartitionState(p);
+    if (state.state == PartitionState::UNKNOWN) { continue; }
+
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer), "%s[%d,'%s',%d,%d,%d,%u]",
+             reply.length() > 1 ? "," : "", p,
+             PartitionState::getStateName(state.state), state.armMode,
+             state.ready, state.user, state.since);
+    reply += buffer;
+  }
+  reply += "]\n";
+  send(reply.data(), reply.length());
+}
+
+/**
+  Round trip times to the selected panel, by command.
+*/
+void
+CommandProcessor::sendAcks()
+{
+  const AckTracker &acks = mIt100->getAckTracker();
+  uint64_t age = 0;
+  if (acks.isPending()) { age = (Capture::now() - acks.getSentAt()) / 1000; }
+
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "[%d,%llu,%u,", acks.getPending(),
+           (unsigned long long)age, (unsigned)mIt100->getQueuedCommands());
+  std::string reply = buffer + acks.format() + "]\n";
+  send(reply.data(), reply.length());
+}
+
+/**
+  History queries: "last", "since", "range", "follow" and "subscribe",
+  each with optional filters. See CommandProcessor.h for the details.
+*/
+void
+CommandProcessor::processQuery()
+{
+  char *words[8] = { 0 };
+  int count = 0;
+  char *save;
+  for (char *word = strtok_r(mBuffer, " ", &save);
+       word && count < 8; word = strtok_r(0, " ", &save))
+  {
+    words[count++] = word;
+  }
+
+  // Positional arguments first, then filters
+  bool subscribe = !strcmp(words[0], "subscribe");
+  History::Filter filter;
+  Subscription subscription;
+  uint64_t args[2] = {0, 0};
+  int argCount = 0;
+  for (int i = 1; i < count; i++)
+  {
+    if (strchr(words[i], '='))
+    {
+      bool parsed = subscribe ? subscription.parse(words[i])
+                              : filter.parse(words[i]);
+      if (!parsed) { send("!?\n", 3); return; }
+    }
+    else if (argCount < 2)
+    {
+      args[argCount++] = strtoull(words[i], 0, 10);
+    }
+  }
+
+  const History &history = mIt100->getHistory();
+  const Journal &journal = mIt100->getJournal();
+  std::vector<Journal::Record> events;
+  bool more = false;
+  uint64_t next;
+
+  if (!strcmp(words[0], "last") && argCount == 1)
+  {
+    size_t n = args[0] < MAX_LAST ? args[0] : (uint64_t)MAX_LAST;
+    history.findLast(&journal, mIt100->getPanel(), filter, n, events, more);
+    sendEvents(events, more, history.getNewest() + 1);
+  }
+  else if (!strcmp(words[0], "since") && argCount == 1)
+  {
+    history.find(&journal, mIt100->getPanel(), filter, args[0],
+                 FOREVER, PAGE_SIZE, events, more, next);
+    sendEvents(events, more, next);
+  }
+  else if (!strcmp(words[0], "range") && argCount == 2)
+  {
+    history.find(&journal, mIt100->getPanel(), filter, args[0],
+                 args[1], PAGE_SIZE, events, more, next);
+    sendEvents(events, more, next);
+  }
+  else if (!strcmp(words[0], "zones") && argCount <= 1 &&
+           args[0] <= ZoneState::NUM_PARTITIONS)
+  {
+    sendZones((int)args[0]);
+  }
+  else if (!strcmp(words[0], "zonestats") && argCount <= 1 &&
+           args[0] <= ZoneStats::NUM_ZONES)
+  {
+    sendZoneStats((int)args[0]);
+  }
+  else if (!strcmp(words[0], "partitions") && count == 1)
+  {
+    sendPartitions();
+  }
+  else if (!strcmp(words[0], "acks") && count == 1)
+  {
+    sendAcks();
+  }
+  else if (!strcmp(words[0], "follow") && argCount == 1)
+  {
+    // Anything already there is answered straight away; otherwise
+    // process() answers when something turns up.
+    history.find(&journal, mIt100->getPanel(), filter, args[0],
+                 FOREVER, PAGE_SIZE, events, more, next);
+    if (events.size() || more)
+    {
+      sendEvents(events, more, next);
+    }
+    else
+    {
+      mFollowing = true;
+      mFollowFrom = args[0];
+      mFollowFilter = filter;
+    }
+  }
+  else if (subscribe && argCount <= 1)
+  {
+    // Events from the cursor on go out with the first push
+    mSubscribed = true;
+    mSubscribeFrom = argCount ? args[0] : history.getNewest() + 1;
+    mSubscription = subscription;
+    sendEvents(events, false, mSubscribeFrom);
+  }
+  else if (!strcmp(words[0], "unsubscribe") && count == 1)
+  {
+    mSubscribed = false;
+    sendEvents(events, false, mSubscribeFrom);
+  }
+  else
+  {
+    send("!?\n", 3);
+  }
+}
+
+/**
+  Everything since the last push that the subscription matches, as
+  one line. Past the in-memory history this reads the journal, so a
+  subscriber that falls behind still sees every event; a long way
+  behind, it catches up a bounded piece per pass of the main loop.
+*/
+void
+CommandProcessor::pushEvents()
+{
+  Config &config = Config::getConfig();
+  std::vector<Journal::Record> events;
+  bool more;
+  uint64_t next;
+  mIt100->getHistory().find(&mIt100->getJournal(), mIt100->getPanel(),
+                            History::Filter(), mSubscribeFrom, FOREVER,
+                            MAX_BATCH, events, more, next);
+  mSubscribeFrom = next;
+  if (events.empty()) { return; }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < events.size(); i++)
+  {
+    int priority = config.getSyslogPriority(events[i].code);
+    if (mSubscription.matches(events[i], priority))
+    {
+      events[kept++] = events[i];
+    }
+  }
+  events.resize(kept);
+  if (kept) { sendEvents(events, more, mSubscribeFrom, true); }
+}
+
+// Single-quoted, with quotes and backslashes escaped
+static void
+appendQuoted(std::string &out, const char *text, size_t length)
+{
+  out += '\'';
+  for (size_t i = 0; i < length && text[i]; i++)
+  {
+    if (text[i] == '\'' || text[i] == '\\') { out += '\\'; }
+    out += text[i];
+  }
+  out += '\'';
+}
+
+/**
+  [CURSOR,MORE,[[time,code,'NAME',zone,partition,etag,'data','name',
+  'name'],...]], with a leading '+' for a push to a subscriber. With no
+  events the cursor is left where it was.
+*/
+void
+CommandProcessor::sendEvents(const std::vector<Journal::Record> &events,
+                             bool more, uint64_t cursor, bool pushed)
+{
+  Config &config = Config::getConfig();
+  std::string reply;
+  char buffer[64];
+
+  if (events.size() && events.back().time + 1 > cursor)
+  {
+    cursor = events.back().time + 1;
+  }
+  snprintf(buffer, sizeof(buffer), "%s[%llu,%d,[", pushed ? "+" : "",
+           (unsigned long long)cursor, more ? 1 : 0);
+  reply = buffer;
+
+  for (size_t i = 0; i < events.size(); i++)
+  {
+    const Journal::Record &e = events[i];
+    const char *name = config.commandIntToName(e.code);
+
+    snprintf(buffer, sizeof(buffer), "%s[%llu,%d,", i ? "," : "",
+             (unsigned long long)e.time, e.code);
+    reply += buffer;
+    if (!name) { name = ""; }
+    appendQuoted(reply, name, strlen(name));
+    snprintf(buffer, sizeof(buffer), ",%d,%d,%u,", e.zone, e.partition,
+             e.etag);
+    reply += buffer;
+    appendQuoted(reply, e.data, e.length);
+    reply += ',';
+    appendQuoted(reply, e.name[0], Journal::NAME_LENGTH);
+    reply += ',';
+    appendQuoted(reply, e.name[1], Journal::NAME_LENGTH);
+    reply += ']';
+  }
+  reply += "]]\n";
+  send(reply.data(), reply.length());
+}
+
+void
+CommandProcessor::send(const char *data, size_t length)
+{
+  mOutput.append(data, length);
+  flush();
+}
+
+void
+CommandProcessor::flush()
+{
+  while (mOutput.length())
+  {
+    int s = write(mDescriptor, mOutput.data(), mOutput.length());
+    if (s <= 0)
+    {
+      if (s < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { return; }
+      mDone = true;
+      mOutput.clear();
+      return;
+    }
+    mOutput.erase(0, s);
+  }
 }
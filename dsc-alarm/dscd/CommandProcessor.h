@@ -32,37 +32,143 @@
 #define _COMMAND_PROCESSOR_H 1
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "History.h"
+#include "Subscription.h"
 
 class It100;
 
 /**
   Listens on local socket for information from virtual keypad
   and from commandline programs; provides alarm status.
+
+  Commands apply to the first panel until the client selects another
+  with "@N" (optionally followed by a command for that panel, as in
+  "@2?"). "@*" returns a one-line summary of every panel.
+
+  Event history for the selected panel:
+
+    last N [filters]          the last N events (up to 1000)
+    since CURSOR [filters]    events from CURSOR on, a page at a time
+    range FROM TO [filters]   events from FROM up to (not including) TO
+    follow CURSOR [filters]   like since, but waits for an event
+
+  Times and cursors are ns since the epoch. Filters are code=NNN,
+  class=(system|zone|alarm|partition|access|trouble|keypad), zone=N and
+  partition=N. The answer is one line:
+
+    [CURSOR,MORE,[[time,code,'NAME',zone,partition,etag,'data',
+                   'name','name'],...]]
+
+  Pass CURSOR back with "since" (or as FROM to "range") to carry on;
+  MORE is 1 if there were more events than fit on a page, or if the
+  answer stopped rather than read too much of the journal at once (so
+  a short or even empty page can still have MORE set). For "last",
+  MORE means older matches may have been left out.
+
+  "subscribe [CURSOR] [filters]" pushes matching events as they happen,
+  until "unsubscribe" or another panel is selected. Besides the filters
+  above, repeated code=, class=, zone= and partition= terms add to each
+  other (as do lists like zone=3,12), and priority=LEVEL (a [syslog]
+  level) leaves out anything less severe. Both verbs answer [CURSOR,0,[]], where the pushes start
+  or stopped; CURSOR defaults to now. Each push is an answer line as
+  above with a leading '+', holding everything that matched since the
+  last one, so a busy panel or a slow reader gets fewer, bigger lines.
+
+  "zones [PARTITION]" reports zone conditions, for one partition or
+  (without one) the whole panel:
+
+    [PARTITION,'members','open','alarm','tamper','fault','bypass',
+     open,alarm,tamper,fault,bypass]
+
+  Zone sets are 64-bit hex masks, zone N in bit N-1, followed by how
+  many zones are in each condition.
+
+  "zonestats [ZONE]" reports activity for one zone, or every zone that
+  has ever changed:
+
+    [[zone,'name',open,opens,open_ms,open_for_ms,last_change_ms,
+      [opens by hour of day, 0-23]],...]
+
+  open_ms is the total time spent open, including open_for_ms, the
+  time the zone has been open if it is now; last_change_ms is since
+  the epoch.
+
+  "partitions" reports the state of each partition the panel has told
+  us about:
+
+    [[partition,'state',mode,ready,user,since],...]
+
+  with state one of ready, not-ready, exit-delay, armed-stay,
+  armed-away, entry-delay, alarm or busy; mode the arming mode from
+  the last 652 (0 away, 1 stay, 2 and 3 the same without entry delay);
+  user whoever last armed or disarmed it (0 if not known); and since
+  when the state last changed, in seconds since the epoch.
+
+  "acks" reports how quickly the panel has been answering commands:
+
+    [PENDING,AGE,QUEUED,[[code,'NAME',count,errors,timeouts,outliers,
+                          min,mean,max,srtt],...]]
+
+  PENDING is the command awaiting a reply (-1 for none) and AGE how
+  long it has waited; QUEUED are waiting behind it. Times are in us.
 */
 
 class CommandProcessor
 {
   public:
-    CommandProcessor(int descriptor, It100 &it100);
+    CommandProcessor(int descriptor, std::vector<It100*> &panels);
     ~CommandProcessor();
 
     void process();
 
     int getDescriptor() { return mDescriptor; }
     bool isDone() { return mDone; }
+    bool isWaiting()
+      { return mWaitForStateChange || mFollowing || mSubscribed; }
 
   private:
+    enum { PAGE_SIZE = 100, MAX_LAST = 1000, MAX_BATCH = 1000,
+           MAX_BACKLOG = 65536 };
+
     void processBuffer();
+    void processQuery();
     void sendKeypadStatus();
+    void sendPanelSummary();
+    void sendAcks();
+    void sendZones(int partition);
+    void sendPartitions();
+    void sendZoneStats(int zone);
+    void sendEvents(const std::vector<Journal::Record> &events, bool more,
+                    uint64_t cursor, bool pushed = false);
+    void pushEvents();
+    bool selectPanel();
+
+    // Replies are queued and written as the socket accepts them
+    void send(const char *data, size_t length);
+    void flush();
 
   private:
     int mDescriptor;
-    It100 &mIt100;
+    std::vector<It100*> &mPanels;
+    It100 *mIt100;
     char mBuffer[80];
     size_t mBufferSize;
     bool mDone;
     unsigned int mWaitingEtag;
     bool mWaitForStateChange;
+    std::string mOutput;
+
+    bool mFollowing;
+    uint64_t mFollowFrom;
+    History::Filter mFollowFilter;
+
+    bool mSubscribed;
+    uint64_t mSubscribeFrom;
+    Subscription mSubscription;
 };
 
 #endif
@@ -29,9 +29,11 @@
 --------------------------------------------------------------------------- */
 
 #include "Config.h"
+#include "Log.h"
 #include "It100.h"
 
 #include <unistd.h>
+#include <string.h>
 #include <iostream>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -39,6 +41,7 @@
 
 
 Config *Config::theConfig = 0;
+Config *Config::retiredConfig = 0;
 
 Config &Config::getConfig(std::string filename)
 {
@@ -55,12 +58,197 @@ Config &Config::getConfig(std::string filename)
 }
 
 Config::Config (std::string filename)
+  : mLoaded(false), mModified(0), mSize(0)
 {
    if ( filename.empty() )
    {
       filename = DEFAULT_CONFIG_FILE;
    }
-  readConfig(filename);
+  mConfigFile = filename;
+  compileCommandTables();
+  mLoaded = readConfig(filename);
+}
+
+/**
+  Parse the configuration file into a brand new Config, and swap it in
+  only if it loads and validates. Lookups in progress can never see a
+  half-read dictionary, and a broken edit leaves the running
+  configuration alone.
+
+  The previous snapshot is kept until the next reload, so references
+  obtained from it just before the swap stay valid.
+*/
+bool
+Config::reload()
+{
+  Config *current = &getConfig();
+  Config *next = new Config(current->mConfigFile);
+
+  if (!next->validate())
+  {
+    Log::getLog().write(Log::CONSOLE|Log::SYSLOG, LOG_ERR,
+                        "Not reloading %s: configuration is invalid",
+                        current->mConfigFile.c_str());
+    // Don't keep retrying the same broken file
+    current->mModified = next->mModified;
+    current->mSize = next->mSize;
+    delete next;
+    return false;
+  }
+
+  std::string ignored = next->getRestartChanges(*current);
+
+  delete retiredConfig;
+  retiredConfig = current;
+  theConfig = next;
+
+  Log::getLog().write(Log::CONSOLE|Log::SYSLOG, LOG_NOTICE,
+                      "Reloaded configuration from %s",
+                      next->mConfigFile.c_str());
+  if (ignored.length())
+  {
+    Log::getLog().write(Log::CONSOLE|Log::SYSLOG, LOG_WARNING,
+                        "Changes to %s take effect on restart",
+                        ignored.c_str());
+  }
+  return true;
+}
+
+static void
+addChange(std::string &changes, const char *what)
+{
+  if (changes.length()) { changes += ", "; }
+  changes += what;
+}
+
+/**
+  The settings read once at startup that differ from previous, as a
+  list for the log; empty if there are none.
+*/
+std::string
+Config::getRestartChanges(Config &previous)
+{
+  std::string changes;
+  if (getPort() != previous.getPort()) { addChange(changes, "port"); }
+  if (getPanels() != previous.getPanels())
+  {
+    addChange(changes, "the set of panels");
+  }
+  std::vector<int> panels = getPanels();
+  for (size_t i = 0; i < panels.size(); i++)
+  {
+    if (getStateFile(panels[i]) != previous.getStateFile(panels[i]))
+    {
+      addChange(changes, "state_file");
+      break;
+    }
+  }
+  if (getMetricsPort() != previous.getMetricsPort())
+  {
+    addChange(changes, "metrics_port");
+  }
+  if (getLogFile() != previous.getLogFile())
+  {
+    addChange(changes, "log_file");
+  }
+  if (getPlugins() != previous.getPlugins())
+  {
+    addChange(changes, "[plugins]");
+  }
+  return changes;
+}
+
+bool
+Config::validate()
+{
+  if (!mLoaded)
+  {
+    return false;
+  }
+
+  if (getPort() == 0)
+  {
+    std::cerr << mConfigFile << ": no port configured" << std::endl;
+    return false;
+  }
+
+  if (mTableError.length())
+  {
+    std::cerr << mConfigFile << ": " << mTableError << std::endl;
+    return false;
+  }
+
+  std::vector<int> panels = getPanels();
+  for (size_t i = 0; i < panels.size(); i++)
+  {
+    if (getDevice(panels[i]).length() == 0)
+    {
+      std::cerr << mConfigFile << ": no device for panel " << panels[i]
+                << std::endl;
+      return false;
+    }
+
+    // Serial is the default for anything that isn't another transport
+    std::string transport = getTransport(panels[i]);
+    if (transport != "tcp" && transport != "pty" && transport != "replay" &&
+        getPanelValue(panels[i], "baud").length())
+    {
+      switch (getBaud(panels[i]))
+      {
+        case 9600: case 19200: case 38400: case 57600: case 115200:
+          break;
+        default:
+          std::cerr << mConfigFile << ": panel " << panels[i]
+                    << " can't use baud "
+                    << getPanelValue(panels[i], "baud") << std::endl;
+          return false;
+      }
+    }
+  }
+
+  if (getMqttPassword().length() && getMqttUser().empty())
+  {
+    std::cerr << mConfigFile << ": [mqtt] password needs a user"
+              << std::endl;
+    return false;
+  }
+
+  // Two panels writing one state or capture file would wreck it
+  std::map<std::string, int> files;
+  for (size_t i = 0; i < panels.size(); i++)
+  {
+    std::string paths[2] = { getStateFile(panels[i]),
+                             getCaptureFile(panels[i]) };
+    for (int j = 0; j < 2; j++)
+    {
+      if (paths[j].empty()) { continue; }
+      if (files.count(paths[j]))
+      {
+        std::cerr << mConfigFile << ": panels " << files[paths[j]]
+                  << " and " << panels[i] << " both write " << paths[j]
+                  << std::endl;
+        return false;
+      }
+      files[paths[j]] = panels[i];
+    }
+  }
+  return true;
+}
+
+/**
+  Cheap enough to call about once a second: one stat() of the file.
+*/
+bool
+Config::hasChanged()
+{
+  struct stat st;
+  if (stat(mConfigFile.c_str(), &st))
+  {
+    return false;
+  }
+  // Size as well as time: an editor can rewrite the file several
+  // times within the same second.
+  return (st.st_mtime != mModified || st.st_size != mSize);
 }
 
 class ConfigParser
@@ -225,34 +413,120 @@ class ConfigParser
 bool
 Config::syncTime()
 {
-  std::string flag = mDictionary["main"]["sync_time"];
+  std::string flag = lookup("main", "sync_time");
   return ((flag=="true")?true:false);
 }
 
+std::vector<int>
+Config::getPanels()
+{
+  std::vector<int> panels;
+  std::map<std::string, std::map<std::string,std::string> >::iterator i;
+  for (i = mDictionary.begin(); i != mDictionary.end(); i++)
+  {
+    if (i->first.compare(0, 6, "panel:") == 0)
+    {
+      int panel = strtol(i->first.c_str() + 6, 0, 10);
+      if (panel > 0) { panels.push_back(panel); }
+    }
+  }
+
+  if (panels.empty())
+  {
+    panels.push_back(1);
+  }
+  return panels;
+}
+
+std::string
+Config::getPanelValue(int panel, std::string tag)
+{
+  char section[24];
+  sprintf(section, "panel:%d", panel);
+  std::map<std::string, std::map<std::string,std::string> >::iterator s
+    = mDictionary.find(section);
+  if (s != mDictionary.end())
+  {
+    std::map<std::string,std::string>::iterator v = s->second.find(tag);
+    if (v != s->second.end() && v->second.length())
+    {
+      return v->second;
+    }
+  }
+  return lookup("main", tag);
+}
+
+/**
+  Files a panel writes can't be shared: inherited from [main], they get
+  ".N" appended for every panel but the first.
+*/
+std::string
+Config::getPanelFile(int panel, std::string tag)
+{
+  char section[24];
+  sprintf(section, "panel:%d", panel);
+  std::string path = lookup(section, tag);
+  if (path.length() || panel == 1) { return getPanelValue(panel, tag); }
+
+  path = lookup("main", tag);
+  if (path.length())
+  {
+    char suffix[16];
+    sprintf(suffix, ".%d", panel);
+    path += suffix;
+  }
+  return path;
+}
+
+std::string
+Config::getPanelName(int panel)
+{
+  std::string name = getPanelValue(panel, "name");
+  if (name.length() == 0)
+  {
+    char buffer[24];
+    sprintf(buffer, "Panel %d", panel);
+    name = buffer;
+  }
+  return name;
+}
+
 int
-Config::getBaud()
+Config::getBaud(int panel)
 {
-  std::string baud = mDictionary["main"]["baud"];
+  std::string baud = getPanelValue(panel, "baud");
   return strtol(baud.c_str(),0,10);
 }
 
 std::string
-Config::getDevice()
+Config::getDevice(int panel)
 {
-  return mDictionary["main"]["device"];
+  return getPanelValue(panel, "device");
+}
+
+std::string
+Config::getTransport(int panel)
+{
+  return getPanelValue(panel, "transport");
 }
 
 short
 Config::getPort()
 {
-  std::string port = mDictionary["main"]["port"];
+  std::string port = lookup("main", "port");
   return strtol(port.c_str(),0,10);
 }
 
+unsigned short
+Config::getMetricsPort()
+{
+  return strtol(lookup("main", "metrics_port").c_str(), 0, 10);
+}
+
 int
 Config::getSyslogFacility()
 {
-  std::string facility = mDictionary["syslog"]["facility"];
+  std::string facility = lookup("syslog", "facility");
   if (facility == "LOCAL0") {return LOG_LOCAL0;}
   if (facility == "LOCAL1") {return LOG_LOCAL1;}
   if (facility == "LOCAL2") {return LOG_LOCAL2;}
@@ -275,10 +549,20 @@ Config::getSyslogFacility()
   return LOG_LOCAL0;
 }
 
+/**
+  Looked up once per frame, so this is just an array load; the
+  configuration is compiled into mSyslogPriority by readConfig.
+*/
 int
 Config::getSyslogPriority(int command)
 {
-  std::string level = mDictionary["syslog"][commandIntToName(command)];
+  if (command < 0 || command >= NUM_COMMAND_CODES) { return -1; }
+  return mSyslogPriority[command];
+}
+
+int
+Config::levelToPriority(const std::string &level)
+{
   if (level == "EMERG") { return LOG_EMERG; }
   if (level == "ALERT") { return LOG_ALERT; }
   if (level == "CRIT") { return LOG_CRIT; }
@@ -291,16 +575,260 @@ Config::getSyslogPriority(int command)
   return -1;
 }
 
+std::map<std::string,std::string>
+Config::getPlugins()
+{
+  std::map<std::string, std::map<std::string,std::string> >::iterator i =
+    mDictionary.find("plugins");
+  if (i == mDictionary.end()) { return std::map<std::string,std::string>(); }
+  return i->second;
+}
+
 std::string
 Config::getShell()
 {
-  return mDictionary["main"]["shell"];
+  return lookup("main", "shell");
+}
+
+std::string
+Config::getLogFile()
+{
+  return lookup("main", "log_file");
+}
+
+std::string
+Config::getTraceFile()
+{
+  return lookup("main", "trace_file");
+}
+
+int
+Config::getTraceSample()
+{
+  int sample = strtol(lookup("main", "trace_sample").c_str(), 0, 10);
+  return sample > 0 ? sample : 100;
+}
+
+std::string
+Config::getMqttHost()
+{
+  return lookup("mqtt", "host");
+}
+
+unsigned short
+Config::getMqttPort()
+{
+  int port = strtol(lookup("mqtt", "port").c_str(), 0, 10);
+  return port > 0 ? port : 1883;
+}
+
+std::string
+Config::getMqttClientId()
+{
+  std::string id = lookup("mqtt", "client_id");
+  return id.length() ? id : "dscd";
+}
+
+std::string
+Config::getMqttUser()
+{
+  return lookup("mqtt", "user");
+}
+
+std::string
+Config::getMqttPassword()
+{
+  return lookup("mqtt", "password");
+}
+
+std::string
+Config::getMqttPrefix()
+{
+  std::string prefix = lookup("mqtt", "prefix");
+  return prefix.length() ? prefix : "dscd";
+}
+
+/** 0 or 1; QoS 2 isn't supported */
+int
+Config::getMqttQos()
+{
+  std::string qos = lookup("mqtt", "qos");
+  if (qos.length() == 0) { return 1; }
+  return strtol(qos.c_str(), 0, 10) > 0 ? 1 : 0;
+}
+
+/** Seconds */
+int
+Config::getMqttKeepAlive()
+{
+  int keepAlive = strtol(lookup("mqtt", "keepalive").c_str(), 0, 10);
+  return keepAlive > 0 ? keepAlive : 60;
+}
+
+/** Bytes of events to hold while the broker is unreachable */
+size_t
+Config::getMqttQueueSize()
+{
+  long size = strtol(lookup("mqtt", "queue_size").c_str(), 0, 10);
+  return size > 0 ? size : 256 * 1024;
 }
 
 std::string
+Config::getStateFile(int panel)
+{
+  return getPanelFile(panel, "state_file");
+}
+
+std::string
+Config::getCaptureFile(int panel)
+{
+  return getPanelFile(panel, "capture_file");
+}
+
+std::string
+Config::getJournalDirectory(int panel)
+{
+  return getPanelValue(panel, "journal_dir");
+}
+
+double
+Config::getReplaySpeed(int panel)
+{
+  std::string speed = getPanelValue(panel, "replay_speed");
+  if (speed.length() == 0) { return 1.0; }
+  return strtod(speed.c_str(),0);
+}
+
+/** Milliseconds to wait for the panel to answer a command */
+int
+Config::getAckTimeout(int panel)
+{
+  int timeout = strtol(getPanelValue(panel, "ack_timeout").c_str(), 0, 10);
+  return timeout > 0 ? timeout : 2000;
+}
+
+/** How many times to resend a command the panel didn't answer */
+int
+Config::getAckRetries(int panel)
+{
+  std::string retries = getPanelValue(panel, "ack_retries");
+  if (retries.length() == 0) { return 1; }
+  int n = strtol(retries.c_str(), 0, 10);
+  return n > 0 ? n : 0;
+}
+
+const std::string &
 Config::getEventAction(int command)
 {
-  return mDictionary["actions"][commandIntToName(command)];
+  static const std::string none;
+  if (command < 0 || command >= NUM_COMMAND_CODES) { return none; }
+  return mEventAction[command];
+}
+
+/**
+  Turn the [syslog] and [actions] sections into arrays indexed by
+  command code, so the per-frame lookups don't have to touch the
+  dictionary at all, and compile [rules] and [debounce].
+*/
+void
+Config::compileCommandTables()
+{
+  std::map<std::string,std::string> &levels = mDictionary["syslog"];
+  std::map<std::string,std::string> &actions = mDictionary["actions"];
+  std::map<std::string,std::string> &rules = mDictionary["rules"];
+  std::map<std::string,std::string> &debounce = mDictionary["debounce"];
+  std::map<std::string,std::string>::iterator i;
+
+  for (int code = 0; code < NUM_COMMAND_CODES; code++)
+  {
+    mSyslogPriority[code] = -1;
+    mEventAction[code].clear();
+    mDebounced[code] = false;
+  }
+
+  for (i = levels.begin(); i != levels.end(); i++)
+  {
+    int code = commandNameToInt(i->first);
+    if (code >= 0)
+    {
+      mSyslogPriority[code] = levelToPriority(i->second);
+    }
+  }
+
+  for (i = actions.begin(); i != actions.end(); i++)
+  {
+    int code = commandNameToInt(i->first);
+    if (code >= 0)
+    {
+      mEventAction[code] = i->second;
+    }
+  }
+
+  mRules.clear();
+  mTableError.clear();
+  for (i = rules.begin(); i != rules.end(); i++)
+  {
+    Rule rule;
+    std::string error;
+    if (rule.parse(*this, i->first, i->second, error))
+    {
+      mRules.push_back(rule);
+    }
+    else if (mTableError.empty())
+    {
+      mTableError = error;
+    }
+  }
+
+  mDebounce.clear();
+  for (i = debounce.begin(); i != debounce.end(); i++)
+  {
+    if (!compileDebounce(i->first, i->second) && mTableError.empty())
+    {
+      mTableError = "debounce " + i->first + ": expected "
+                    "NAME[:ZONE] = SECONDS [BURST]";
+    }
+  }
+}
+
+/** NAME[:ZONE] = SECONDS [BURST] */
+bool
+Config::compileDebounce(const std::string &tag, const std::string &value)
+{
+  std::string::size_type colon = tag.find(':');
+  int code = commandNameToInt(tag.substr(0, colon));
+  int subject = 0;
+  if (colon != std::string::npos)
+  {
+    char *end;
+    subject = strtol(tag.c_str() + colon + 1, &end, 10);
+    if (*end || subject < 1 || subject > 255) { return false; }
+  }
+
+  char *end;
+  double seconds = strtod(value.c_str(), &end);
+  long burst = strtol(end, &end, 10);
+  while (*end == ' ' || *end == '\t') { end++; }
+  if (code < 0 || seconds <= 0 || burst < 0 || *end) { return false; }
+
+  mDebounced[code] = true;
+  mDebounce[code * 1000 + subject] =
+    std::make_pair((uint64_t)(seconds * 1e9), burst > 0 ? (int)burst : 1);
+  return true;
+}
+
+/** A zone's own entry if it has one, or the command's */
+bool
+Config::lookupDebounce(int command, int subject, uint64_t &window,
+                       int &burst)
+{
+  std::map<int, std::pair<uint64_t, int> >::const_iterator i =
+    mDebounce.find(command * 1000 + subject);
+  if (i == mDebounce.end()) { i = mDebounce.find(command * 1000); }
+  if (i == mDebounce.end()) { return false; }
+  window = i->second.first;
+  burst = i->second.second;
+  return true;
 }
 
 bool
@@ -315,6 +843,13 @@ Config::readConfig(std::string filename)
 
   mConfigFile = filename;
  
+  struct stat st;
+  if (fstat(descriptor, &st) == 0)
+  {
+    mModified = st.st_mtime;
+    mSize = st.st_size;
+  }
+
   mDictionary.clear();
 
   char buffer[256];
@@ -344,481 +879,378 @@ Config::readConfig(std::string filename)
 
         case ConfigParser::ERROR:
           std::cerr << p.getValue() << std::endl;
+          close(descriptor);
           return false;
+
+        case ConfigParser::NONE:
+          break;
       }
     }
   }
 
+  close(descriptor);
+  compileCommandTables();
   return true;
 }
 
 std::string
-Config::getZoneName(int zone)
+Config::getZoneName(int zone, int panel)
 {
-  return getValueByInt("zones",zone);
+  return getValueByInt("zones",zone,panel);
 }
 
 std::string
-Config::getAccessCode(int partition)
+Config::getAccessCode(int partition, int panel)
 {
-  std::string retval = getValueByInt("access",partition);
+  std::string retval = getValueByInt("access",partition,panel);
   if (retval.length()) { return retval; }
-  return mDictionary["access"]["default"];
+  if (panel)
+  {
+    char section[24];
+    sprintf(section, "access:%d", panel);
+    retval = lookup(section, "default");
+    if (retval.length()) { return retval; }
+  }
+  return lookup("access", "default");
 }
 
 std::string
-Config::getPartitionName(int partition)
+Config::getPartitionName(int partition, int panel)
 {
-  return getValueByInt("partitions",partition);
+  return getValueByInt("partitions",partition,panel);
+}
+
+/**
+  Zone lists such as "1-8, 12 14"; anything outside 1-64 is ignored.
+*/
+bool
+Config::getPartitionZones(int partition, int panel, uint64_t &zones)
+{
+  std::string list = getValueByInt("partition_zones", partition, panel);
+  if (list.length() == 0) { return false; }
+
+  zones = 0;
+  const char *p = list.c_str();
+  while (*p)
+  {
+    char *end;
+    long first = strtol(p, &end, 10);
+    if (end == p) { p++; continue; }
+    long last = first;
+    p = end;
+    if (*p == '-')
+    {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1) { last = first; }
+      p = end;
+    }
+    for (long zone = first; zone <= last && zone <= 64; zone++)
+    {
+      if (zone >= 1) { zones |= (uint64_t)1 << (zone - 1); }
+    }
+  }
+  return true;
 }
 
 std::string
-Config::getUserName(int user)
+Config::getUserName(int user, int panel)
 {
-  return getValueByInt("users",user);
+  return getValueByInt("users",user,panel);
 }
 
 std::string
-Config::getKeyName(int user)
+Config::getKeyName(int key, int panel)
 {
-  return getValueByInt("wireless_key",user);
+  return getValueByInt("wireless_keys",key,panel);
 }
 
 std::string
-Config::getKeypadName(int user)
+Config::getKeypadName(int keypad, int panel)
+{
+  return getValueByInt("wireless_keypads",keypad,panel);
+}
+
+const std::string &
+Config::lookup(const std::string &section, const std::string &tag)
 {
-  return getValueByInt("wireless_keypad",user);
+  static const std::string empty;
+  std::map<std::string, std::map<std::string,std::string> >::const_iterator s
+    = mDictionary.find(section);
+  if (s == mDictionary.end()) { return empty; }
+  std::map<std::string,std::string>::const_iterator v = s->second.find(tag);
+  if (v == s->second.end()) { return empty; }
+  return v->second;
 }
 
 std::string
-Config::getValueByInt(std::string section, int tag)
+Config::getValueByInt(const char *section, int tag, int panel)
 {
   char tagname[16];
   sprintf(tagname, "%d", tag);
-  return mDictionary[section][tagname];
+  if (panel)
+  {
+    char panelSection[64];
+    snprintf(panelSection, sizeof(panelSection), "%s:%d", section, panel);
+    const std::string &value = lookup(panelSection, tagname);
+    if (value.length()) { return value; }
+  }
+  return lookup(section, tagname);
 }
 
+// Sorted by name, so that names can be found with a binary search.
+// Keep it that way when adding commands.
+static const struct
+{
+  const char *name;
+  int code;
+} commandNames[] =
+{
+  { "AUXILIARY_INPUT_ALARM",
+    It100::AUXILIARY_INPUT_ALARM },
+  { "AUXILIARY_INPUT_ALARM_RESTORED",
+    It100::AUXILIARY_INPUT_ALARM_RESTORED },
+  { "A_KEY_ALARM",
+    It100::A_KEY_ALARM },
+  { "A_KEY_RESTORAL",
+    It100::A_KEY_RESTORAL },
+  { "BAUD_RATE_CHANGE",
+    It100::BAUD_RATE_CHANGE },
+  { "BAUD_RATE_SET",
+    It100::BAUD_RATE_SET },
+  { "BEEP_STATUS",
+    It100::BEEP_STATUS },
+  { "BROADCAST_LABELS",
+    It100::BROADCAST_LABELS },
+  { "BUFFER_NEAR_FULL",
+    It100::BUFFER_NEAR_FULL },
+  { "BUZZER_STATUS",
+    It100::BUZZER_STATUS },
+  { "BYPASSED_ZONES_BITFIELD_DUMP",
+    It100::BYPASSED_ZONES_BITFIELD_DUMP },
+  { "CODE_REQUIRED",
+    It100::CODE_REQUIRED },
+  { "CODE_SEND",
+    It100::CODE_SEND },
+  { "COMMAND_ACKNOWLEDGE",
+    It100::COMMAND_ACKNOWLEDGE },
+  { "COMMAND_ERROR",
+    It100::COMMAND_ERROR },
+  { "COMMAND_OUTPUT_CONTROL",
+    It100::COMMAND_OUTPUT_CONTROL },
+  { "COMMAND_OUTPUT_IN_PROGRESS",
+    It100::COMMAND_OUTPUT_IN_PROGRESS },
+  { "DOOR_CHIME_STATUS",
+    It100::DOOR_CHIME_STATUS },
+  { "DURESS_ALARM",
+    It100::DURESS_ALARM },
+  { "ENTRY_DELAY_IN_PROGRESS",
+    It100::ENTRY_DELAY_IN_PROGRESS },
+  { "EXIT_DELAY_IN_PROGRESS",
+    It100::EXIT_DELAY_IN_PROGRESS },
+  { "FAIL_TO_ARM",
+    It100::FAIL_TO_ARM },
+  { "FIRE_TROUBLE_ALARM",
+    It100::FIRE_TROUBLE_ALARM },
+  { "FIRE_TROUBLE_ALARM_RESTORED",
+    It100::FIRE_TROUBLE_ALARM_RESTORED },
+  { "FTC_TROUBLE",
+    It100::FTC_TROUBLE },
+  { "FUNCTION_NOT_AVAILABLE",
+    It100::FUNCTION_NOT_AVAILABLE },
+  { "F_KEY_ALARM",
+    It100::F_KEY_ALARM },
+  { "F_KEY_RESTORAL",
+    It100::F_KEY_RESTORAL },
+  { "GENERAL_DEVICE_LOW_BATTERY",
+    It100::GENERAL_DEVICE_LOW_BATTERY },
+  { "GENERAL_DEVICE_LOW_BATTERY_RESTORE",
+    It100::GENERAL_DEVICE_LOW_BATTERY_RESTORE },
+  { "GENERAL_SYSTEM_TAMPER",
+    It100::GENERAL_SYSTEM_TAMPER },
+  { "GENERAL_SYSTEM_TAMPER_RESTORE",
+    It100::GENERAL_SYSTEM_TAMPER_RESTORE },
+  { "GET_TEMPERATURE_SET_POINT",
+    It100::GET_TEMPERATURE_SET_POINT },
+  { "HANDHELD_KEYPAD_LOW_BATTERY_TROUBLE",
+    It100::HANDHELD_KEYPAD_LOW_BATTERY_TROUBLE },
+  { "HOME_AUTOMATION_TROUBLE",
+    It100::HOME_AUTOMATION_TROUBLE },
+  { "HOME_AUTOMATION_TROUBLE_RESTORE",
+    It100::HOME_AUTOMATION_TROUBLE_RESTORE },
+  { "INDOOR_TEMPERATURE_BROADCAST",
+    It100::INDOOR_TEMPERATURE_BROADCAST },
+  { "INVALID_ACCESS_CODE",
+    It100::INVALID_ACCESS_CODE },
+  { "KEYPAD_BLANKING",
+    It100::KEYPAD_BLANKING },
+  { "KEYPAD_LOCKOUT",
+    It100::KEYPAD_LOCKOUT },
+  { "KEY_PRESSED",
+    It100::KEY_PRESSED },
+  { "LABELS_REQUEST",
+    It100::LABELS_REQUEST },
+  { "LCD_CURSOR",
+    It100::LCD_CURSOR },
+  { "LCD_UPDATE",
+    It100::LCD_UPDATE },
+  { "LED_STATUS",
+    It100::LED_STATUS },
+  { "OUTDOOR_TEMPERATRURE_BROADCAST",
+    It100::OUTDOOR_TEMPERATRURE_BROADCAST },
+  { "PANEL_AC_RESTORE",
+    It100::PANEL_AC_RESTORE },
+  { "PANEL_AC_TROUBLE",
+    It100::PANEL_AC_TROUBLE },
+  { "PANEL_BATTERY_TROUBLE",
+    It100::PANEL_BATTERY_TROUBLE },
+  { "PANEL_BATTERY_TROUBLE_RESTORE",
+    It100::PANEL_BATTERY_TROUBLE_RESTORE },
+  { "PARTIAL_CLOSING",
+    It100::PARTIAL_CLOSING },
+  { "PARTITION_ARMED_DESCRIPTIVE_MODE",
+    It100::PARTITION_ARMED_DESCRIPTIVE_MODE },
+  { "PARTITION_ARM_CONTROL_ARMED_NO_ENTRY_DELAY",
+    It100::PARTITION_ARM_CONTROL_ARMED_NO_ENTRY_DELAY },
+  { "PARTITION_ARM_CONTROL_AWAY",
+    It100::PARTITION_ARM_CONTROL_AWAY },
+  { "PARTITION_ARM_CONTROL_STAY",
+    It100::PARTITION_ARM_CONTROL_STAY },
+  { "PARTITION_ARM_CONTROL_WITH_CODE",
+    It100::PARTITION_ARM_CONTROL_WITH_CODE },
+  { "PARTITION_BUSY",
+    It100::PARTITION_BUSY },
+  { "PARTITION_DISARMED",
+    It100::PARTITION_DISARMED },
+  { "PARTITION_DISARM_CONTROL_WITH_CODE",
+    It100::PARTITION_DISARM_CONTROL_WITH_CODE },
+  { "PARTITION_IN_ALARM",
+    It100::PARTITION_IN_ALARM },
+  { "PARTITION_IN_READY_TO_FORCE_ARM",
+    It100::PARTITION_IN_READY_TO_FORCE_ARM },
+  { "PARTITION_NOT_READY",
+    It100::PARTITION_NOT_READY },
+  { "PARTITION_READY",
+    It100::PARTITION_READY },
+  { "POLL",
+    It100::POLL },
+  { "P_KEY_ALARM",
+    It100::P_KEY_ALARM },
+  { "P_KEY_RESTORAL",
+    It100::P_KEY_RESTORAL },
+  { "RESTORE",
+    It100::RESTORE },
+  { "RESTORED",
+    It100::RESTORED },
+  { "RING_DETECTED",
+    It100::RING_DETECTED },
+  { "RULE_NOTE",
+    It100::RULE_NOTE },
+  { "SAVE_TEMPERATURE_SETTING",
+    It100::SAVE_TEMPERATURE_SETTING },
+  { "SET_TIME_AND_DATE",
+    It100::SET_TIME_AND_DATE },
+  { "SOFTWARE_VERSION",
+    It100::SOFTWARE_VERSION },
+  { "SPECIAL_CLOSING",
+    It100::SPECIAL_CLOSING },
+  { "SPECIAL_OPENING",
+    It100::SPECIAL_OPENING },
+  { "STATUS_REQUEST",
+    It100::STATUS_REQUEST },
+  { "SYSTEM_BELL_TROUBLE",
+    It100::SYSTEM_BELL_TROUBLE },
+  { "SYSTEM_BELL_TROUBLE_RESTORAL",
+    It100::SYSTEM_BELL_TROUBLE_RESTORAL },
+  { "SYSTEM_ERROR",
+    It100::SYSTEM_ERROR },
+  { "TEMPERATURE_BROADCAST_CONTROL",
+    It100::TEMPERATURE_BROADCAST_CONTROL },
+  { "TEMPERATURE_CHANGE",
+    It100::TEMPERATURE_CHANGE },
+  { "THERMOSTAT_SET_POINTS",
+    It100::THERMOSTAT_SET_POINTS },
+  { "TIME_DATE_BROADCAST",
+    It100::TIME_DATE_BROADCAST },
+  { "TIME_DATE_BROADCAST_CONTROL",
+    It100::TIME_DATE_BROADCAST_CONTROL },
+  { "TIME_STAMP_CONTROL",
+    It100::TIME_STAMP_CONTROL },
+  { "TLM_LINE_1_TROUBLE",
+    It100::TLM_LINE_1_TROUBLE },
+  { "TLM_LINE_1_TROUBLE_RESTORED",
+    It100::TLM_LINE_1_TROUBLE_RESTORED },
+  { "TLM_LINE_2_TROUBLE",
+    It100::TLM_LINE_2_TROUBLE },
+  { "TLM_LINE_2_TROUBLE_RESTORED",
+    It100::TLM_LINE_2_TROUBLE_RESTORED },
+  { "TONE_STATUS",
+    It100::TONE_STATUS },
+  { "TRIGGER_PANIC_ALARM",
+    It100::TRIGGER_PANIC_ALARM },
+  { "TROUBLE_STATUS_LED_ON",
+    It100::TROUBLE_STATUS_LED_ON },
+  { "TROUBLE_STATUS_RESTORE_LED_OFF",
+    It100::TROUBLE_STATUS_RESTORE_LED_OFF },
+  { "USER_CLOSING",
+    It100::USER_CLOSING },
+  { "USER_OPENING",
+    It100::USER_OPENING },
+  { "VIRTUAL_KEYPAD_CONTROL",
+    It100::VIRTUAL_KEYPAD_CONTROL },
+  { "WIRELESS_KEY_LOW_BATTERY_TROUBLE",
+    It100::WIRELESS_KEY_LOW_BATTERY_TROUBLE },
+  { "ZONE_ALARM",
+    It100::ZONE_ALARM },
+  { "ZONE_ALARM_RESTORE",
+    It100::ZONE_ALARM_RESTORE },
+  { "ZONE_FAULT",
+    It100::ZONE_FAULT },
+  { "ZONE_FAULT_RESTORE",
+    It100::ZONE_FAULT_RESTORE },
+  { "ZONE_OPEN",
+    It100::ZONE_OPEN },
+  { "ZONE_RESTORED",
+    It100::ZONE_RESTORED },
+  { "ZONE_TAMPER",
+    It100::ZONE_TAMPER },
+  { "ZONE_TAMPER_RESTORE",
+    It100::ZONE_TAMPER_RESTORE },
+};
+
+static const int numCommandNames = sizeof(commandNames)/sizeof(*commandNames);
+
 int
 Config::commandNameToInt(std::string cmd)
 {
-  if (cmd == "POLL")
-    { return It100::POLL; }
-  if (cmd == "STATUS_REQUEST")
-    { return It100::STATUS_REQUEST; }
-  if (cmd == "LABELS_REQUEST")
-    { return It100::LABELS_REQUEST; }
-  if (cmd == "SET_TIME_AND_DATE")
-    { return It100::SET_TIME_AND_DATE; }
-  if (cmd == "COMMAND_OUTPUT_CONTROL")
-    { return It100::COMMAND_OUTPUT_CONTROL; }
-  if (cmd == "PARTITION_ARM_CONTROL_AWAY")
-    { return It100::PARTITION_ARM_CONTROL_AWAY; }
-  if (cmd == "PARTITION_ARM_CONTROL_STAY")
-    { return It100::PARTITION_ARM_CONTROL_STAY; }
-  if (cmd == "PARTITION_ARM_CONTROL_ARMED_NO_ENTRY_DELAY")
-    { return It100::PARTITION_ARM_CONTROL_ARMED_NO_ENTRY_DELAY; }
-  if (cmd == "PARTITION_ARM_CONTROL_WITH_CODE")
-    { return It100::PARTITION_ARM_CONTROL_WITH_CODE; }
-  if (cmd == "PARTITION_DISARM_CONTROL_WITH_CODE")
-    { return It100::PARTITION_DISARM_CONTROL_WITH_CODE; }
-  if (cmd == "TIME_STAMP_CONTROL")
-    { return It100::TIME_STAMP_CONTROL; }
-  if (cmd == "TIME_DATE_BROADCAST_CONTROL")
-    { return It100::TIME_DATE_BROADCAST_CONTROL; }
-  if (cmd == "TEMPERATURE_BROADCAST_CONTROL")
-    { return It100::TEMPERATURE_BROADCAST_CONTROL; }
-  if (cmd == "VIRTUAL_KEYPAD_CONTROL")
-    { return It100::VIRTUAL_KEYPAD_CONTROL; }
-  if (cmd == "TRIGGER_PANIC_ALARM")
-    { return It100::TRIGGER_PANIC_ALARM; }
-  if (cmd == "KEY_PRESSED")
-    { return It100::KEY_PRESSED; }
-  if (cmd == "BAUD_RATE_CHANGE")
-    { return It100::BAUD_RATE_CHANGE; }
-  if (cmd == "GET_TEMPERATURE_SET_POINT")
-    { return It100::GET_TEMPERATURE_SET_POINT; }
-  if (cmd == "TEMPERATURE_CHANGE")
-    { return It100::TEMPERATURE_CHANGE; }
-  if (cmd == "SAVE_TEMPERATURE_SETTING")
-    { return It100::SAVE_TEMPERATURE_SETTING; }
-  if (cmd == "CODE_SEND")
-    { return It100::CODE_SEND; }
-  if (cmd == "COMMAND_ACKNOWLEDGE")
-    { return It100::COMMAND_ACKNOWLEDGE; }
-  if (cmd == "COMMAND_ERROR")
-    { return It100::COMMAND_ERROR; }
-  if (cmd == "SYSTEM_ERROR")
-    { return It100::SYSTEM_ERROR; }
-  if (cmd == "TIME_DATE_BROADCAST")
-    { return It100::TIME_DATE_BROADCAST; }
-  if (cmd == "RING_DETECTED")
-    { return It100::RING_DETECTED; }
-  if (cmd == "INDOOR_TEMPERATURE_BROADCAST")
-    { return It100::INDOOR_TEMPERATURE_BROADCAST; }
-  if (cmd == "OUTDOOR_TEMPERATRURE_BROADCAST")
-    { return It100::OUTDOOR_TEMPERATRURE_BROADCAST; }
-  if (cmd == "THERMOSTAT_SET_POINTS")
-    { return It100::THERMOSTAT_SET_POINTS; }
-  if (cmd == "BROADCAST_LABELS")
-    { return It100::BROADCAST_LABELS; }
-  if (cmd == "BAUD_RATE_SET")
-    { return It100::BAUD_RATE_SET; }
-  if (cmd == "ZONE_ALARM")
-    { return It100::ZONE_ALARM; }
-  if (cmd == "ZONE_ALARM_RESTORE")
-    { return It100::ZONE_ALARM_RESTORE; }
-  if (cmd == "ZONE_TAMPER")
-    { return It100::ZONE_TAMPER; }
-  if (cmd == "ZONE_TAMPER_RESTORE")
-    { return It100::ZONE_TAMPER_RESTORE; }
-  if (cmd == "ZONE_FAULT")
-    { return It100::ZONE_FAULT; }
-  if (cmd == "ZONE_FAULT_RESTORE")
-    { return It100::ZONE_FAULT_RESTORE; }
-  if (cmd == "ZONE_OPEN")
-    { return It100::ZONE_OPEN; }
-  if (cmd == "ZONE_RESTORED")
-    { return It100::ZONE_RESTORED; }
-  if (cmd == "DURESS_ALARM")
-    { return It100::DURESS_ALARM; }
-  if (cmd == "F_KEY_ALARM")
-    { return It100::F_KEY_ALARM; }
-  if (cmd == "F_KEY_RESTORAL")
-    { return It100::F_KEY_RESTORAL; }
-  if (cmd == "A_KEY_ALARM")
-    { return It100::A_KEY_ALARM; }
-  if (cmd == "A_KEY_RESTORAL")
-    { return It100::A_KEY_RESTORAL; }
-  if (cmd == "P_KEY_ALARM")
-    { return It100::P_KEY_ALARM; }
-  if (cmd == "P_KEY_RESTORAL")
-    { return It100::P_KEY_RESTORAL; }
-  if (cmd == "AUXILIARY_INPUT_ALARM")
-    { return It100::AUXILIARY_INPUT_ALARM; }
-  if (cmd == "AUXILIARY_INPUT_ALARM_RESTORED")
-    { return It100::AUXILIARY_INPUT_ALARM_RESTORED; }
-  if (cmd == "PARTITION_READY")
-    { return It100::PARTITION_READY; }
-  if (cmd == "PARTITION_NOT_READY")
-    { return It100::PARTITION_NOT_READY; }
-  if (cmd == "PARTITION_ARMED_DESCRIPTIVE_MODE")
-    { return It100::PARTITION_ARMED_DESCRIPTIVE_MODE; }
-  if (cmd == "PARTITION_IN_READY_TO_FORCE_ARM")
-    { return It100::PARTITION_IN_READY_TO_FORCE_ARM; }
-  if (cmd == "PARTITION_IN_ALARM")
-    { return It100::PARTITION_IN_ALARM; }
-  if (cmd == "PARTITION_DISARMED")
-    { return It100::PARTITION_DISARMED; }
-  if (cmd == "EXIT_DELAY_IN_PROGRESS")
-    { return It100::EXIT_DELAY_IN_PROGRESS; }
-  if (cmd == "ENTRY_DELAY_IN_PROGRESS")
-    { return It100::ENTRY_DELAY_IN_PROGRESS; }
-  if (cmd == "KEYPAD_LOCKOUT")
-    { return It100::KEYPAD_LOCKOUT; }
-  if (cmd == "KEYPAD_BLANKING")
-    { return It100::KEYPAD_BLANKING; }
-  if (cmd == "COMMAND_OUTPUT_IN_PROGRESS")
-    { return It100::COMMAND_OUTPUT_IN_PROGRESS; }
-  if (cmd == "INVALID_ACCESS_CODE")
-    { return It100::INVALID_ACCESS_CODE; }
-  if (cmd == "FUNCTION_NOT_AVAILABLE")
-    { return It100::FUNCTION_NOT_AVAILABLE; }
-  if (cmd == "FAIL_TO_ARM")
-    { return It100::FAIL_TO_ARM; }
-  if (cmd == "PARTITION_BUSY")
-    { return It100::PARTITION_BUSY; }
-  if (cmd == "USER_CLOSING")
-    { return It100::USER_CLOSING; }
-  if (cmd == "SPECIAL_CLOSING")
-    { return It100::SPECIAL_CLOSING; }
-  if (cmd == "PARTIAL_CLOSING")
-    { return It100::PARTIAL_CLOSING; }
-  if (cmd == "USER_OPENING")
-    { return It100::USER_OPENING; }
-  if (cmd == "SPECIAL_OPENING")
-    { return It100::SPECIAL_OPENING; }
-  if (cmd == "PANEL_BATTERY_TROUBLE")
-    { return It100::PANEL_BATTERY_TROUBLE; }
-  if (cmd == "PANEL_BATTERY_TROUBLE_RESTORE")
-    { return It100::PANEL_BATTERY_TROUBLE_RESTORE; }
-  if (cmd == "PANEL_AC_TROUBLE")
-    { return It100::PANEL_AC_TROUBLE; }
-  if (cmd == "PANEL_AC_RESTORE")
-    { return It100::PANEL_AC_RESTORE; }
-  if (cmd == "SYSTEM_BELL_TROUBLE")
-    { return It100::SYSTEM_BELL_TROUBLE; }
-  if (cmd == "SYSTEM_BELL_TROUBLE_RESTORAL")
-    { return It100::SYSTEM_BELL_TROUBLE_RESTORAL; }
-  if (cmd == "TLM_LINE_1_TROUBLE")
-    { return It100::TLM_LINE_1_TROUBLE; }
-  if (cmd == "TLM_LINE_1_TROUBLE_RESTORED")
-    { return It100::TLM_LINE_1_TROUBLE_RESTORED; }
-  if (cmd == "TLM_LINE_2_TROUBLE")
-    { return It100::TLM_LINE_2_TROUBLE; }
-  if (cmd == "TLM_LINE_2_TROUBLE_RESTORED")
-    { return It100::TLM_LINE_2_TROUBLE_RESTORED; }
-  if (cmd == "FTC_TROUBLE")
-    { return It100::FTC_TROUBLE; }
-  if (cmd == "BUFFER_NEAR_FULL")
-    { return It100::BUFFER_NEAR_FULL; }
-  if (cmd == "GENERAL_DEVICE_LOW_BATTERY")
-    { return It100::GENERAL_DEVICE_LOW_BATTERY; }
-  if (cmd == "GENERAL_DEVICE_LOW_BATTERY_RESTORE")
-    { return It100::GENERAL_DEVICE_LOW_BATTERY_RESTORE; }
-  if (cmd == "WIRELESS_KEY_LOW_BATTERY_TROUBLE")
-    { return It100::WIRELESS_KEY_LOW_BATTERY_TROUBLE; }
-  if (cmd == "RESTORE")
-    { return It100::RESTORE; }
-  if (cmd == "HANDHELD_KEYPAD_LOW_BATTERY_TROUBLE")
-    { return It100::HANDHELD_KEYPAD_LOW_BATTERY_TROUBLE; }
-  if (cmd == "RESTORED")
-    { return It100::RESTORED; }
-  if (cmd == "GENERAL_SYSTEM_TAMPER")
-    { return It100::GENERAL_SYSTEM_TAMPER; }
-  if (cmd == "GENERAL_SYSTEM_TAMPER_RESTORE")
-    { return It100::GENERAL_SYSTEM_TAMPER_RESTORE; }
-  if (cmd == "HOME_AUTOMATION_TROUBLE")
-    { return It100::HOME_AUTOMATION_TROUBLE; }
-  if (cmd == "HOME_AUTOMATION_TROUBLE_RESTORE")
-    { return It100::HOME_AUTOMATION_TROUBLE_RESTORE; }
-  if (cmd == "TROUBLE_STATUS_LED_ON")
-    { return It100::TROUBLE_STATUS_LED_ON; }
-  if (cmd == "TROUBLE_STATUS_RESTORE_LED_OFF")
-    { return It100::TROUBLE_STATUS_RESTORE_LED_OFF; }
-  if (cmd == "FIRE_TROUBLE_ALARM")
-    { return It100::FIRE_TROUBLE_ALARM; }
-  if (cmd == "FIRE_TROUBLE_ALARM_RESTORED")
-    { return It100::FIRE_TROUBLE_ALARM_RESTORED; }
-  if (cmd == "CODE_REQUIRED")
-    { return It100::CODE_REQUIRED; }
-  if (cmd == "LCD_UPDATE")
-    { return It100::LCD_UPDATE; }
-  if (cmd == "LCD_CURSOR")
-    { return It100::LCD_CURSOR; }
-  if (cmd == "LED_STATUS")
-    { return It100::LED_STATUS; }
-  if (cmd == "BEEP_STATUS")
-    { return It100::BEEP_STATUS; }
-  if (cmd == "TONE_STATUS")
-    { return It100::TONE_STATUS; }
-  if (cmd == "BUZZER_STATUS")
-    { return It100::BUZZER_STATUS; }
-  if (cmd == "DOOR_CHIME_STATUS")
-    { return It100::DOOR_CHIME_STATUS; }
-  if (cmd == "SOFTWARE_VERSION")
-    { return It100::SOFTWARE_VERSION; }
+  int low = 0;
+  int high = numCommandNames - 1;
+  while (low <= high)
+  {
+    int mid = (low + high) / 2;
+    int cmp = strcmp(cmd.c_str(), commandNames[mid].name);
+    if (cmp == 0) { return commandNames[mid].code; }
+    if (cmp < 0) { high = mid - 1; } else { low = mid + 1; }
+  }
+  return -1;
 }
 
-std::string
+const char *
 Config::commandIntToName(int cmd)
 {
-  switch (cmd)
-  {
-    case It100::POLL: 
-      return "POLL";
-    case It100::STATUS_REQUEST: 
-      return "STATUS_REQUEST";
-    case It100::LABELS_REQUEST: 
-      return "LABELS_REQUEST";
-    case It100::SET_TIME_AND_DATE: 
-      return "SET_TIME_AND_DATE";
-    case It100::COMMAND_OUTPUT_CONTROL: 
-      return "COMMAND_OUTPUT_CONTROL";
-    case It100::PARTITION_ARM_CONTROL_AWAY: 
-      return "PARTITION_ARM_CONTROL_AWAY";
-    case It100::PARTITION_ARM_CONTROL_STAY: 
-      return "PARTITION_ARM_CONTROL_STAY";
-    case It100::PARTITION_ARM_CONTROL_ARMED_NO_ENTRY_DELAY: 
-      return "PARTITION_ARM_CONTROL_ARMED_NO_ENTRY_DELAY";
-    case It100::PARTITION_ARM_CONTROL_WITH_CODE: 
-      return "PARTITION_ARM_CONTROL_WITH_CODE";
-    case It100::PARTITION_DISARM_CONTROL_WITH_CODE: 
-      return "PARTITION_DISARM_CONTROL_WITH_CODE";
-    case It100::TIME_STAMP_CONTROL: 
-      return "TIME_STAMP_CONTROL";
-    case It100::TIME_DATE_BROADCAST_CONTROL: 
-      return "TIME_DATE_BROADCAST_CONTROL";
-    case It100::TEMPERATURE_BROADCAST_CONTROL: 
-      return "TEMPERATURE_BROADCAST_CONTROL";
-    case It100::VIRTUAL_KEYPAD_CONTROL: 
-      return "VIRTUAL_KEYPAD_CONTROL";
-    case It100::TRIGGER_PANIC_ALARM: 
-      return "TRIGGER_PANIC_ALARM";
-    case It100::KEY_PRESSED: 
-      return "KEY_PRESSED";
-    case It100::BAUD_RATE_CHANGE: 
-      return "BAUD_RATE_CHANGE";
-    case It100::GET_TEMPERATURE_SET_POINT: 
-      return "GET_TEMPERATURE_SET_POINT";
-    case It100::TEMPERATURE_CHANGE: 
-      return "TEMPERATURE_CHANGE";
-    case It100::SAVE_TEMPERATURE_SETTING: 
-      return "SAVE_TEMPERATURE_SETTING";
-    case It100::CODE_SEND: 
-      return "CODE_SEND";
-    case It100::COMMAND_ACKNOWLEDGE: 
-      return "COMMAND_ACKNOWLEDGE";
-    case It100::COMMAND_ERROR: 
-      return "COMMAND_ERROR";
-    case It100::SYSTEM_ERROR: 
-      return "SYSTEM_ERROR";
-    case It100::TIME_DATE_BROADCAST: 
-      return "TIME_DATE_BROADCAST";
-    case It100::RING_DETECTED: 
-      return "RING_DETECTED";
-    case It100::INDOOR_TEMPERATURE_BROADCAST: 
-      return "INDOOR_TEMPERATURE_BROADCAST";
-    case It100::OUTDOOR_TEMPERATRURE_BROADCAST: 
-      return "OUTDOOR_TEMPERATRURE_BROADCAST";
-    case It100::THERMOSTAT_SET_POINTS: 
-      return "THERMOSTAT_SET_POINTS";
-    case It100::BROADCAST_LABELS: 
-      return "BROADCAST_LABELS";
-    case It100::BAUD_RATE_SET: 
-      return "BAUD_RATE_SET";
-    case It100::ZONE_ALARM: 
-      return "ZONE_ALARM";
-    case It100::ZONE_ALARM_RESTORE: 
-      return "ZONE_ALARM_RESTORE";
-    case It100::ZONE_TAMPER: 
-      return "ZONE_TAMPER";
-    case It100::ZONE_TAMPER_RESTORE: 
-      return "ZONE_TAMPER_RESTORE";
-    case It100::ZONE_FAULT: 
-      return "ZONE_FAULT";
-    case It100::ZONE_FAULT_RESTORE: 
-      return "ZONE_FAULT_RESTORE";
-    case It100::ZONE_OPEN: 
-      return "ZONE_OPEN";
-    case It100::ZONE_RESTORED: 
-      return "ZONE_RESTORED";
-    case It100::DURESS_ALARM: 
-      return "DURESS_ALARM";
-    case It100::F_KEY_ALARM: 
-      return "F_KEY_ALARM";
-    case It100::F_KEY_RESTORAL: 
-      return "F_KEY_RESTORAL";
-    case It100::A_KEY_ALARM: 
-      return "A_KEY_ALARM";
-    case It100::A_KEY_RESTORAL: 
-      return "A_KEY_RESTORAL";
-    case It100::P_KEY_ALARM: 
-      return "P_KEY_ALARM";
-    case It100::P_KEY_RESTORAL: 
-      return "P_KEY_RESTORAL";
-    case It100::AUXILIARY_INPUT_ALARM: 
-      return "AUXILIARY_INPUT_ALARM";
-    case It100::AUXILIARY_INPUT_ALARM_RESTORED: 
-      return "AUXILIARY_INPUT_ALARM_RESTORED";
-    case It100::PARTITION_READY: 
-      return "PARTITION_READY";
-    case It100::PARTITION_NOT_READY: 
-      return "PARTITION_NOT_READY";
-    case It100::PARTITION_ARMED_DESCRIPTIVE_MODE: 
-      return "PARTITION_ARMED_DESCRIPTIVE_MODE";
-    case It100::PARTITION_IN_READY_TO_FORCE_ARM: 
-      return "PARTITION_IN_READY_TO_FORCE_ARM";
-    case It100::PARTITION_IN_ALARM: 
-      return "PARTITION_IN_ALARM";
-    case It100::PARTITION_DISARMED: 
-      return "PARTITION_DISARMED";
-    case It100::EXIT_DELAY_IN_PROGRESS: 
-      return "EXIT_DELAY_IN_PROGRESS";
-    case It100::ENTRY_DELAY_IN_PROGRESS: 
-      return "ENTRY_DELAY_IN_PROGRESS";
-    case It100::KEYPAD_LOCKOUT: 
-      return "KEYPAD_LOCKOUT";
-    case It100::KEYPAD_BLANKING: 
-      return "KEYPAD_BLANKING";
-    case It100::COMMAND_OUTPUT_IN_PROGRESS: 
-      return "COMMAND_OUTPUT_IN_PROGRESS";
-    case It100::INVALID_ACCESS_CODE: 
-      return "INVALID_ACCESS_CODE";
-    case It100::FUNCTION_NOT_AVAILABLE: 
-      return "FUNCTION_NOT_AVAILABLE";
-    case It100::FAIL_TO_ARM: 
-      return "FAIL_TO_ARM";
-    case It100::PARTITION_BUSY: 
-      return "PARTITION_BUSY";
-    case It100::USER_CLOSING: 
-      return "USER_CLOSING";
-    case It100::SPECIAL_CLOSING: 
-      return "SPECIAL_CLOSING";
-    case It100::PARTIAL_CLOSING: 
-      return "PARTIAL_CLOSING";
-    case It100::USER_OPENING: 
-      return "USER_OPENING";
-    case It100::SPECIAL_OPENING: 
-      return "SPECIAL_OPENING";
-    case It100::PANEL_BATTERY_TROUBLE: 
-      return "PANEL_BATTERY_TROUBLE";
-    case It100::PANEL_BATTERY_TROUBLE_RESTORE: 
-      return "PANEL_BATTERY_TROUBLE_RESTORE";
-    case It100::PANEL_AC_TROUBLE: 
-      return "PANEL_AC_TROUBLE";
-    case It100::PANEL_AC_RESTORE: 
-      return "PANEL_AC_RESTORE";
-    case It100::SYSTEM_BELL_TROUBLE: 
-      return "SYSTEM_BELL_TROUBLE";
-    case It100::SYSTEM_BELL_TROUBLE_RESTORAL: 
-      return "SYSTEM_BELL_TROUBLE_RESTORAL";
-    case It100::TLM_LINE_1_TROUBLE: 
-      return "TLM_LINE_1_TROUBLE";
-    case It100::TLM_LINE_1_TROUBLE_RESTORED: 
-      return "TLM_LINE_1_TROUBLE_RESTORED";
-    case It100::TLM_LINE_2_TROUBLE: 
-      return "TLM_LINE_2_TROUBLE";
-    case It100::TLM_LINE_2_TROUBLE_RESTORED: 
-      return "TLM_LINE_2_TROUBLE_RESTORED";
-    case It100::FTC_TROUBLE: 
-      return "FTC_TROUBLE";
-    case It100::BUFFER_NEAR_FULL: 
-      return "BUFFER_NEAR_FULL";
-    case It100::GENERAL_DEVICE_LOW_BATTERY: 
-      return "GENERAL_DEVICE_LOW_BATTERY";
-    case It100::GENERAL_DEVICE_LOW_BATTERY_RESTORE: 
-      return "GENERAL_DEVICE_LOW_BATTERY_RESTORE";
-    case It100::WIRELESS_KEY_LOW_BATTERY_TROUBLE: 
-      return "WIRELESS_KEY_LOW_BATTERY_TROUBLE";
-    case It100::RESTORE: 
-      return "RESTORE";
-    case It100::HANDHELD_KEYPAD_LOW_BATTERY_TROUBLE: 
-      return "HANDHELD_KEYPAD_LOW_BATTERY_TROUBLE";
-    case It100::RESTORED: 
-      return "RESTORED";
-    case It100::GENERAL_SYSTEM_TAMPER: 
-      return "GENERAL_SYSTEM_TAMPER";
-    case It100::GENERAL_SYSTEM_TAMPER_RESTORE: 
-      return "GENERAL_SYSTEM_TAMPER_RESTORE";
-    case It100::HOME_AUTOMATION_TROUBLE: 
-      return "HOME_AUTOMATION_TROUBLE";
-    case It100::HOME_AUTOMATION_TROUBLE_RESTORE: 
-      return "HOME_AUTOMATION_TROUBLE_RESTORE";
-    case It100::TROUBLE_STATUS_LED_ON: 
-      return "TROUBLE_STATUS_LED_ON";
-    case It100::TROUBLE_STATUS_RESTORE_LED_OFF: 
-      return "TROUBLE_STATUS_RESTORE_LED_OFF";
-    case It100::FIRE_TROUBLE_ALARM: 
-      return "FIRE_TROUBLE_ALARM";
-    case It100::FIRE_TROUBLE_ALARM_RESTORED: 
-      return "FIRE_TROUBLE_ALARM_RESTORED";
-    case It100::CODE_REQUIRED: 
-      return "CODE_REQUIRED";
-    case It100::LCD_UPDATE: 
-      return "LCD_UPDATE";
-    case It100::LCD_CURSOR: 
-      return "LCD_CURSOR";
-    case It100::LED_STATUS: 
-      return "LED_STATUS";
-    case It100::BEEP_STATUS: 
-      return "BEEP_STATUS";
-    case It100::TONE_STATUS: 
-      return "TONE_STATUS";
-    case It100::BUZZER_STATUS: 
-      return "BUZZER_STATUS";
-    case It100::DOOR_CHIME_STATUS: 
-      return "DOOR_CHIME_STATUS";
-    case It100::SOFTWARE_VERSION: 
-      return "SOFTWARE_VERSION";
+  // Command codes are three decimal digits, so a dense table indexed
+  // by code is small enough to build once and keep around.
+  static const char *codeToName[1000];
+  static bool initialized = false;
+
+  if (!initialized)
+  {
+    for (int i = 0; i < numCommandNames; i++)
+    {
+      codeToName[commandNames[i].code] = commandNames[i].name;
+    }
+    initialized = true;
   }
+
+  if (cmd < 0 || cmd >= 1000 || !codeToName[cmd]) { return ""; }
+  return codeToName[cmd];
 }
@@ -33,8 +33,13 @@
 
 #include <syslog.h>
 #include <string>
+#include <time.h>
+#include <sys/types.h>
 //#include <tr1/unordered_map>
 #include <map>
+#include <vector>
+
+#include "Rule.h"
 
 // #define DEFAULT_CONFIG_FILE "/etc/dscd.conf"
 #define DEFAULT_CONFIG_FILE "./dscd.conf"
@@ -44,23 +49,76 @@ class Config
   public:
     static Config &getConfig(std::string filename=DEFAULT_CONFIG_FILE);
 
+    // Re-read the file into a new snapshot and make it current
+    static bool reload();
+    bool hasChanged();
+    bool validate();
+
     bool syncTime();
-    int getBaud();
-    std::string getDevice();
     short getPort();
+    unsigned short getMetricsPort();
     std::string getShell();
-
-    std::string getZoneName(int zone);
-    std::string getAccessCode(int partition);
-    std::string getPartitionName(int partition);
-    std::string getUserName(int user);
-    std::string getKeyName(int key);
-    std::string getKeypadName(int keypad);
+    std::string getLogFile();
+    std::string getTraceFile();
+    int getTraceSample();
+
+    // [mqtt]; an empty host leaves the publisher off
+    std::string getMqttHost();
+    unsigned short getMqttPort();
+    std::string getMqttClientId();
+    std::string getMqttUser();
+    std::string getMqttPassword();
+    std::string getMqttPrefix();
+    int getMqttQos();
+    int getMqttKeepAlive();
+    size_t getMqttQueueSize();
+
+    // Each IT-100 has a [panel:N] section; settings missing there (or
+    // the whole section, for a single-panel setup) come from [main].
+    std::vector<int> getPanels();
+    std::string getPanelName(int panel);
+    int getBaud(int panel = 1);
+    std::string getDevice(int panel = 1);
+    std::string getTransport(int panel = 1);
+    std::string getStateFile(int panel = 1);
+    std::string getCaptureFile(int panel = 1);
+    std::string getJournalDirectory(int panel = 1);
+    double getReplaySpeed(int panel = 1);
+    int getAckTimeout(int panel = 1);
+    int getAckRetries(int panel = 1);
+
+    // Names and codes can be overridden per panel in [zones:N] etc.
+    std::string getZoneName(int zone, int panel = 0);
+    std::string getAccessCode(int partition, int panel = 0);
+    std::string getPartitionName(int partition, int panel = 0);
+    // From [partition_zones]; false if the partition isn't listed
+    bool getPartitionZones(int partition, int panel, uint64_t &zones);
+    std::string getUserName(int user, int panel = 0);
+    std::string getKeyName(int key, int panel = 0);
+    std::string getKeypadName(int keypad, int panel = 0);
 
     int getSyslogFacility();
     int getSyslogPriority(int command);
-
-    std::string getEventAction(int command);
+    // A [syslog] level name such as WARNING; -1 for NONE or unknown
+    static int levelToPriority(const std::string &level);
+
+    const std::string &getEventAction(int command);
+    // [plugins], by name
+    std::map<std::string,std::string> getPlugins();
+    // From [rules], in order of name
+    const std::vector<Rule> &getRules() const { return mRules; }
+    // From [debounce]: at most burst events per window (in ns) for
+    // this command and zone (or partition, for events without a zone)
+    bool getDebounce(int command, int subject, uint64_t &window, int &burst)
+    {
+      return command >= 0 && command < NUM_COMMAND_CODES &&
+             mDebounced[command] && lookupDebounce(command, subject,
+                                                   window, burst);
+    }
+
+    // Command names as used in [syslog] and [actions], e.g. ZONE_OPEN
+    int commandNameToInt(std::string);
+    const char *commandIntToName(int);
 
     bool readConfig(std::string fileame);
 
@@ -68,14 +126,28 @@ class Config
     Config(std::string filename=DEFAULT_CONFIG_FILE);
     ~Config() {;}
 
-    int commandNameToInt(std::string);
-    std::string commandIntToName(int);
+    void compileCommandTables();
+    bool compileDebounce(const std::string &tag, const std::string &value);
+    bool lookupDebounce(int command, int subject, uint64_t &window,
+                        int &burst);
 
-    std::string getValueByInt(std::string section, int tag);
+    // Unlike mDictionary[section][tag], these never add empty entries
+    const std::string &lookup(const std::string &section,
+                              const std::string &tag);
+    std::string getValueByInt(const char *section, int tag, int panel = 0);
+    std::string getPanelValue(int panel, std::string tag);
+    std::string getPanelFile(int panel, std::string tag);
+    std::string getRestartChanges(Config &previous);
 
   private:
+    enum { NUM_COMMAND_CODES = 1000 };
+
     static Config *theConfig;
+    static Config *retiredConfig;
     std::string mConfigFile;
+    bool mLoaded;
+    time_t mModified;
+    off_t mSize;
     /*
     std::tr1::unordered_map<std::string,
                             std::tr1::unordered_map<std::string,std::string> >
@@ -84,6 +156,16 @@ class Config
     std::map<std::string,
                             std::map<std::string,std::string> >
                             mDictionary;
+
+    /* Compiled from [syslog] and [actions], indexed by command code */
+    int mSyslogPriority[NUM_COMMAND_CODES];
+    std::string mEventAction[NUM_COMMAND_CODES];
+    std::vector<Rule> mRules;
+    bool mDebounced[NUM_COMMAND_CODES];
+    // By command * 1000 + subject; subject 0 for any
+    std::map<int, std::pair<uint64_t, int> > mDebounce;
+    // The first [rules] or [debounce] entry that didn't compile
+    std::string mTableError;
 };
 
 #endif
@@ -0,0 +1,184 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "Debounce.h"
+#include "Config.h"
+#include "It100.h"
+
+bool
+Debounce::pass(const Journal::Record &record, uint64_t now)
+{
+  bool passed = admit(record, now);
+
+  int other = opposite(record.code);
+  if (other)
+  {
+    Journal::Record first = record;
+    first.code = other < record.code ? other : record.code;
+    Pair &pair = mPairs[key(first)];
+    pair.latest = record.code;
+    if (passed) { pair.passed = record.code; }
+  }
+  return passed;
+}
+
+/**
+  The other half of a trouble/restore pair, or 0 for an event that
+  doesn't come in one.
+*/
+int
+Debounce::opposite(int code)
+{
+  static const int pairs[][2] =
+  {
+    { It100::ZONE_ALARM, It100::ZONE_ALARM_RESTORE },
+    { It100::ZONE_TAMPER, It100::ZONE_TAMPER_RESTORE },
+    { It100::ZONE_FAULT, It100::ZONE_FAULT_RESTORE },
+    { It100::ZONE_OPEN, It100::ZONE_RESTORED },
+    { It100::F_KEY_ALARM, It100::F_KEY_RESTORAL },
+    { It100::A_KEY_ALARM, It100::A_KEY_RESTORAL },
+    { It100::P_KEY_ALARM, It100::P_KEY_RESTORAL },
+    { It100::AUXILIARY_INPUT_ALARM, It100::AUXILIARY_INPUT_ALARM_RESTORED },
+    { It100::PARTITION_READY, It100::PARTITION_NOT_READY },
+    { It100::PANEL_BATTERY_TROUBLE, It100::PANEL_BATTERY_TROUBLE_RESTORE },
+    { It100::PANEL_AC_TROUBLE, It100::PANEL_AC_RESTORE },
+    { It100::SYSTEM_BELL_TROUBLE, It100::SYSTEM_BELL_TROUBLE_RESTORAL },
+    { It100::TLM_LINE_1_TROUBLE, It100::TLM_LINE_1_TROUBLE_RESTORED },
+    { It100::TLM_LINE_2_TROUBLE, It100::TLM_LINE_2_TROUBLE_RESTORED },
+    { It100::GENERAL_DEVICE_LOW_BATTERY,
+      It100::GENERAL_DEVICE_LOW_BATTERY_RESTORE },
+    { It100::WIRELESS_KEY_LOW_BATTERY_TROUBLE, It100::RESTORE },
+    { It100::HANDHELD_KEYPAD_LOW_BATTERY_TROUBLE, It100::RESTORED },
+    { It100::GENERAL_SYSTEM_TAMPER, It100::GENERAL_SYSTEM_TAMPER_RESTORE },
+    { It100::HOME_AUTOMATION_TROUBLE,
+      It100::HOME_AUTOMATION_TROUBLE_RESTORE },
+    { It100::TROUBLE_STATUS_LED_ON, It100::TROUBLE_STATUS_RESTORE_LED_OFF },
+    { It100::FIRE_TROUBLE_ALARM, It100::FIRE_TROUBLE_ALARM_RESTORED },
+  };
+  for (size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++)
+  {
+    if (pairs[i][0] == code) { return pairs[i][1]; }
+    if (pairs[i][1] == code) { return pairs[i][0]; }
+  }
+  return 0;
+}
+
+bool
+Debounce::admit(const Journal::Record &record, uint64_t now)
+{
+  uint64_t length;
+  int burst;
+  int subject = record.zone ? record.zone : record.partition;
+  if (!Config::getConfig().getDebounce(record.code, subject, length, burst))
+  {
+    return true;
+  }
+
+  uint32_t k = key(record);
+  std::map<uint32_t, Window>::iterator w = mWindows.find(k);
+  if (w != mWindows.end() && now - w->second.start < w->second.length)
+  {
+    Window &window = w->second;
+    if (window.passed < (uint32_t)burst)
+    {
+      window.passed++;
+      return true;
+    }
+    window.suppressed++;
+    window.last = record;
+    return false;
+  }
+
+  // A new window, after reporting on the old one if expire() hasn't
+  // got to it yet. Nothing need be delivered late: this event is the
+  // same as its last, and goes through.
+  if (w != mWindows.end() && w->second.suppressed)
+  {
+    Summary summary = { record.code, record.zone, record.partition,
+                        w->second.suppressed, w->second.length };
+    mClosed.push_back(summary);
+  }
+  Window &window = mWindows[k];
+  window.start = now;
+  window.length = length;
+  window.passed = 1;
+  window.suppressed = 0;
+  if (!mNextExpiry || now + length < mNextExpiry)
+  {
+    mNextExpiry = now + length;
+  }
+  return true;
+}
+
+void
+Debounce::expire(uint64_t now, std::vector<Summary> &summaries,
+                 std::vector<Journal::Record> &late)
+{
+  summaries.swap(mClosed);
+  mClosed.clear();
+  mNextExpiry = 0;
+
+  std::map<uint32_t, Window>::iterator w = mWindows.begin();
+  while (w != mWindows.end())
+  {
+    const Window &window = w->second;
+    uint64_t end = window.start + window.length;
+    if (now < end)
+    {
+      if (!mNextExpiry || end < mNextExpiry) { mNextExpiry = end; }
+      w++;
+      continue;
+    }
+
+    if (window.suppressed)
+    {
+      Summary summary = { (int)(w->first >> 16), (int)(w->first >> 8 & 0xff),
+                          (int)(w->first & 0xff), window.suppressed,
+                          window.length };
+      summaries.push_back(summary);
+
+      // The last of the pair we saw was suppressed, and isn't what was
+      // last let through
+      int other = opposite(window.last.code);
+      if (other)
+      {
+        Journal::Record first = window.last;
+        first.code = other < first.code ? other : first.code;
+        Pair &pair = mPairs[key(first)];
+        if (pair.latest == window.last.code &&
+            pair.passed != window.last.code)
+        {
+          late.push_back(window.last);
+          pair.passed = window.last.code;
+        }
+      }
+    }
+    mWindows.erase(w++);
+  }
+}
@@ -0,0 +1,115 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _DEBOUNCE_H
+#define _DEBOUNCE_H 1
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+#include "Journal.h"
+
+/**
+  Rate limits from [debounce], applied to each event before it is
+  logged, acted on or pushed to clients. Each command, zone and
+  partition gets its own window: the first BURST events in it go
+  through, and the rest are only counted. When the window closes,
+  whatever it suppressed comes back as a summary, so a flapping AC
+  trouble or a loose door contact costs one log line a window rather
+  than a log line, a fork and a client wakeup per frame.
+
+  Suppressed events still update the panel's state and are still
+  recorded; only what reacts to them is held back. For the halves of a
+  trouble/restore pair, that would leave consumers with the wrong idea
+  when a window ends on a suppressed event the other way from the last
+  one let through: expire() hands that event back to be delivered late.
+*/
+
+class Debounce
+{
+  public:
+    struct Summary
+    {
+      int code;
+      int zone;
+      int partition;
+      uint32_t suppressed;
+      uint64_t window;          // ns
+    };
+
+    Debounce() : mNextExpiry(0) {;}
+
+    // True if the event should be logged and acted on. now is
+    // monotonic, in ns.
+    bool pass(const Journal::Record &record, uint64_t now);
+
+    // Windows that have closed with something suppressed; the rest
+    // are forgotten. late gets the suppressed events that have to be
+    // delivered after all.
+    void expire(uint64_t now, std::vector<Summary> &summaries,
+                std::vector<Journal::Record> &late);
+
+    // Whether expire() has anything to do yet
+    bool isExpiring(uint64_t now) const
+      { return mNextExpiry && now >= mNextExpiry; }
+
+  private:
+    struct Window
+    {
+      uint64_t start;
+      uint64_t length;
+      uint32_t passed;
+      uint32_t suppressed;
+      Journal::Record last;     // suppressed
+    };
+
+    // Of a trouble/restore pair: the code last let through, and the
+    // last one seen
+    struct Pair
+    {
+      int passed;
+      int latest;
+    };
+
+    bool admit(const Journal::Record &record, uint64_t now);
+    static int opposite(int code);
+
+    static uint32_t key(const Journal::Record &record)
+      { return record.code << 16 | record.zone << 8 | record.partition; }
+
+  private:
+    std::map<uint32_t, Window> mWindows;
+    std::map<uint32_t, Pair> mPairs;  // by key() of the lower code
+    std::vector<Summary> mClosed;
+    uint64_t mNextExpiry;       // the earliest window end; 0 for none
+};
+
+#endif
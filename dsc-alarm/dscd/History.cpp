@@ -0,0 +1,210 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "History.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+  Command classes for filtering, by code range
+*/
+static const struct
+{
+  const char *name;
+  int low;
+  int high;
+} commandClasses[] =
+{
+  { "system",    500, 599 },
+  { "zone",      600, 619 },
+  { "alarm",     620, 649 },
+  { "partition", 650, 699 },
+  { "access",    700, 799 },
+  { "trouble",   800, 899 },
+  { "keypad",    900, 999 },
+};
+
+bool
+History::Filter::parse(const char *term)
+{
+  const char *value = strchr(term, '=');
+  if (!value) { return false; }
+  size_t length = value - term;
+  value++;
+
+  if (length == 4 && !strncmp(term, "code", 4))
+  {
+    low = high = atoi(value);
+    return true;
+  }
+  if (length == 5 && !strncmp(term, "class", 5))
+  {
+    for (size_t i = 0;
+         i < sizeof(commandClasses) / sizeof(commandClasses[0]); i++)
+    {
+      if (!strcmp(value, commandClasses[i].name))
+      {
+        low = commandClasses[i].low;
+        high = commandClasses[i].high;
+        return true;
+      }
+    }
+    return false;
+  }
+  if (length == 4 && !strncmp(term, "zone", 4))
+  {
+    zone = atoi(value);
+    return zone > 0;
+  }
+  if (length == 9 && !strncmp(term, "partition", 9))
+  {
+    partition = atoi(value);
+    return partition > 0;
+  }
+  return false;
+}
+
+History::History() : mCount(0)
+{
+}
+
+void
+History::add(const Journal::Record &record)
+{
+  mRing[mCount % SIZE] = record;
+  mCount++;
+}
+
+uint64_t
+History::getNewest() const
+{
+  return mCount ? at(0).time : 0;
+}
+
+/**
+  Memory holds everything from its oldest record on, so the journal is
+  only read for what came before that, and nothing is found twice.
+*/
+void
+History::find(const Journal *journal, int panel, const Filter &filter,
+              uint64_t from, uint64_t to, size_t max,
+              std::vector<Journal::Record> &events, bool &more,
+              uint64_t &next) const
+{
+  events.clear();
+  more = false;
+  next = from;
+
+  uint64_t oldest = size() ? at(size() - 1).time : ~(uint64_t)0;
+  if (from < oldest && journal && journal->isOpen())
+  {
+    Journal::Reader reader(journal->getDirectory(), panel);
+    Journal::Record record;
+    size_t scanned = 0;
+    reader.seek(from);
+    while (reader.next(record) && record.time < to && record.time < oldest)
+    {
+      if (++scanned > MAX_SCAN || events.size() == max)
+      {
+        more = true;
+        next = record.time;
+        return;
+      }
+      if (!filter.matches(record)) { continue; }
+      events.push_back(record);
+      next = record.time + 1;
+    }
+  }
+
+  for (size_t age = size(); age-- > 0; )
+  {
+    const Journal::Record &record = at(age);
+    if (record.time < from) { continue; }
+    if (record.time >= to) { break; }
+    if (!filter.matches(record)) { continue; }
+    if (events.size() == max) { more = true; break; }
+    events.push_back(record);
+    next = record.time + 1;
+  }
+}
+
+void
+History::findLast(const Journal *journal, int panel, const Filter &filter,
+                  size_t count, std::vector<Journal::Record> &events,
+                  bool &more) const
+{
+  events.clear();
+  more = false;
+
+  for (size_t age = 0; age < size() && events.size() < count; age++)
+  {
+    if (filter.matches(at(age))) { events.push_back(at(age)); }
+  }
+
+  // If memory came up short, go on into the journal from just before
+  // the oldest record in memory, newest segment first. Segments are
+  // read whole, so a cut-short answer has no gaps in it.
+  if (events.size() < count && journal && journal->isOpen())
+  {
+    uint64_t oldest = size() ? at(size() - 1).time : ~(uint64_t)0;
+    Journal::Reader reader(journal->getDirectory(), panel);
+    size_t scanned = 0;
+    for (size_t segment = reader.getSegmentCount(); segment-- > 0 &&
+         events.size() < count; )
+    {
+      if (scanned >= MAX_SCAN)
+      {
+        more = true;
+        break;
+      }
+
+      std::vector<Journal::Record> matches;
+      Journal::Record record;
+      reader.seekSegment(segment);
+      while (reader.next(record) && reader.getSegment() == segment &&
+             record.time < oldest)
+      {
+        scanned++;
+        if (filter.matches(record)) { matches.push_back(record); }
+      }
+
+      // Newest first, like the memory scan above
+      while (matches.size() && events.size() < count)
+      {
+        events.push_back(matches.back());
+        matches.pop_back();
+      }
+    }
+  }
+
+  // Hand them back oldest first
+  std::reverse(events.begin(), events.end());
+}
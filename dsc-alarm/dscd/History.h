@@ -0,0 +1,110 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _HISTORY_H
+#define _HISTORY_H 1
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Journal.h"
+
+/**
+  Recent events for one panel, for answering history queries from
+  clients. The newest SIZE events are kept in memory; anything older
+  comes from the panel's journal, when there is one. Events the
+  journal never saw (rule notes pushed only to clients) are in memory
+  alone, and are gone once they drop out of it.
+
+  Events are ordered by time, and a time (in ns since the epoch) is
+  also the cursor a client passes back to carry on where a previous
+  answer stopped.
+
+  Queries run on the event loop, so one never reads more than about
+  MAX_SCAN records of the journal: past that it stops early, says
+  there is more, and leaves a cursor to carry on from.
+*/
+
+class History
+{
+  public:
+    enum { SIZE = 4096, MAX_SCAN = 65536 };
+
+    struct Filter
+    {
+      Filter() : low(0), high(999), zone(0), partition(0) {;}
+
+      // Parses "code=609", "class=zone", "zone=3" or "partition=1"
+      bool parse(const char *term);
+      bool matches(const Journal::Record &record) const
+      {
+        return record.code >= low && record.code <= high &&
+               (!zone || record.zone == zone) &&
+               (!partition || record.partition == partition);
+      }
+
+      int low;
+      int high;
+      int zone;
+      int partition;
+    };
+
+    History();
+
+    void add(const Journal::Record &record);
+    uint64_t getNewest() const;
+
+    // Matching events with from <= time < to, oldest first. If there
+    // are more than max, or the journal scan was cut short, more is
+    // set; next is where to carry on from either way.
+    void find(const Journal *journal, int panel, const Filter &filter,
+              uint64_t from, uint64_t to, size_t max,
+              std::vector<Journal::Record> &events, bool &more,
+              uint64_t &next) const;
+
+    // The last count matching events, oldest first. more is set if
+    // the journal scan was cut short, and there may be older ones.
+    void findLast(const Journal *journal, int panel, const Filter &filter,
+                  size_t count, std::vector<Journal::Record> &events,
+                  bool &more) const;
+
+  private:
+    const Journal::Record &at(size_t age) const
+      { return mRing[(mCount - 1 - age) % SIZE]; }
+    size_t size() const
+      { return mCount < SIZE ? mCount : (size_t)SIZE; }
+
+  private:
+    Journal::Record mRing[SIZE];
+    uint64_t mCount;
+};
+
+#endif
@@ -31,11 +31,16 @@
 #include "It100.h"
 #include "Config.h"
 #include "Command.h"
+#include "Transport.h"
+#include "Log.h"
+#include "Plugins.h"
+#include "Mqtt.h"
 
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -52,171 +57,719 @@
 #include <vector>
 
 
-It100::It100() : mHasLabels(false), mKeypadEtag(1)
+It100::It100(int panel) : mPanel(panel), mTransport(0), mNextReconnect(0),
+                          mReconnectDelay(1), mRxLength(0), mAcks(panel),
+                          mAttempts(0), mEtagReadAt(0), mEtagTraced(false),
+                          mState(0)
 {
-  strncpy(mDevice, Config::getConfig().getDevice().c_str(), sizeof(mDevice));
-  mDescriptor = open(mDevice, O_RDWR);
+  Config &config = Config::getConfig();
+  configChanged();
 
-  if (mDescriptor < 0)
+  Metrics &metrics = Metrics::getMetrics();
+  std::string labels = getPanelLabel();
+  memset(mFramesIn, 0, sizeof(mFramesIn));
+  memset(mFramesOut, 0, sizeof(mFramesOut));
+  memset(mSuppressed, 0, sizeof(mSuppressed));
+  mQueueDepth = &metrics.gauge("dscd_pending_commands",
+    "Commands waiting for the panel to acknowledge the one before", labels);
+  mActionSpawn = &metrics.histogram("dscd_action_spawn_seconds",
+    "Time taken to start an action", labels);
+  mActionTime = &metrics.histogram("dscd_action_seconds",
+    "How long actions ran (to the nearest event loop pass)", labels);
+  mSystemErrors = &metrics.counter("dscd_system_errors_total",
+    "SYSTEM_ERROR reports from the panel", labels);
+  for (int i = 0; i < Trace::NUM_STAGES; i++)
+  {
+    mStageTime[i] = &metrics.histogram("dscd_stage_seconds",
+      "Time inbound frames spend in each stage of processing",
+      labels + ",stage=\"" + Trace::getStageName(i) + "\"");
+  }
+
+  mTransport = Transport::create(mPanel);
+  mTransportSpec = getTransportSpec();
+  if (!mTransport->open())
+  {
+    // We'll keep trying from checkConnection(); anything sent in
+    // the meantime is queued until the panel is reachable.
+    perror(mTransport->getName().c_str());
+    syslog(LOG_ERR, "Could not open %s", mTransport->getName().c_str());
+  }
+
+  // Set up the keypad state, picking up where the last
+  // instance left off if we have a valid snapshot.
+  std::string stateFile = config.getStateFile(mPanel);
+  if (!mStateFile.open(stateFile))
   {
-    perror(mDevice);
     exit(-1);
   }
+  mState = mStateFile.getState();
 
-  int baud;
-  int baudInt = Config::getConfig().getBaud();
-  switch (baudInt)
+  if (mStateFile.isRestored())
   {
-    case 9600: baud = B9600; break;
-    case 19200: baud = B19200; break;
-    case 38400: baud = B38400; break;
-    case 57600: baud = B57600; break;
-    case 115200: baud = B115200; break;
-    default: baud = B9600;
+    syslog(LOG_INFO, "Restored panel state from %s (etag %u)",
+           stateFile.c_str(), mState->keypadEtag);
   }
+  mNames.resolve(config, mPanel, mState);
+  resolvePartitionZones();
+}
 
-  setFdBaud(baud);
+/**
+  Partitions listed in [partition_zones] get exactly the zones listed;
+  the others keep what we've learned from the partition numbers in
+  zone alarm and tamper reports.
+*/
+void
+It100::resolvePartitionZones()
+{
+  Config &config = Config::getConfig();
+  mStateFile.beginUpdate();
+  for (int p = 1; p <= ZoneState::NUM_PARTITIONS; p++)
+  {
+    uint64_t zones;
+    if (config.getPartitionZones(p, mPanel, zones))
+    {
+      mState->zones.members[p] = zones;
+    }
+  }
+  mStateFile.endUpdate();
+}
 
-  mCommandPending = 0;
+It100::~It100()
+{
+  delete mTransport;
+}
 
-  // Set up the keypad state
-  memset(mLCD, ' ', 32);
-  mLCD[32] = 0;
-  memset(mLedState, sizeof(mLedState), OFF);
-  for (int i = 0; i <= 64; i++) { mZoneOpen[i] = false; }
+std::string
+It100::getTransportSpec()
+{
+  Config &config = Config::getConfig();
+  std::stringstream spec;
+  spec << config.getTransport(mPanel) << ' ' << config.getDevice(mPanel)
+       << ' ' << config.getBaud(mPanel) << ' ' << config.getReplaySpeed(mPanel);
+  return spec.str();
 }
 
-uint64_t
-It100::getZoneStatus() const
+/**
+  Pick up settings from a freshly loaded configuration. The link to
+  the panel is only touched if its own settings changed.
+*/
+void
+It100::configChanged()
 {
-  uint64_t status = 0;
-  for (int i = 64; i > 0; i--)
+  Config &config = Config::getConfig();
+  mPanelName = config.getPanelName(mPanel);
+  mAckTimeout = (uint64_t)config.getAckTimeout(mPanel) * 1000000;
+  mAckRetries = config.getAckRetries(mPanel);
+
+  // Only bother telling panels apart in the logs if there's more than one
+  mLogPrefix.clear();
+  if (config.getPanels().size() > 1)
+  {
+    mLogPrefix = "[" + mPanelName + "] ";
+  }
+
+  // Not set up yet on the first call; the constructor resolves them
+  if (mState)
+  {
+    mNames.resolve(config, mPanel, mState);
+    resolvePartitionZones();
+  }
+
+  std::string captureFile = config.getCaptureFile(mPanel);
+  if (captureFile != mCaptureFile)
+  {
+    mCapture.close();
+    if (captureFile.length())
+    {
+      mCapture.create(captureFile);
+    }
+    mCaptureFile = captureFile;
+  }
+
+  std::string journal = config.getJournalDirectory(mPanel);
+  if (journal != mJournal.getDirectory())
+  {
+    mJournal.close();
+    if (journal.length())
+    {
+      mJournal.open(journal, mPanel);
+    }
+  }
+
+  if (mTransport && getTransportSpec() != mTransportSpec)
   {
-    status <<= 1;
-    status |= (mZoneOpen[i]?1:0);
+    Log::getLog().write(Log::SYSLOG, LOG_NOTICE,
+                        "%sPanel link settings changed; reconnecting",
+                        mLogPrefix.c_str());
+    delete mTransport;
+    mTransport = Transport::create(mPanel);
+    mTransportSpec = getTransportSpec();
+    mNextReconnect = 0;
+    mReconnectDelay = 1;
   }
-  return status;
 }
 
-// TODO -- This is butt ugly, and should be made to cache stuff into
-// a class attribute buffer so we can return immediately,
-// even if a fully command has not arrived yet.
+int
+It100::getDescriptor()
+{
+  return mTransport->getDescriptor();
+}
+
+bool
+It100::isConnected()
+{
+  return mTransport->isOpen();
+}
+
+bool
+It100::isFinished()
+{
+  return mTransport->isFinished();
+}
+
+bool
+It100::wantsWrite()
+{
+  return mTransport->wantsWrite();
+}
+
+/**
+  Re-open the transport if it has gone away, backing off between
+  attempts so that a missing device doesn't eat the CPU. While it is
+  open, make sure the panel hasn't ignored our last command.
+*/
 void
-It100::processMessage()
+It100::checkConnection()
 {
-  char buffer[80];
-  char commandStr[4] = {0,0,0,0};
-  char checksumStr[3] = {0,0,0};
-  char *parameters = buffer+3;
-  int length = 0;
-  bool lineDone = false;
+  if (mTransport->isOpen())
+  {
+    checkAcknowledgement();
+    return;
+  }
+  if (mTransport->isConnecting() || time(0) < mNextReconnect)
+  {
+    return;
+  }
+
+  if (!mTransport->open())
+  {
+    mNextReconnect = time(0) + mReconnectDelay;
+    if (mReconnectDelay < 60) { mReconnectDelay *= 2; }
+    return;
+  }
+  if (!mTransport->isConnecting()) { connected(); }
+}
 
-  // Read an entire line of output from the IT-100
-  while (length < sizeof(buffer) && !lineDone)
+/**
+  Carry on with a connect that open() started, or hand the transport
+  more of the output it couldn't take before. Called every time around
+  the event loop while wantsWrite(), writable or not, so a connect that
+  never completes can time out.
+*/
+void
+It100::processWrite(bool writable)
+{
+  if (mTransport->isConnecting())
   {
-    int s = read(mDescriptor,buffer + length,1);
-    if (s < 1)
+    int s = mTransport->finishOpen(writable);
+    if (s > 0) { connected(); }
+    if (s < 0)
     {
-      return;
+      mNextReconnect = time(0) + mReconnectDelay;
+      if (mReconnectDelay < 60) { mReconnectDelay *= 2; }
     }
-    if (buffer[length] == '\n') 
+    return;
+  }
+  if (writable && !mTransport->flush())
+  {
+    mNextReconnect = time(0) + mReconnectDelay;
+  }
+}
+
+void
+It100::connected()
+{
+  Log::getLog().write(Log::SYSLOG, LOG_NOTICE, "Connected to %s",
+                      mTransport->getName().c_str());
+  mReconnectDelay = 1;
+  mRxLength = 0;
+
+  // Anything in flight when we lost the link will never be
+  // acknowledged; start the queue over, then resynchronize.
+  mAcks.cancel();
+  sendPendingCommand();
+  statusRequest();
+}
+
+/**
+  Read whatever the transport has for us, and process each complete
+  line as it arrives. Partial lines are kept until the rest shows up.
+*/
+void
+It100::processMessage()
+{
+  char buffer[256];
+  int s = mTransport->read(buffer, sizeof(buffer));
+  uint64_t readAt = Capture::now();
+
+  if (s == 0)
+  {
+    mNextReconnect = time(0) + mReconnectDelay;
+    return;
+  }
+
+  for (int i = 0; i < s; i++)
+  {
+    if (buffer[i] == '\n')
     {
-      buffer[length-1] = '\0';
-      lineDone = true;
-      length--;
+      if (mRxLength && mRxBuffer[mRxLength-1] == '\r') { mRxLength--; }
+      mRxBuffer[mRxLength] = 0;
+
+      // Shortest valid frame: three digit code plus checksum
+      if (mRxLength >= 5)
+      {
+        mCapture.record(Capture::INBOUND, mRxBuffer, mRxLength);
+        processLine(mRxBuffer, readAt);
+      }
+      mRxLength = 0;
     }
-    else
+    else if (mRxLength < sizeof(mRxBuffer) - 1)
     {
-      length += s;
+      mRxBuffer[mRxLength++] = buffer[i];
     }
   }
+}
 
-  // Parse the line into a command object; log it,
-  // update our internal state, and execute any
-  // applicable shell commands.
+void
+It100::processLine(const char *buffer, uint64_t readAt)
+{
+  // Parse the line into a command object; update our
+  // internal state, record it, and (unless [debounce]
+  // holds it back) log it and run its rules and actions.
   {
+    uint64_t stamps[Trace::NUM_STAMPS];
+    stamps[Trace::READ] = readAt;
+
     Command *c = Command::makeCommand(*this, buffer);
     if (c)
     {
-      std::stringstream logMessage;
-      logMessage << (*c);
+      Log &log = Log::getLog();
+      char text[Log::TEXT_LENGTH];
+      c->format(text, sizeof(text));
+      bool traced = Trace::getTrace().sample();
 
-      std::cout << ">>> " << logMessage.str() << std::endl;
-      int priority = c->getSyslogPriority();
-      if (priority != -1)
+      int code = c->getCommandNumber();
+      countFrame(mFramesIn, "dscd_frames_received_total",
+                 "Frames received from the panel, by command", code);
+      if (code == COMMAND_ACKNOWLEDGE || code == COMMAND_ERROR)
       {
-        syslog(priority, "%s", logMessage.str().c_str());
+        mAcks.replied(code == COMMAND_ERROR, Capture::now());
       }
+      if (code == SYSTEM_ERROR) { mSystemErrors->increment(); }
 
+      stamps[Trace::PARSED] = Capture::now();
+
+      unsigned int etag = mState->keypadEtag;
       c->processStateChange();
+      stamps[Trace::STATE] = Capture::now();
+      if (mState->keypadEtag != etag)
+      {
+        mEtagReadAt = readAt;
+        mEtagTraced = traced;
+      }
 
-      std::string action = c->getShellAction();
+      Journal::Record record;
+      describeEvent(*c, record);
+      bool passed = mDebounce.pass(record, stamps[Trace::STATE]);
+      if (!passed)
+      {
+        record.flags |= Journal::SUPPRESSED;
+        countFrame(mSuppressed, "dscd_events_suppressed_total",
+                   "Events held back by [debounce], by command", code);
+      }
+      recordEvent(record);
+      stamps[Trace::RECORDED] = Capture::now();
 
-      // We use a double-fork approach to avoid zombies
-      if (action.length() > 0)
+      log.write(Log::CONSOLE, -1, "%s>>> %s%s", mLogPrefix.c_str(), text,
+                passed ? "" : " (suppressed)");
+      if (passed)
       {
-        std::cout << "Executing command: " << action << std::endl;
+        actOn(*c, record, text);
+      }
+      Mqtt::getMqtt().event(*this, record, passed);
+      stamps[Trace::ACTED] = Capture::now();
 
-        pid_t child = fork();
-        if (!child)
-        {
-          pid_t grandchild = fork();
-          if (grandchild) 
-          { 
-            if (grandchild == -1)
-            {
-              //syslog();
-            }
-            exit(0); 
-          }
-          std::string shell = Config::getConfig().getShell();
-
-          char flag[] = {'-','c',0};
-
-          char *const av[] = {(char *)(shell.c_str()),
-                              flag,
-                              (char *)(action.c_str()),
-                              (char *)0};
-
-          char *const ev[] = {(char *)0};
-          execve("/bin/sh",av,ev);
-          exit(-1);
-        }
-        else
+      for (int i = 0; i + 1 < Trace::NUM_STAMPS; i++)
+      {
+        mStageTime[i]->observe(stamps[i + 1] - stamps[i]);
+      }
+      mStageTime[Trace::TOTAL]->observe(stamps[Trace::ACTED] - readAt);
+      if (traced)
+      {
+        const char *name = Config::getConfig().commandIntToName(code);
+        Trace::getTrace().frame(mPanel, name ? name : "", stamps);
+      }
+      delete c;
+    }
+  }
+
+}
+
+/**
+  Everything that reacts to an event [debounce] lets through: syslog,
+  rules, plugins and the [actions] command.
+*/
+void
+It100::actOn(Command &command, const Journal::Record &record,
+             const char *text)
+{
+  int priority = command.getSyslogPriority();
+  if (priority != -1)
+  {
+    Log::getLog().write(Log::SYSLOG, priority, "%s%s", mLogPrefix.c_str(),
+                        text);
+  }
+
+  runRules(command, record, priority);
+  Plugins::getPlugins().event(*this, record);
+  std::string action = command.getShellAction();
+  if (action.length() > 0)
+  {
+    spawnAction(action);
+  }
+}
+
+/**
+  Log what [debounce] has held back, once each window closes, and
+  deliver any suppressed event that the last one let through would
+  otherwise contradict (see Debounce.h).
+*/
+void
+It100::reportSuppressed()
+{
+  uint64_t now = Capture::now();
+  if (!mDebounce.isExpiring(now)) { return; }
+
+  std::vector<Debounce::Summary> summaries;
+  std::vector<Journal::Record> late;
+  mDebounce.expire(now, summaries, late);
+  Config &config = Config::getConfig();
+  for (size_t i = 0; i < summaries.size(); i++)
+  {
+    const Debounce::Summary &s = summaries[i];
+    char subject[32] = "";
+    if (s.zone)
+    {
+      snprintf(subject, sizeof(subject), " zone %d", s.zone);
+    }
+    else if (s.partition)
+    {
+      snprintf(subject, sizeof(subject), " partition %d", s.partition);
+    }
+
+    int priority = config.getSyslogPriority(s.code);
+    int destinations = Log::CONSOLE | (priority != -1 ? Log::SYSLOG : 0);
+    Log::getLog().write(destinations, priority,
+                        "%s%s%s: %u more suppressed in %.1fs",
+                        mLogPrefix.c_str(), config.commandIntToName(s.code),
+                        subject, s.suppressed, s.window / 1e9);
+  }
+
+  for (size_t i = 0; i < late.size(); i++)
+  {
+    // Rebuilt from what was recorded; the state change has been made
+    char frame[3 + Journal::DATA_LENGTH + 3];
+    int length = snprintf(frame, sizeof(frame), "%03d%.*s", late[i].code,
+                          (int)late[i].length, late[i].data);
+    unsigned char checksum = 0;
+    for (int j = 0; j < length; j++) { checksum += frame[j]; }
+    snprintf(frame + length, sizeof(frame) - length, "%02X", checksum);
+    Command *c = Command::makeCommand(*this, frame);
+    if (!c) { continue; }
+
+    // Recorded again, let through, so clients see it too
+    Journal::Record record = late[i];
+    record.time = mJournal.stamp();
+    record.etag = mState->keypadEtag;
+    record.flags &= ~Journal::SUPPRESSED;
+    recordEvent(record);
+
+    char text[Log::TEXT_LENGTH];
+    c->format(text, sizeof(text));
+    Log::getLog().write(Log::CONSOLE, -1, "%s>>> %s (delivered late)",
+                        mLogPrefix.c_str(), text);
+    actOn(*c, record, text);
+    Mqtt::getMqtt().event(*this, record, true);
+    delete c;
+  }
+}
+
+/**
+  Check every rule against an event that has just been recorded, and
+  carry out those that match.
+*/
+void
+It100::runRules(const Command &command, const Journal::Record &record,
+                int priority)
+{
+  const std::vector<Rule> &rules = Config::getConfig().getRules();
+  for (size_t i = 0; i < rules.size(); i++)
+  {
+    const Rule &rule = rules[i];
+    if (!rule.matches(record, priority, *this)) { continue; }
+
+    std::string labels = getPanelLabel() + ",rule=\"" + rule.getName() +
+                         "\"";
+    Metrics::getMetrics().counter("dscd_rules_fired_total",
+      "Rules whose conditions matched an event", labels).increment();
+
+    std::string text = command.expand(rule.getArgument());
+    switch (rule.getSink())
+    {
+      case Rule::LOG:
+        Log::getLog().write(Log::CONSOLE|Log::SYSLOG, LOG_NOTICE, "%s%s: %s",
+                            mLogPrefix.c_str(), rule.getName().c_str(),
+                            text.c_str());
+        break;
+
+      case Rule::JOURNAL:
+      case Rule::PUSH:
+        recordNote(record, rule.getName(), text,
+                   rule.getSink() == Rule::JOURNAL);
+        break;
+
+      case Rule::COMMAND:
+        // The code was checked when the rule was read; the data can
+        // only be checked now that it's expanded
+        if (text.length() > 3 + MAX_COMMAND_DATA)
         {
-          if (child == -1)
-          {
-            //syslog();
-          }
-          waitpid(child,0,0);
+          Log::getLog().write(Log::CONSOLE|Log::SYSLOG, LOG_WARNING,
+                              "%s%s: command too long: %s",
+                              mLogPrefix.c_str(), rule.getName().c_str(),
+                              text.c_str());
+          break;
         }
+        sendCommand(static_cast<command_t>(atoi(rule.getArgument().substr(0,
+                      3).c_str())), "%s", text.c_str() + 3);
+        break;
 
-      }
-      delete c;
+      case Rule::RUN:
+        spawnAction(text);
+        break;
+    }
+  }
+}
+
+/**
+  The log writer thread doesn't survive the fork, so the child must not
+  allocate or run exit handlers: everything is prepared up front, and
+  it leaves with _exit() if the exec fails. reapActions() collects it
+  when it's done.
+*/
+void
+It100::spawnAction(const std::string &action)
+{
+  Log &log = Log::getLog();
+  log.write(Log::CONSOLE, -1, "Executing command: %s", action.c_str());
+
+  std::string shell = Config::getConfig().getShell();
+  char flag[] = {'-','c',0};
+  char *const av[] = {(char *)(shell.c_str()),
+                      flag,
+                      (char *)(action.c_str()),
+                      (char *)0};
+  char *const ev[] = {(char *)0};
+
+  uint64_t start = Capture::now();
+  pid_t child = fork();
+  if (!child)
+  {
+    execve("/bin/sh",av,ev);
+    _exit(127);
+  }
+  else if (child == -1)
+  {
+    log.write(Log::SYSLOG, LOG_ERR, "%sCould not run action: %s",
+              mLogPrefix.c_str(), strerror(errno));
+  }
+  else
+  {
+    mActionSpawn->observe(Capture::now() - start);
+    mActions[child] = start;
+  }
+}
+
+/**
+  Collect actions that have finished, noting how long they ran and how
+  they exited.
+*/
+void
+It100::reapActions()
+{
+  std::map<pid_t, uint64_t>::iterator a = mActions.begin();
+  while (a != mActions.end())
+  {
+    int status;
+    if (waitpid(a->first, &status, WNOHANG) == 0)
+    {
+      a++;
+      continue;
+    }
+
+    // Gone, one way or another
+    mActionTime->observe(Capture::now() - a->second);
+
+    char labels[64];
+    if (WIFEXITED(status))
+    {
+      snprintf(labels, sizeof(labels), "%s,status=\"%d\"",
+               getPanelLabel().c_str(), WEXITSTATUS(status));
     }
+    else
+    {
+      snprintf(labels, sizeof(labels), "%s,status=\"signal %d\"",
+               getPanelLabel().c_str(),
+               WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+    }
+    Metrics::getMetrics().counter("dscd_action_exits_total",
+      "Actions that finished, by exit status", labels).increment();
+
+    mActions.erase(a++);
   }
+}
 
+void
+It100::clientNotified()
+{
+  if (!mEtagReadAt) { return; }
+
+  uint64_t now = Capture::now();
+  mStageTime[Trace::CLIENT]->observe(now - mEtagReadAt);
+  if (mEtagTraced)
+  {
+    Trace::getTrace().clientWoken(mPanel, mEtagReadAt, now);
+  }
+}
+
+std::string
+It100::getPanelLabel() const
+{
+  char label[24];
+  snprintf(label, sizeof(label), "panel=\"%d\"", mPanel);
+  return label;
 }
 
+/**
+  Bump the per-command counter for a frame, registering it the first
+  time that command is seen.
+*/
 void
-It100::setFdBaud(int baud)
-{
-  // TODO -- make sure the IT-100 is set to the selected speed
-  struct termios desc;
-#if 0 
-  // Cullen commented out this code and replaced it with the code in the #else
-  // side. This code won't compile on OSX and the code I replaced with looks
-  // right but I have not tested it on linux so I left this code here so people
-  // could see how to fix it.
-  ioctl(mDescriptor, TCGETA, &desc);
-  desc.c_cflag &= ~CBAUD;
-  desc.c_cflag |= baud;
-  ioctl(mDescriptor, TCSETA, &desc);
-#else
-  tcgetattr( mDescriptor, &desc );
-  cfsetspeed( &desc, baud );
-  tcsetattr( mDescriptor, TCSANOW, &desc );
-#endif 
+It100::countFrame(Metrics::Counter **table, const char *name,
+                  const char *help, int code)
+{
+  if (code < 0 || code >= 1000) { return; }
+  if (!table[code])
+  {
+    const char *command = Config::getConfig().commandIntToName(code);
+    char labels[96];
+    if (command && command[0])
+    {
+      snprintf(labels, sizeof(labels), "%s,command=\"%s\"",
+               getPanelLabel().c_str(), command);
+    }
+    else
+    {
+      snprintf(labels, sizeof(labels), "%s,command=\"%03d\"",
+               getPanelLabel().c_str(), code);
+    }
+    table[code] = &Metrics::getMetrics().counter(name, help, labels);
+  }
+  table[code]->increment();
+}
+
+/**
+  A decoded event as a journal record, along with the keypad etag it
+  left behind and the names it resolved to at the time.
+*/
+void
+It100::describeEvent(const Command &command, Journal::Record &record)
+{
+  memset(&record, 0, sizeof(record));
+  record.time = mJournal.stamp();
+  record.etag = mState->keypadEtag;
+  record.code = command.getCommandNumber();
+  record.panel = mPanel;
+
+  const char *data = command.getParameters();
+  size_t length = strlen(data);
+  if (length > sizeof(record.data)) { length = sizeof(record.data); }
+  memcpy(record.data, data, length);
+  record.length = length;
+
+  // Keep the zone and partition for filtering, and the parameters that
+  // aren't just numbers: zone, partition and user names, labels, LCD
+  // text
+  int names = 0;
+  for (int i = 0; i < command.getNumParams(); i++)
+  {
+    std::string name = command.getParamName(i);
+    if (name == "Zone") { record.zone = command.getIntParam(i); }
+    if (name == "Partition") { record.partition = command.getIntParam(i); }
+
+    std::string param = command.getStringParam(i);
+    if (names < Journal::NUM_NAMES && param.length() &&
+        param.find_first_not_of("0123456789") != std::string::npos)
+    {
+      strncpy(record.name[names++], param.c_str(), Journal::NAME_LENGTH - 1);
+    }
+  }
+}
+
+/**
+  Remember an event in memory for history queries, and in the journal
+  if there is one.
+*/
+void
+It100::recordEvent(const Journal::Record &record)
+{
+  mHistory.add(record);
+  if (mJournal.isOpen())
+  {
+    mJournal.append(record);
+  }
+}
+
+/**
+  A RULE_NOTE event for a rule that fired: about the same zone and
+  partition as the event it matched, with the rule's text as its data
+  and the rule and event names as its names.
+*/
+void
+It100::recordNote(const Journal::Record &event, const std::string &rule,
+                  const std::string &text, bool journal)
+{
+  Journal::Record record;
+  memset(&record, 0, sizeof(record));
+  record.time = mJournal.stamp();
+  record.etag = mState->keypadEtag;
+  record.code = RULE_NOTE;
+  record.panel = mPanel;
+  record.zone = event.zone;
+  record.partition = event.partition;
+
+  size_t length = text.length();
+  if (length > sizeof(record.data)) { length = sizeof(record.data); }
+  memcpy(record.data, text.data(), length);
+  record.length = length;
+  strncpy(record.name[0], rule.c_str(), Journal::NAME_LENGTH - 1);
+  strncpy(record.name[1], Config::getConfig().commandIntToName(event.code),
+          Journal::NAME_LENGTH - 1);
+
+  mHistory.add(record);
+  if (journal && mJournal.isOpen())
+  {
+    mJournal.append(record);
+  }
 }
 
 // TODO -- Really, we should add constructors to the appropriate
@@ -224,16 +777,53 @@ It100::setFdBaud(int baud)
 // for us. This is ugly because it predates the object-orientation
 // of the command handling.
 
+bool
+It100::isOutboundCommand(int code)
+{
+  switch (code)
+  {
+    case POLL:
+    case STATUS_REQUEST:
+    case LABELS_REQUEST:
+    case SET_TIME_AND_DATE:
+    case COMMAND_OUTPUT_CONTROL:
+    case PARTITION_ARM_CONTROL_AWAY:
+    case PARTITION_ARM_CONTROL_STAY:
+    case PARTITION_ARM_CONTROL_ARMED_NO_ENTRY_DELAY:
+    case PARTITION_ARM_CONTROL_WITH_CODE:
+    case PARTITION_DISARM_CONTROL_WITH_CODE:
+    case TIME_STAMP_CONTROL:
+    case TIME_DATE_BROADCAST_CONTROL:
+    case TEMPERATURE_BROADCAST_CONTROL:
+    case VIRTUAL_KEYPAD_CONTROL:
+    case TRIGGER_PANIC_ALARM:
+    case KEY_PRESSED:
+    case BAUD_RATE_CHANGE:
+    case GET_TEMPERATURE_SET_POINT:
+    case TEMPERATURE_CHANGE:
+    case SAVE_TEMPERATURE_SETTING:
+    case CODE_SEND:
+      return true;
+    default:
+      return false;
+  }
+}
+
 void 
 It100::sendCommand(command_t cmd, const char *format, ...)
 {
-  char buffer[40];
+  // Code, data, checksum, CR/LF and the terminator
+  char buffer[3 + MAX_COMMAND_DATA + 5];
   va_list parameters;
   int length;
   unsigned char checksum = 0;
   va_start(parameters, format);
   snprintf(buffer, sizeof(buffer), "%3.3d", cmd);
-  length = vsnprintf(buffer+3, sizeof(buffer)-3, format, parameters) + 3;
+  length = vsnprintf(buffer+3, MAX_COMMAND_DATA + 1, format, parameters);
+  va_end(parameters);
+  if (length < 0) { length = 0; }
+  if (length > MAX_COMMAND_DATA) { length = MAX_COMMAND_DATA; }
+  length += 3;
 
   for (int i = 0; i < length; i++)
   {
@@ -245,25 +835,75 @@ It100::sendCommand(command_t cmd, const char *format, ...)
     Command *c = Command::makeCommand(*this, buffer);
     if (c)
     {
-      std::cout << "<<< " << (*c) << std::endl;
+      char text[Log::TEXT_LENGTH];
+      c->format(text, sizeof(text));
+      Log::getLog().write(Log::CONSOLE, -1, "%s<<< %s",
+                          mLogPrefix.c_str(), text);
       delete c;
     }
     else
     {
-      std::cout << "<<< " << buffer << std::endl;
+      Log::getLog().write(Log::CONSOLE, -1, "%s<<< %s",
+                          mLogPrefix.c_str(), buffer);
     }
   }
   length += snprintf(buffer+length, sizeof(buffer)-length, "\r\n");
 
-  if (!mCommandPending)
+  if (!mAcks.isPending() && mTransport->isOpen())
   {
-    write(mDescriptor, buffer, length);
-    mCommandPending = time(0);
+    mAttempts = 1;
+    transmit(std::string(buffer, length));
   }
   else
   {
     mPendingCommands.push(std::string(buffer));
+    mQueueDepth->set(mPendingCommands.size());
+  }
+}
+
+void
+It100::transmit(const std::string &frame)
+{
+  // Recorded without the trailing CR/LF, like inbound frames
+  mCapture.record(Capture::OUTBOUND, frame.data(), frame.length() - 2);
+  mTransport->write(frame.data(), frame.length());
+  int code = atoi(frame.substr(0, 3).c_str());
+  mAcks.sent(code, Capture::now());
+  mInFlight = frame;
+  countFrame(mFramesOut, "dscd_frames_sent_total",
+             "Frames sent to the panel, by command", code);
+}
+
+/**
+  The panel answers every command with an acknowledgement or an error
+  before it takes the next one, so one it never answers would block
+  the queue for good. Send it again a few times, then give up on it.
+*/
+void
+It100::checkAcknowledgement()
+{
+  if (!mAcks.isPending() ||
+      Capture::now() - mAcks.getSentAt() < mAckTimeout)
+  {
+    return;
   }
+
+  int code = mAcks.getPending();
+  mAcks.timedOut();
+  if (mAttempts <= mAckRetries)
+  {
+    Log::getLog().write(Log::SYSLOG, LOG_WARNING,
+                        "%sNo reply to command %03d, resending",
+                        mLogPrefix.c_str(), code);
+    mAttempts++;
+    transmit(mInFlight);
+    return;
+  }
+
+  Log::getLog().write(Log::SYSLOG, LOG_ERR,
+                      "%sNo reply to command %03d after %d attempts, "
+                      "dropping it", mLogPrefix.c_str(), code, mAttempts);
+  sendPendingCommand();
 }
 
 void
@@ -279,39 +919,75 @@ It100::setTimeAndDate(time_t time)
   State updates that can happen as a result of command execution
 *************************************************************************** */
 
-// TODO -- We need to add timeout handling to queued commands.
-// Otherwise, a failure to acknowledge a command will kill
-// our ability to send any further commands. (I've seen
-// this happen). Also, we should probably trigger this on
-// command error to recover from bad checksum handling.
-
+/**
+  The panel has answered (or given up on) the last command; send the
+  next one. Unanswered commands are timed out by checkAcknowledgement().
+*/
 void
 It100::sendPendingCommand()
 {
-  if (mPendingCommands.size())
+  if (!mAcks.isPending() && mPendingCommands.size() && mTransport->isOpen())
   {
     std::string cmd = mPendingCommands.front();
     mPendingCommands.pop();
-    write(mDescriptor, cmd.c_str(), cmd.length());
-    mCommandPending = time(0);
+    mQueueDepth->set(mPendingCommands.size());
+    mAttempts = 1;
+    transmit(cmd);
   }
-  else
+}
+
+void
+It100::setZoneOpen(int zone, bool open)
+{
+  bool wasOpen = mState->zones.get(ZoneState::OPEN) & ZoneState::bit(zone);
+  mStateFile.beginUpdate();
+  mState->zones.set(ZoneState::OPEN, zone, open);
+  if (open != wasOpen)
   {
-    mCommandPending = 0;
+    mState->zoneStats.changed(zone, open, Journal::now());
   }
+  mStateFile.endUpdate();
 }
 
+/**
+  Alarm, tamper and fault reports. The first two also say which
+  partition the zone is in (partition 0 here when it isn't known).
+*/
 void
-It100::setZoneOpen(int zone, bool open)
+It100::setZoneCondition(ZoneState::condition_t condition, int partition,
+                        int zone, bool on)
+{
+  mStateFile.beginUpdate();
+  mState->zones.set(condition, zone, on);
+  mState->zones.join(partition, zone);
+  mStateFile.endUpdate();
+}
+
+/**
+  Partition status, closing and opening reports; see PartitionState.
+*/
+void
+It100::setPartitionState(int code, int partition, int detail)
+{
+  if (partition < 1 || partition > ZoneState::NUM_PARTITIONS) { return; }
+  mStateFile.beginUpdate();
+  mState->partitions[partition].apply(code, detail, time(0));
+  mStateFile.endUpdate();
+}
+
+void
+It100::setBypassedZones(uint64_t zones)
 {
-  mZoneOpen[zone] = open;
+  mStateFile.beginUpdate();
+  mState->zones.mask[ZoneState::BYPASS] = zones;
+  mStateFile.endUpdate();
 }
 
 void
 It100::sendAccessCode(int partition, int codeLength)
 {
   char code[7] = "000000";
-  std::string cc = Config::getConfig().getAccessCode(partition);
+  std::string cc = Config::getConfig().getAccessCode(partition, mPanel);
   if (cc.length() <= 6)
   {
     memmove(code, cc.c_str(), cc.length());
@@ -325,67 +1001,47 @@ void
 It100::setLcdScreen(int line, int column, std::string str)
 {
   column += (line * 16);
-  if (column + str.length() <= 32)
+  mStateFile.beginUpdate();
+  if (column >= 0 && column + str.length() <= 32)
   {
-    memmove(mLCD + column, str.c_str(), str.length());
+    memmove(mState->lcd + column, str.c_str(), str.length());
   }
-  mKeypadEtag++;
+  mState->keypadEtag++;
+  mStateFile.endUpdate();
 }
 
 void
 It100::setLcdCursor(int type, int line, int column)
 {
-  mCursorType = static_cast<cursor_t>(type);
-  mCursorLine = line;
-  mCursorColumn = column;
-  mKeypadEtag++;
+  mStateFile.beginUpdate();
+  mState->cursorType = type;
+  mState->cursorLine = line;
+  mState->cursorColumn = column;
+  mState->keypadEtag++;
+  mStateFile.endUpdate();
 }
 
 void
 It100::setLedState(int led, int state)
 {
-  mLedState[led] = static_cast<ledState_t>(state);
-  mKeypadEtag++;
+  if (led < 0 || led >= StateFile::NUM_LEDS) { return; }
+  mStateFile.beginUpdate();
+  mState->ledState[led] = state;
+  mState->keypadEtag++;
+  mStateFile.endUpdate();
 }
 
 void
 It100::setLabel(int num, std::string label)
 {
-  if (num <= 151)
+  mStateFile.beginUpdate();
+  if (num >= 0 && num < StateFile::NUM_LABELS)
   {
-    mLabel[num] = label;
+    strncpy(mState->label[num], label.c_str(), StateFile::LABEL_LENGTH - 1);
+    mState->label[num][StateFile::LABEL_LENGTH - 1] = 0;
+    mNames.setLabel(num, mState->label[num]);
   }
 
-  if (num == 151) { mHasLabels = true; }
-}
-
-std::string
-It100::getZoneName(int zone)
-{
-  if (zone > 151) { return ""; }
-  std::string override = Config::getConfig().getZoneName(zone);
-  if (override.length() != 0)
-  {
-    return override;
-  }
-  return mLabel[zone];
-}
-
-std::string
-It100::getPartitionName(int partition)
-{
-  if (partition > 8) { return ""; }
-  std::string override = Config::getConfig().getPartitionName(partition);
-  if (override.length() != 0)
-  {
-    return override;
-  }
-  return mLabel[100 + partition];
-}
-
-std::string
-It100::getUserName(int user)
-{
-  if (user > 42) { return ""; }
-  return Config::getConfig().getUserName(user);
+  if (num == 151) { mState->hasLabels = true; }
+  mStateFile.endUpdate();
 }
@@ -31,11 +31,26 @@
 #ifndef _IT100_H
 #define _IT100_H 1
 
+#include <sys/types.h>
 #include <time.h>
 #include <stdio.h>
 #include <queue>
+#include <map>
 #include <string>
 
+#include "StateFile.h"
+#include "Capture.h"
+#include "NameTable.h"
+#include "Journal.h"
+#include "History.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "AckTracker.h"
+#include "Debounce.h"
+
+class Transport;
+class Command;
+
 class It100
 {
   public:
@@ -90,6 +105,7 @@ class It100
       ZONE_FAULT_RESTORE                          = 606,
       ZONE_OPEN                                   = 609,
       ZONE_RESTORED                               = 610,
+      BYPASSED_ZONES_BITFIELD_DUMP                = 616,
       DURESS_ALARM                                = 620,
       F_KEY_ALARM                                 = 621,
       F_KEY_RESTORAL                              = 622,
@@ -153,18 +169,44 @@ class It100
       TONE_STATUS                                 = 905,
       BUZZER_STATUS                               = 906,
       DOOR_CHIME_STATUS                           = 907,
-      SOFTWARE_VERSION                            = 908
+      SOFTWARE_VERSION                            = 908,
+      // Not from the panel: noted by journal and push rules
+      RULE_NOTE                                   = 999
     } command_t;
 
-    It100();
+    It100(int panel = 1);
+    ~It100();
+
+    int getPanel() const { return mPanel; }
+    const std::string &getPanelName() const { return mPanelName; }
 
-    int getDescriptor() { return mDescriptor; }
+    int getDescriptor();
+    bool isConnected();
+    bool isFinished();
+    // Waiting on a connect, or on the link to take queued output
+    bool wantsWrite();
 
-    void setFdBaud(int baud);
     void processMessage();
+    void processWrite(bool writable);
+    void checkConnection();
+    void configChanged();
+    void reapActions();
+    void reportSuppressed();
+
+    // A long-polling client has just been sent the current status
+    void clientNotified();
+
+    // Round trip times to the panel, by command
+    const AckTracker &getAckTracker() const { return mAcks; }
+    size_t getQueuedCommands() const { return mPendingCommands.size(); }
 
     static const char *commandToName(int command);
 
+    // Whether the panel accepts this code from us, and how much data
+    // sendCommand() will put after it
+    static bool isOutboundCommand(int code);
+    enum { MAX_COMMAND_DATA = 32 };
+
     // Here are the commands we can send
     void poll() {sendCommand(POLL); }
     void statusRequest() { sendCommand(STATUS_REQUEST); }
@@ -215,52 +257,124 @@ class It100
     // Here are the things that can happen due to commands we receive
     void sendPendingCommand();
     void setZoneOpen(int zone, bool open);
+    void setZoneCondition(ZoneState::condition_t condition, int partition,
+                          int zone, bool on);
+    void setBypassedZones(uint64_t zones);
+    void setPartitionState(int code, int partition, int detail = 0);
     void sendAccessCode(int parition, int codeLength);
     void setLcdScreen(int line, int column, std::string);
     void setLcdCursor(int type, int line, int column);
     void setLedState(int led, int state);
     void setLabel(int num, std::string label);
 
-    bool hasLabels() { return mHasLabels; }
+    bool hasLabels() { return mState->hasLabels; }
 
-    std::string getZoneName(int zone);
-    std::string getPartitionName(int partition);
-    std::string getUserName(int zone);
+    const std::string &getZoneName(int zone) const
+      { return mNames.getZoneName(zone); }
+    const std::string &getPartitionName(int partition) const
+      { return mNames.getPartitionName(partition); }
+    const std::string &getUserName(int user) const
+      { return mNames.getUserName(user); }
+    const std::string &getKeyName(int key) const
+      { return mNames.getKeyName(key); }
+    const std::string &getKeypadName(int keypad) const
+      { return mNames.getKeypadName(keypad); }
 
-    ledState_t getLedState(led_t led) const { return mLedState[led]; }
-    const char *getLcd() const { return mLCD; }
-    cursor_t getCursorType() const { return mCursorType; }
-    int getCursorLine() const { return mCursorLine; }
-    int getCursorColumn() const { return mCursorColumn; }
-    unsigned int getKeypadEtag() const { return mKeypadEtag; }
-    uint64_t getZoneStatus() const;
+    ledState_t getLedState(led_t led) const
+      { return static_cast<ledState_t>(mState->ledState[led]); }
+    const char *getLcd() const { return mState->lcd; }
+    cursor_t getCursorType() const
+      { return static_cast<cursor_t>(mState->cursorType); }
+    int getCursorLine() const { return mState->cursorLine; }
+    int getCursorColumn() const { return mState->cursorColumn; }
+    unsigned int getKeypadEtag() const { return mState->keypadEtag; }
+    uint64_t getZoneStatus() const
+      { return mState->zones.get(ZoneState::OPEN); }
+    const ZoneState &getZones() const { return mState->zones; }
+    const ZoneStats &getZoneStats() const { return mState->zoneStats; }
+    // Partitions 1-8
+    const PartitionState &getPartitionState(int partition) const
+      { return mState->partitions[partition]; }
+
+    const History &getHistory() const { return mHistory; }
+    const Journal &getJournal() const { return mJournal; }
 
   protected:
     void sendCommand(command_t cmd, const char *format, ...);
     void sendCommand(command_t cmd) { sendCommand(cmd, ""); }
     void updateState(command_t cmd, const char *parameters);
+    void processLine(const char *line, uint64_t readAt);
+    void transmit(const std::string &frame);
+    void checkAcknowledgement();
+    void connected();
+    void resolvePartitionZones();
+    void actOn(Command &command, const Journal::Record &record,
+               const char *text);
+    void describeEvent(const Command &command, Journal::Record &record);
+    void recordEvent(const Journal::Record &record);
+    void recordNote(const Journal::Record &event, const std::string &rule,
+                    const std::string &text, bool journal);
+    void runRules(const Command &command, const Journal::Record &record,
+                  int priority);
+    void spawnAction(const std::string &action);
+    void countFrame(Metrics::Counter **table, const char *name,
+                    const char *help, int code);
+    std::string getPanelLabel() const;
+    std::string getTransportSpec();
 
   private:
-    char mDevice[FILENAME_MAX];
-    int mDescriptor;
+    int mPanel;
+    std::string mPanelName;
+    std::string mLogPrefix;
+
+    Transport *mTransport;
+    std::string mTransportSpec;
+    Capture mCapture;
+    std::string mCaptureFile;
+    Journal mJournal;
+    History mHistory;
+    time_t mNextReconnect;
+    int mReconnectDelay;
+
+    /* Partial frame read from the transport */
+    char mRxBuffer[128];
+    size_t mRxLength;
 
-    bool mHasLabels;
-    time_t mCommandPending;
+    /* The command awaiting a reply, and those queued behind it */
+    AckTracker mAcks;
+    std::string mInFlight;
+    int mAttempts;
+    uint64_t mAckTimeout;
+    int mAckRetries;
     std::queue<std::string> mPendingCommands;
 
-    /* Labels */
-    std::string mLabel[152];
+    /* Rate limits on logging and acting on events */
+    Debounce mDebounce;
+
+    /* Actions still running, with their start times */
+    std::map<pid_t, uint64_t> mActions;
+
+    /* Looked up on first use, by command code */
+    Metrics::Counter *mFramesIn[1000];
+    Metrics::Counter *mFramesOut[1000];
+    Metrics::Counter *mSuppressed[1000];
+    Metrics::Gauge *mQueueDepth;
+    Metrics::Histogram *mActionSpawn;
+    Metrics::Histogram *mActionTime;
+    Metrics::Counter *mSystemErrors;
+    Metrics::Histogram *mStageTime[Trace::NUM_STAGES];
+
+    /* When the frame behind the current keypad etag was read */
+    uint64_t mEtagReadAt;
+    bool mEtagTraced;
 
-    /* Internal Status */
-    bool mZoneOpen[65];
+    /* Labels, zone and keypad status -- survives restarts if
+       a state file is configured */
+    StateFile mStateFile;
+    StateFile::PanelState *mState;
 
-    /* Keypad Status */
-    unsigned int mKeypadEtag;
-    ledState_t mLedState[10];
-    char mLCD[33];
-    cursor_t mCursorType;
-    int mCursorLine;
-    int mCursorColumn;
+    /* Configured names merged with the labels above */
+    NameTable mNames;
 
     /* Noises -- these may need some refactoring, as they are all one-shot */
     int mBeepDuration;
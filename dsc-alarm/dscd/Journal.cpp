@@ -0,0 +1,433 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "Journal.h"
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+Journal::Journal() : mPanel(0), mSegmentRecords(DEFAULT_SEGMENT_RECORDS),
+                     mHeader(0), mRecords(0), mMapSize(0), mLastTime(0)
+{
+}
+
+Journal::~Journal()
+{
+  close();
+}
+
+uint64_t
+Journal::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t
+Journal::stamp()
+{
+  uint64_t time = now();
+  if (time <= mLastTime) { time = mLastTime + 1; }
+  mLastTime = time;
+  return time;
+}
+
+std::string
+Journal::segmentName(const std::string &directory, int panel,
+                     uint64_t sequence)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "/panel%d-%08llu.jrn", panel,
+           (unsigned long long)sequence);
+  return directory + name;
+}
+
+/**
+  The panel's segment files, oldest first. Sequence numbers are zero
+  padded, so name order is sequence order.
+*/
+std::vector<std::string>
+Journal::listSegments(const std::string &directory, int panel)
+{
+  std::vector<std::string> segments;
+  DIR *dir = opendir(directory.c_str());
+  if (!dir) { return segments; }
+
+  char prefix[24];
+  int prefixLength = snprintf(prefix, sizeof(prefix), "panel%d-", panel);
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != 0)
+  {
+    const char *name = entry->d_name;
+    size_t length = strlen(name);
+    if (strncmp(name, prefix, prefixLength) == 0 &&
+        length == (size_t)prefixLength + 12 &&
+        strcmp(name + length - 4, ".jrn") == 0)
+    {
+      segments.push_back(directory + "/" + name);
+    }
+  }
+  closedir(dir);
+
+  std::sort(segments.begin(), segments.end());
+  return segments;
+}
+
+/**
+  Records in a mapped segment, never more than it has room for: the
+  count is only checked against the capacity when the segment is mapped.
+*/
+static uint32_t
+recordCount(const Journal::Header *header)
+{
+  uint32_t count = header->count;
+  return count < header->capacity ? count : header->capacity;
+}
+
+/**
+  Map a segment and check that it's one of ours. Returns 0 for
+  anything that isn't a complete, current-format segment.
+*/
+const Journal::Header *
+Journal::mapSegment(const std::string &filename, size_t &size,
+                    bool writable)
+{
+  int descriptor = ::open(filename.c_str(), writable ? O_RDWR : O_RDONLY);
+  if (descriptor < 0) { return 0; }
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(descriptor, &st) == 0 && st.st_size >= HEADER_SIZE)
+  {
+    size = st.st_size;
+    map = mmap(0, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+               MAP_SHARED, descriptor, 0);
+  }
+  ::close(descriptor);
+  if (map == MAP_FAILED) { return 0; }
+
+  const Header *header = static_cast<const Header *>(map);
+  if (header->magic != MAGIC ||
+      header->version != VERSION ||
+      header->recordSize != sizeof(Record) ||
+      header->capacity > MAX_SEGMENT_RECORDS ||
+      header->count > header->capacity ||
+      HEADER_SIZE + (size_t)header->capacity * sizeof(Record) > size)
+  {
+    munmap(map, size);
+    return 0;
+  }
+  return header;
+}
+
+bool
+Journal::open(const std::string &directory, int panel,
+              uint32_t segmentRecords)
+{
+  close();
+  if (!directory.length()) { return false; }
+
+  mDirectory = directory;
+  mPanel = panel;
+  mSegmentRecords = std::min<uint32_t>(segmentRecords, MAX_SEGMENT_RECORDS);
+
+  if (mkdir(directory.c_str(), 0755) < 0 && errno != EEXIST)
+  {
+    syslog(LOG_ERR, "Could not create journal directory %s",
+           directory.c_str());
+    mDirectory.clear();
+    return false;
+  }
+
+  // Carry on in the newest segment if it has room
+  std::vector<std::string> segments = listSegments(directory, panel);
+  uint64_t sequence = 0;
+  if (segments.size())
+  {
+    const std::string &newest = segments.back();
+    sscanf(newest.c_str() + newest.rfind('-') + 1, "%llu",
+           (unsigned long long *)&sequence);
+
+    const Header *header = mapSegment(newest, mMapSize, true);
+    if (header && header->count && header->lastTime > mLastTime)
+    {
+      mLastTime = header->lastTime;
+    }
+    if (header && header->count < header->capacity)
+    {
+      mHeader = const_cast<Header *>(header);
+      mRecords = reinterpret_cast<Record *>((char *)mHeader + HEADER_SIZE);
+      return true;
+    }
+    if (header) { munmap((void *)header, mMapSize); }
+    sequence++;
+  }
+
+  return startSegment(sequence);
+}
+
+void
+Journal::close()
+{
+  if (mHeader)
+  {
+    munmap(mHeader, mMapSize);
+    mHeader = 0;
+    mRecords = 0;
+  }
+  mDirectory.clear();
+}
+
+/**
+  Create and map a new, preallocated segment. The magic number goes in
+  last, so a half-initialized segment is never taken for a valid one.
+*/
+bool
+Journal::startSegment(uint64_t sequence)
+{
+  std::string filename = segmentName(mDirectory, mPanel, sequence);
+  size_t size = HEADER_SIZE + (size_t)mSegmentRecords * sizeof(Record);
+
+  int descriptor = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (descriptor < 0 || ftruncate(descriptor, size) < 0)
+  {
+    if (descriptor >= 0) { ::close(descriptor); }
+    syslog(LOG_ERR, "Could not create journal segment %s",
+           filename.c_str());
+    return false;
+  }
+
+  void *map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   descriptor, 0);
+  ::close(descriptor);
+  if (map == MAP_FAILED)
+  {
+    syslog(LOG_ERR, "Could not map journal segment %s", filename.c_str());
+    return false;
+  }
+
+  mHeader = static_cast<Header *>(map);
+  mRecords = reinterpret_cast<Record *>((char *)map + HEADER_SIZE);
+  mMapSize = size;
+
+  memset(mHeader, 0, HEADER_SIZE);
+  mHeader->version = VERSION;
+  mHeader->recordSize = sizeof(Record);
+  mHeader->capacity = mSegmentRecords;
+  mHeader->panel = mPanel;
+  mHeader->sequence = sequence;
+  __sync_synchronize();
+  mHeader->magic = MAGIC;
+  return true;
+}
+
+bool
+Journal::append(const Record &record)
+{
+  if (!mHeader) { return false; }
+
+  if (mHeader->count >= mHeader->capacity)
+  {
+    uint64_t sequence = mHeader->sequence + 1;
+    munmap(mHeader, mMapSize);
+    mHeader = 0;
+    mRecords = 0;
+    if (!startSegment(sequence))
+    {
+      mDirectory.clear();
+      return false;
+    }
+  }
+
+  uint32_t count = mHeader->count;
+  mRecords[count] = record;
+
+  // Records are stamped by stamp(); this only keeps the index sorted
+  // should one come from anywhere else
+  if (count && mRecords[count].time < mHeader->lastTime)
+  {
+    mRecords[count].time = mHeader->lastTime;
+  }
+  if (count == 0) { mHeader->firstTime = mRecords[count].time; }
+  if (count % INDEX_STRIDE == 0)
+  {
+    mHeader->index[count / INDEX_STRIDE] = mRecords[count].time;
+  }
+  mHeader->lastTime = mRecords[count].time;
+
+  // Readers trust everything below count
+  __sync_synchronize();
+  mHeader->count = count + 1;
+  return true;
+}
+
+/** *******************************************************************
+ * Journal::Reader
+ *********************************************************************/
+
+Journal::Reader::Reader(const std::string &directory, int panel)
+  : mSegment(0), mPosition(0), mHeader(0), mMapSize(0)
+{
+  mSegments = listSegments(directory, panel);
+}
+
+Journal::Reader::~Reader()
+{
+  unmap();
+}
+
+bool
+Journal::Reader::map(size_t segment)
+{
+  unmap();
+  if (segment >= mSegments.size()) { return false; }
+  mHeader = mapSegment(mSegments[segment], mMapSize, false);
+  return mHeader != 0;
+}
+
+void
+Journal::Reader::unmap()
+{
+  if (mHeader)
+  {
+    munmap((void *)mHeader, mMapSize);
+    mHeader = 0;
+  }
+}
+
+void
+Journal::Reader::seek(uint64_t time)
+{
+  mPosition = 0;
+  for (mSegment = 0; mSegment < mSegments.size(); mSegment++)
+  {
+    if (!map(mSegment)) { continue; }
+
+    uint32_t count = recordCount(mHeader);
+    __sync_synchronize();
+    if (count == 0 || mHeader->lastTime < time) { continue; }
+
+    // Last indexed record before the time we want...
+    const Record *records = reinterpret_cast<const Record *>(
+      (const char *)mHeader + HEADER_SIZE);
+    uint32_t low = 0;
+    uint32_t high = (count - 1) / INDEX_STRIDE;
+    while (low < high)
+    {
+      uint32_t middle = (low + high + 1) / 2;
+      if (mHeader->index[middle] < time) { low = middle; }
+      else { high = middle - 1; }
+    }
+
+    // ...then walk forward to the first one at or after it
+    mPosition = low * INDEX_STRIDE;
+    while (mPosition < count && records[mPosition].time < time)
+    {
+      mPosition++;
+    }
+    return;
+  }
+
+  // Nothing that late yet; wait at the end for new records
+  if (mSegments.size())
+  {
+    mSegment = mSegments.size() - 1;
+    if (map(mSegment))
+    {
+      mPosition = recordCount(mHeader);
+    }
+  }
+}
+
+void
+Journal::Reader::seekSegment(size_t segment)
+{
+  unmap();
+  mSegment = segment;
+  mPosition = 0;
+}
+
+/**
+  The next record, or false at the end of the journal. A reader at the
+  end picks up records (and segments) appended since.
+*/
+bool
+Journal::Reader::next(Record &record)
+{
+  while (1)
+  {
+    if (!mHeader)
+    {
+      if (mSegment >= mSegments.size()) { return false; }
+      if (!map(mSegment))
+      {
+        mSegment++;
+        mPosition = 0;
+        continue;
+      }
+    }
+
+    uint32_t count = recordCount(mHeader);
+    __sync_synchronize();
+    if (mPosition < count)
+    {
+      const Record *records = reinterpret_cast<const Record *>(
+        (const char *)mHeader + HEADER_SIZE);
+      record = records[mPosition++];
+      return true;
+    }
+
+    // Done with a full segment; the writer has moved on
+    if (count < mHeader->capacity) { return false; }
+    if (mSegment + 1 >= mSegments.size())
+    {
+      std::string directory = mSegments[mSegment].substr(
+        0, mSegments[mSegment].rfind('/'));
+      std::vector<std::string> segments =
+        listSegments(directory, mHeader->panel);
+      if (segments.size() <= mSegments.size()) { return false; }
+      mSegments = segments;
+    }
+    unmap();
+    mSegment++;
+    mPosition = 0;
+  }
+}
@@ -0,0 +1,166 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H 1
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+  Append-only record of every event decoded from a panel.
+
+  The journal is a directory of segment files, one series per panel
+  (panel1-00000000.jrn, panel1-00000001.jrn, ...). Each segment is
+  preallocated to hold a fixed number of fixed-size records behind a
+  header, and is written through a shared mapping, so readers can map
+  it while the daemon is appending. A record becomes visible when the
+  header's count moves past it.
+
+  The header also keeps the time of every INDEX_STRIDEth record. A time
+  range query picks segments by their first and last times, binary
+  searches the sparse index, and scans at most one stride of records to
+  find its starting point.
+*/
+
+class Journal
+{
+  public:
+    enum { MAGIC = 0x4a435344, VERSION = 2 };   // "DSCJ"
+    enum { HEADER_SIZE = 4096, INDEX_STRIDE = 256 };
+    enum { INDEX_SIZE = (HEADER_SIZE - 48) / 8 };
+    enum { DEFAULT_SEGMENT_RECORDS = 65536,
+           MAX_SEGMENT_RECORDS = INDEX_SIZE * INDEX_STRIDE };
+    enum { DATA_LENGTH = 36, NAME_LENGTH = 36, NUM_NAMES = 2 };
+    // Held back by [debounce]: recorded, but not logged or acted on
+    enum { SUPPRESSED = 1 };
+
+    // 128 bytes; the layout is the file format
+    struct Record
+    {
+      uint64_t time;                // ns since the epoch
+      uint32_t etag;                // keypad etag after the event
+      uint16_t code;                // IT-100 command code
+      uint8_t  panel;
+      uint8_t  length;              // of data
+      uint8_t  zone;                // 0 if the event isn't about one
+      uint8_t  partition;           // 0 if the event isn't about one
+      uint8_t  flags;               // SUPPRESSED
+      uint8_t  pad;
+      char     data[DATA_LENGTH];   // raw parameters, after the code
+      char     name[NUM_NAMES][NAME_LENGTH];  // resolved text parameters
+    };
+
+    struct Header
+    {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t recordSize;
+      uint32_t capacity;
+      volatile uint32_t count;
+      uint32_t panel;
+      uint64_t sequence;
+      uint64_t firstTime;
+      volatile uint64_t lastTime;
+      uint64_t index[INDEX_SIZE];
+    };
+
+    Journal();
+    ~Journal();
+
+    // Start writing into the newest segment for this panel, or a new
+    // one. An empty directory name leaves the journal disabled.
+    bool open(const std::string &directory, int panel,
+              uint32_t segmentRecords = DEFAULT_SEGMENT_RECORDS);
+    void close();
+    bool isOpen() const { return mHeader != 0; }
+    const std::string &getDirectory() const { return mDirectory; }
+    int getPanel() const { return mPanel; }
+
+    bool append(const Record &record);
+
+    static uint64_t now();
+
+    // now(), but never at or before the last stamp handed out or the
+    // newest record in the journal: the index and the history cursors
+    // rely on times going forward, whatever the wall clock does
+    uint64_t stamp();
+
+    /**
+      Read-only view of a panel's journal, positioned by time.
+    */
+    class Reader
+    {
+      public:
+        Reader(const std::string &directory, int panel);
+        ~Reader();
+
+        // Position at the first record at or after time
+        void seek(uint64_t time);
+        bool next(Record &record);
+
+        // For walking the journal backwards, a segment at a time
+        size_t getSegmentCount() const { return mSegments.size(); }
+        size_t getSegment() const { return mSegment; }
+        void seekSegment(size_t segment);
+
+      private:
+        bool map(size_t segment);
+        void unmap();
+
+      private:
+        std::vector<std::string> mSegments;
+        size_t mSegment;
+        uint32_t mPosition;
+        const Header *mHeader;
+        size_t mMapSize;
+    };
+
+  private:
+    static std::vector<std::string> listSegments(
+      const std::string &directory, int panel);
+    static std::string segmentName(const std::string &directory,
+                                   int panel, uint64_t sequence);
+    static const Header *mapSegment(const std::string &filename,
+                                    size_t &size, bool writable);
+    bool startSegment(uint64_t sequence);
+
+  private:
+    std::string mDirectory;
+    int mPanel;
+    uint32_t mSegmentRecords;
+    Header *mHeader;
+    Record *mRecords;
+    size_t mMapSize;
+    uint64_t mLastTime;
+};
+
+#endif
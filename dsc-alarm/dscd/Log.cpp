@@ -0,0 +1,251 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+Log &
+Log::getLog()
+{
+  static Log theLog;
+  return theLog;
+}
+
+Log::Log() : mHead(0), mTail(0), mDropped(0), mReported(0), mNextReport(0),
+             mSleeping(0), mStopping(0), mRunning(false), mConsole(stdout)
+{
+  mWakeup[0] = mWakeup[1] = -1;
+}
+
+Log::~Log()
+{
+  stop();
+}
+
+/**
+  Start the writer thread. Console output goes to the named file if
+  there is one, stdout otherwise.
+*/
+bool
+Log::start(const std::string &filename)
+{
+  if (mRunning) { return true; }
+
+  if (filename.length())
+  {
+    FILE *file = fopen(filename.c_str(), "a");
+    if (!file)
+    {
+      perror(filename.c_str());
+      syslog(LOG_ERR, "Could not open log file %s", filename.c_str());
+    }
+    else
+    {
+      mConsole = file;
+    }
+  }
+
+  if (pipe(mWakeup) < 0)
+  {
+    perror("pipe");
+    return false;
+  }
+  fcntl(mWakeup[0], F_SETFL, O_NONBLOCK);
+  fcntl(mWakeup[1], F_SETFL, O_NONBLOCK);
+
+  // Signals are for the event loop; keep them out of the writer
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  mStopping = 0;
+  mRunning = (pthread_create(&mThread, 0, run, this) == 0);
+  pthread_sigmask(SIG_SETMASK, &old, 0);
+
+  if (!mRunning)
+  {
+    close(mWakeup[0]);
+    close(mWakeup[1]);
+    mWakeup[0] = mWakeup[1] = -1;
+  }
+  return mRunning;
+}
+
+/**
+  Drain whatever is still queued and stop the writer thread.
+*/
+void
+Log::stop()
+{
+  if (!mRunning) { return; }
+
+  mStopping = 1;
+  __sync_synchronize();
+  char c = 0;
+  ::write(mWakeup[1], &c, 1);
+  pthread_join(mThread, 0);
+  mRunning = false;
+
+  close(mWakeup[0]);
+  close(mWakeup[1]);
+  mWakeup[0] = mWakeup[1] = -1;
+  fflush(mConsole);
+}
+
+void
+Log::write(int sinks, int priority, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+
+  if (!mRunning)
+  {
+    Record record;
+    record.sinks = sinks;
+    record.priority = priority;
+    vsnprintf(record.text, sizeof(record.text), format, args);
+    va_end(args);
+    emit(record);
+    fflush(mConsole);
+    return;
+  }
+
+  unsigned int head = mHead;
+  if (head - mTail >= RING_SIZE)
+  {
+    mDropped++;
+    va_end(args);
+    return;
+  }
+
+  Record &record = mRing[head % RING_SIZE];
+  record.sinks = sinks;
+  record.priority = priority;
+  vsnprintf(record.text, sizeof(record.text), format, args);
+  va_end(args);
+
+  // Publish the record, then check whether the writer needs a nudge.
+  // The writer sets mSleeping before its last look at mHead, so one
+  // side or the other always sees the new record.
+  __sync_synchronize();
+  mHead = head + 1;
+  __sync_synchronize();
+  if (mSleeping)
+  {
+    char c = 0;
+    ::write(mWakeup[1], &c, 1);
+  }
+}
+
+void *
+Log::run(void *self)
+{
+  static_cast<Log *>(self)->drain();
+  return 0;
+}
+
+void
+Log::drain()
+{
+  while (1)
+  {
+    while (mTail != mHead)
+    {
+      __sync_synchronize();
+      emit(mRing[mTail % RING_SIZE]);
+      __sync_synchronize();
+      mTail = mTail + 1;
+    }
+    fflush(mConsole);
+    reportDropped();
+
+    if (mStopping) { break; }
+
+    mSleeping = 1;
+    __sync_synchronize();
+    if (mTail == mHead && !mStopping)
+    {
+      struct pollfd pfd;
+      pfd.fd = mWakeup[0];
+      pfd.events = POLLIN;
+      poll(&pfd, 1, 1000);
+
+      char buffer[64];
+      while (read(mWakeup[0], buffer, sizeof(buffer)) > 0) {;}
+    }
+    mSleeping = 0;
+  }
+}
+
+void
+Log::emit(const Record &record)
+{
+  if (record.sinks & CONSOLE)
+  {
+    fputs(record.text, mConsole);
+    fputc('\n', mConsole);
+  }
+  if ((record.sinks & SYSLOG) && record.priority >= 0)
+  {
+    syslog(record.priority, "%s", record.text);
+  }
+}
+
+/**
+  Tell someone about dropped messages, but no more than once every
+  ten seconds -- an overflow is usually a burst.
+*/
+void
+Log::reportDropped()
+{
+  unsigned long dropped = mDropped;
+  if (dropped == mReported) { return; }
+
+  time_t now = time(0);
+  if (now < mNextReport) { return; }
+
+  Record record;
+  record.sinks = CONSOLE | SYSLOG;
+  record.priority = LOG_WARNING;
+  snprintf(record.text, sizeof(record.text),
+           "Log buffer full; %lu messages dropped", dropped - mReported);
+  emit(record);
+  fflush(mConsole);
+
+  mReported = dropped;
+  mNextReport = now + 10;
+}
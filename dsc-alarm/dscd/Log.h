@@ -0,0 +1,105 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _LOG_H
+#define _LOG_H 1
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string>
+#include <time.h>
+
+/**
+  Console and syslog output for the daemon, kept off the event loop.
+
+  write() formats the message straight into a slot of a fixed ring and
+  returns; a background thread drains the ring to stdout (or the
+  configured log file) and syslog. A slow console or a stalled syslog
+  daemon only holds up that thread. If the ring is full the message is
+  dropped and counted, and the writer reports the count now and then.
+
+  The ring has a single producer: only the main thread may call
+  write(). Before start() (and after stop()) messages are written
+  synchronously.
+*/
+
+class Log
+{
+  public:
+    // Where a message should go; combine with |
+    enum { CONSOLE = 1, SYSLOG = 2 };
+
+    enum { RING_SIZE = 1024, TEXT_LENGTH = 240 };
+
+    static Log &getLog();
+
+    bool start(const std::string &filename);
+    void stop();
+
+    void write(int sinks, int priority, const char *format, ...)
+      __attribute__((format(printf, 4, 5)));
+
+    unsigned long getDropped() const { return mDropped; }
+
+  private:
+    struct Record
+    {
+      int sinks;
+      int priority;
+      char text[TEXT_LENGTH];
+    };
+
+    Log();
+    ~Log();
+
+    static void *run(void *self);
+    void drain();
+    void emit(const Record &record);
+    void reportDropped();
+
+  private:
+    Record mRing[RING_SIZE];
+    volatile unsigned int mHead;    // next slot to fill; producer only
+    volatile unsigned int mTail;    // next slot to drain; writer only
+    volatile unsigned long mDropped;
+    unsigned long mReported;
+    time_t mNextReport;
+
+    // The writer sleeps on this pipe when the ring is empty
+    int mWakeup[2];
+    volatile int mSleeping;
+    volatile int mStopping;
+
+    pthread_t mThread;
+    bool mRunning;
+    FILE *mConsole;
+};
+
+#endif
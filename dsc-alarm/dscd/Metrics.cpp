@@ -0,0 +1,338 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "Metrics.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+Metrics::Histogram::Histogram() : mCount(0), mSum(0)
+{
+  memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+void
+Metrics::Histogram::observe(uint64_t ns)
+{
+  // Bucket b holds durations up to 2^b microseconds
+  uint64_t us = (ns + 999) / 1000;
+  int bucket = 0;
+  while (bucket < NUM_BUCKETS && (1ULL << bucket) < us) { bucket++; }
+  mBuckets[bucket]++;
+  mCount++;
+  mSum += ns;
+}
+
+double
+Metrics::Histogram::getBound(int bucket)
+{
+  return (double)(1ULL << bucket) / 1e6;
+}
+
+Metrics &
+Metrics::getMetrics()
+{
+  static Metrics theMetrics;
+  return theMetrics;
+}
+
+Metrics::Metrics() : mListener(-1)
+{
+}
+
+void *
+Metrics::find(const char *name, const char *help, type_t type,
+              const std::string &labels)
+{
+  std::map<std::string, Family>::iterator f = mFamilies.find(name);
+  if (f == mFamilies.end())
+  {
+    Family family;
+    family.type = type;
+    family.help = help;
+    f = mFamilies.insert(std::make_pair(std::string(name), family)).first;
+  }
+
+  std::map<std::string, void *>::iterator m = f->second.metrics.find(labels);
+  if (m != f->second.metrics.end()) { return m->second; }
+
+  void *metric;
+  switch (type)
+  {
+    case COUNTER:   metric = new Counter(); break;
+    case GAUGE:     metric = new Gauge(); break;
+    default:        metric = new Histogram(); break;
+  }
+  f->second.metrics[labels] = metric;
+  return metric;
+}
+
+Metrics::Counter &
+Metrics::counter(const char *name, const char *help,
+                 const std::string &labels)
+{
+  return *static_cast<Counter *>(find(name, help, COUNTER, labels));
+}
+
+Metrics::Gauge &
+Metrics::gauge(const char *name, const char *help, const std::string &labels)
+{
+  return *static_cast<Gauge *>(find(name, help, GAUGE, labels));
+}
+
+Metrics::Histogram &
+Metrics::histogram(const char *name, const char *help,
+                   const std::string &labels)
+{
+  return *static_cast<Histogram *>(find(name, help, HISTOGRAM, labels));
+}
+
+/**
+  Everything in the Prometheus text exposition format, version 0.0.4
+*/
+std::string
+Metrics::format() const
+{
+  static const char *typeNames[] = { "counter", "gauge", "histogram" };
+  std::string out;
+  char line[256];
+
+  std::map<std::string, Family>::const_iterator f;
+  for (f = mFamilies.begin(); f != mFamilies.end(); f++)
+  {
+    const char *name = f->first.c_str();
+    out += "# HELP " + f->first + " " + f->second.help + "\n";
+    out += "# TYPE " + f->first + " " + typeNames[f->second.type] + "\n";
+
+    std::map<std::string, void *>::const_iterator m;
+    for (m = f->second.metrics.begin(); m != f->second.metrics.end(); m++)
+    {
+      const std::string &labels = m->first;
+      std::string braced = labels.length() ? "{" + labels + "}" : "";
+
+      if (f->second.type == COUNTER)
+      {
+        snprintf(line, sizeof(line), "%s%s %llu\n", name, braced.c_str(),
+          (unsigned long long)static_cast<Counter *>(m->second)->get());
+        out += line;
+      }
+      else if (f->second.type == GAUGE)
+      {
+        snprintf(line, sizeof(line), "%s%s %lld\n", name, braced.c_str(),
+          (long long)static_cast<Gauge *>(m->second)->get());
+        out += line;
+      }
+      else
+      {
+        const Histogram *h = static_cast<Histogram *>(m->second);
+        const char *comma = labels.length() ? "," : "";
+        uint64_t cumulative = 0;
+        for (int b = 0; b < Histogram::NUM_BUCKETS; b++)
+        {
+          cumulative += h->getBucket(b);
+          snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"%g\"} %llu\n",
+                   name, labels.c_str(), comma, Histogram::getBound(b),
+                   (unsigned long long)cumulative);
+          out += line;
+        }
+        snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"+Inf\"} %llu\n"
+                 "%s_sum%s %.9f\n%s_count%s %llu\n",
+                 name, labels.c_str(), comma,
+                 (unsigned long long)h->getCount(),
+                 name, braced.c_str(), h->getSum() / 1e9,
+                 name, braced.c_str(), (unsigned long long)h->getCount());
+        out += line;
+      }
+    }
+  }
+  return out;
+}
+
+bool
+Metrics::listen(unsigned short port)
+{
+  mListener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (mListener < 0) { perror("socket()"); return false; }
+
+  int one = 1;
+  setsockopt(mListener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+  if (bind(mListener, (struct sockaddr *)&addr, sizeof(addr)) ||
+      ::listen(mListener, 4))
+  {
+    perror("metrics bind()");
+    syslog(LOG_ERR, "Could not listen for metrics on port %d", port);
+    close(mListener);
+    mListener = -1;
+    return false;
+  }
+  return true;
+}
+
+int
+Metrics::setDescriptors(fd_set *readSet, fd_set *writeSet, int maxFd) const
+{
+  if (mListener < 0) { return maxFd; }
+
+  FD_SET(mListener, readSet);
+  if (mListener > maxFd) { maxFd = mListener; }
+  for (size_t i = 0; i < mClients.size(); i++)
+  {
+    const Client &client = mClients[i];
+    FD_SET(client.descriptor,
+           client.reply.length() ? writeSet : readSet);
+    if (client.descriptor > maxFd) { maxFd = client.descriptor; }
+  }
+  return maxFd;
+}
+
+/**
+  Take new scrapers, read requests and write replies as far as each
+  socket allows, and drop those that are done or have run out of time.
+*/
+void
+Metrics::serve(fd_set *readSet, fd_set *writeSet)
+{
+  if (mListener < 0) { return; }
+
+  time_t now = time(0);
+  std::vector<Client>::iterator c = mClients.begin();
+  while (c != mClients.end())
+  {
+    bool open = now < c->deadline;
+    if (open && c->reply.empty() && FD_ISSET(c->descriptor, readSet))
+    {
+      open = receive(*c);
+    }
+    else if (open && c->reply.length() && FD_ISSET(c->descriptor, writeSet))
+    {
+      open = send(*c);
+    }
+
+    if (open)
+    {
+      c++;
+      continue;
+    }
+    close(c->descriptor);
+    c = mClients.erase(c);
+  }
+
+  if (FD_ISSET(mListener, readSet)) { accept(); }
+}
+
+void
+Metrics::accept()
+{
+  int descriptor = ::accept(mListener, 0, 0);
+  if (descriptor < 0) { return; }
+  if (mClients.size() >= MAX_CLIENTS)
+  {
+    close(descriptor);
+    return;
+  }
+  fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL) | O_NONBLOCK);
+
+  Client client;
+  client.descriptor = descriptor;
+  client.deadline = time(0) + CLIENT_TIMEOUT;
+  client.written = 0;
+  mClients.push_back(client);
+}
+
+/**
+  Read what there is of the request. Whatever it was, the reply is the
+  full set of metrics, as of when the headers finished arriving. False
+  once the client has gone.
+*/
+bool
+Metrics::receive(Client &client)
+{
+  char buffer[1024];
+  int s = read(client.descriptor, buffer, sizeof(buffer));
+  if (s < 0)
+  {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+  if (s == 0) { return false; }
+
+  client.request.append(buffer, s);
+  if (client.request.find("\r\n\r\n") == std::string::npos &&
+      client.request.find("\n\n") == std::string::npos &&
+      client.request.length() < MAX_REQUEST)
+  {
+    return true;
+  }
+
+  std::string body = format();
+  char header[160];
+  int length = snprintf(header, sizeof(header),
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: %lu\r\n\r\n",
+                        (unsigned long)body.length());
+  client.reply = std::string(header, length) + body;
+  client.request.clear();
+  return send(client);
+}
+
+/**
+  Write as much of the reply as the socket takes. False once it's all
+  gone, or the client has.
+*/
+bool
+Metrics::send(Client &client)
+{
+  while (client.written < client.reply.length())
+  {
+    int s = write(client.descriptor, client.reply.data() + client.written,
+                  client.reply.length() - client.written);
+    if (s < 0)
+    {
+      if (errno == EINTR) { continue; }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    client.written += s;
+  }
+  return false;
+}
@@ -0,0 +1,153 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _METRICS_H
+#define _METRICS_H 1
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <sys/select.h>
+#include <time.h>
+
+/**
+  Counters, gauges and histograms describing the daemon's internals,
+  exported in the Prometheus text format.
+
+  Metrics are registered by name and label set, and the registry hands
+  back a reference that stays valid for the life of the process; hot
+  paths look a metric up once and keep the reference. Updates are plain
+  arithmetic: everything that counts runs on the event loop thread, so
+  nothing needs to be atomic.
+
+  When metrics_port is set, the event loop also serves the current
+  values over HTTP on 127.0.0.1 at that port. Scrapers are served
+  without blocking, like keypad clients: each has its own request and
+  reply buffer, and one that takes longer than CLIENT_TIMEOUT seconds
+  is dropped.
+*/
+
+class Metrics
+{
+  public:
+    class Counter
+    {
+      public:
+        Counter() : mValue(0) {;}
+        void increment(uint64_t n = 1) { mValue += n; }
+        uint64_t get() const { return mValue; }
+      private:
+        uint64_t mValue;
+    };
+
+    class Gauge
+    {
+      public:
+        Gauge() : mValue(0) {;}
+        void set(int64_t value) { mValue = value; }
+        void add(int64_t n) { mValue += n; }
+        int64_t get() const { return mValue; }
+      private:
+        int64_t mValue;
+    };
+
+    // Durations in ns, bucketed by powers of two from 1us to ~34s
+    class Histogram
+    {
+      public:
+        enum { NUM_BUCKETS = 26 };
+        Histogram();
+        void observe(uint64_t ns);
+        uint64_t getCount() const { return mCount; }
+        uint64_t getBucket(int bucket) const { return mBuckets[bucket]; }
+        uint64_t getSum() const { return mSum; }
+        static double getBound(int bucket);  // seconds
+      private:
+        uint64_t mBuckets[NUM_BUCKETS + 1];  // last one is +Inf
+        uint64_t mCount;
+        uint64_t mSum;
+    };
+
+    static Metrics &getMetrics();
+
+    // labels is Prometheus syntax without the braces: panel="1",code="609"
+    Counter &counter(const char *name, const char *help,
+                     const std::string &labels = "");
+    Gauge &gauge(const char *name, const char *help,
+                 const std::string &labels = "");
+    Histogram &histogram(const char *name, const char *help,
+                         const std::string &labels = "");
+
+    std::string format() const;
+
+    // HTTP exposition. setDescriptors() adds the listener and every
+    // scraper to the event loop's sets and returns the new highest
+    // descriptor; serve() then deals with whichever are ready.
+    bool listen(unsigned short port);
+    int getDescriptor() const { return mListener; }
+    int setDescriptors(fd_set *readSet, fd_set *writeSet, int maxFd) const;
+    void serve(fd_set *readSet, fd_set *writeSet);
+
+  private:
+    enum type_t { COUNTER, GAUGE, HISTOGRAM };
+
+    enum { MAX_CLIENTS = 8, MAX_REQUEST = 4096, CLIENT_TIMEOUT = 5 };
+
+    struct Client
+    {
+      int descriptor;
+      time_t deadline;
+      std::string request;
+      std::string reply;        // empty until the request is complete
+      size_t written;
+    };
+
+    struct Family
+    {
+      type_t type;
+      std::string help;
+      std::map<std::string, void *> metrics;   // by label set
+    };
+
+    Metrics();
+    void *find(const char *name, const char *help, type_t type,
+               const std::string &labels);
+    void accept();
+    bool receive(Client &client);
+    bool send(Client &client);
+
+  private:
+    std::map<std::string, Family> mFamilies;
+    int mListener;
+    std::vector<Client> mClients;
+};
+
+#endif
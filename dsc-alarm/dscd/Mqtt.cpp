@@ -0,0 +1,712 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "Mqtt.h"
+#include "Config.h"
+#include "It100.h"
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// Control packet types, already shifted into the high nibble
+enum
+{
+  CONNECT = 0x10, CONNACK = 0x20, PUBLISH = 0x30, PUBACK = 0x40,
+  PINGREQ = 0xc0, PINGRESP = 0xd0, DISCONNECT = 0xe0
+};
+
+// PUBLISH flags
+enum { DUP = 0x08, RETAIN = 0x01 };
+
+static const char PING[] = { (char)PINGREQ, 0 };
+
+static void
+appendString(std::string &packet, const std::string &s)
+{
+  packet += (char)(s.length() >> 8);
+  packet += (char)(s.length() & 0xff);
+  packet += s;
+}
+
+static std::string
+makePacket(int header, const std::string &body)
+{
+  std::string packet(1, (char)header);
+  size_t length = body.length();
+  do
+  {
+    char digit = length % 128;
+    length /= 128;
+    if (length) { digit |= 0x80; }
+    packet += digit;
+  } while (length);
+  return packet + body;
+}
+
+// Double-quoted, with JSON's escapes
+static void
+appendJson(std::string &out, const char *text, size_t length)
+{
+  out += '"';
+  for (size_t i = 0; i < length && text[i]; i++)
+  {
+    unsigned char c = text[i];
+    if (c == '"' || c == '\\') { out += '\\'; out += c; }
+    else if (c < 0x20)
+    {
+      char escape[8];
+      snprintf(escape, sizeof(escape), "\\u%04x", c);
+      out += escape;
+    }
+    else { out += c; }
+  }
+  out += '"';
+}
+
+Mqtt &
+Mqtt::getMqtt()
+{
+  static Mqtt mqtt;
+  return mqtt;
+}
+
+Mqtt::Mqtt()
+  : mState(DISABLED), mSocket(-1), mPort(0), mQos(1), mKeepAlive(60),
+    mQueueLimit(0), mNextConnect(0), mReconnectDelay(1), mLastSent(0),
+    mLastReceived(0), mPendingBytes(0), mNextId(1), mWritten(0),
+    mConnected(0), mQueued(0), mPublished(0), mDropped(0), mConnects(0)
+{
+}
+
+/**
+  Read [mqtt], at startup and again on each reload. Changing anything
+  but queue_size drops the connection (saying goodbye first) and starts
+  a new one with the new settings; queued events are kept.
+*/
+void
+Mqtt::configure(Config &config)
+{
+  mQueueLimit = config.getMqttQueueSize();
+
+  std::string host = config.getMqttHost();
+  unsigned short port = config.getMqttPort();
+  std::string clientId = config.getMqttClientId();
+  std::string user = config.getMqttUser();
+  std::string password = config.getMqttPassword();
+  std::string prefix = config.getMqttPrefix();
+  int qos = config.getMqttQos();
+  int keepAlive = config.getMqttKeepAlive();
+  if (keepAlive > 65535) { keepAlive = 65535; }
+
+  if (mState == DISABLED ? host.empty() :
+      host == mHost && port == mPort && clientId == mClientId &&
+      user == mUser && password == mPassword && prefix == mPrefix &&
+      qos == mQos && keepAlive == mKeepAlive)
+  {
+    return;
+  }
+
+  stop();
+  mHost = host;
+  mPort = port;
+  mClientId = clientId;
+  mUser = user;
+  mPassword = password;
+  mPrefix = prefix;
+  mQos = qos;
+  mKeepAlive = keepAlive;
+  if (mHost.empty()) { return; }
+
+  if (!mConnected)
+  {
+    Metrics &metrics = Metrics::getMetrics();
+    mConnected = &metrics.gauge("dscd_mqtt_connected",
+      "1 while connected to the MQTT broker");
+    mQueued = &metrics.gauge("dscd_mqtt_queued_bytes",
+      "Events waiting to go to the MQTT broker");
+    mPublished = &metrics.counter("dscd_mqtt_published_total",
+      "Messages sent to the MQTT broker, including resends");
+    mDropped = &metrics.counter("dscd_mqtt_dropped_total",
+      "Events dropped because the MQTT queue was full");
+    mConnects = &metrics.counter("dscd_mqtt_connects_total",
+      "Connections accepted by the MQTT broker");
+  }
+  mState = IDLE;
+  mNextConnect = 0;
+  mReconnectDelay = 1;
+}
+
+void
+Mqtt::addPanel(const It100 *it100)
+{
+  mPanels[it100->getPanel()] = it100;
+}
+
+/**
+  Start a non-blocking connect; process() carries on from there. The
+  name is looked up here, synchronously, so an address is the better
+  choice of host if DNS might be slow.
+*/
+void
+Mqtt::connect()
+{
+  char port[8];
+  snprintf(port, sizeof(port), "%u", mPort);
+  struct addrinfo hints;
+  struct addrinfo *result;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  int error = getaddrinfo(mHost.c_str(), port, &hints, &result);
+  if (error)
+  {
+    disconnect(gai_strerror(error));
+    return;
+  }
+
+  mSocket = socket(result->ai_family, SOCK_STREAM, 0);
+  if (mSocket < 0)
+  {
+    freeaddrinfo(result);
+    disconnect(strerror(errno));
+    return;
+  }
+  fcntl(mSocket, F_SETFL, fcntl(mSocket, F_GETFL) | O_NONBLOCK);
+  int one = 1;
+  setsockopt(mSocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  if (::connect(mSocket, result->ai_addr, result->ai_addrlen) < 0 &&
+      errno != EINPROGRESS)
+  {
+    freeaddrinfo(result);
+    disconnect(strerror(errno));
+    return;
+  }
+  freeaddrinfo(result);
+  mState = CONNECTING;
+  mLastSent = mLastReceived = time(0);
+}
+
+/**
+  Drop the connection and try again later, backing off up to a
+  minute. Unacknowledged QoS 1 messages are kept to send again, and
+  QoS 0 events that hadn't been written go back on the queue; the
+  state is published afresh after the next connect.
+*/
+void
+Mqtt::disconnect(const char *reason)
+{
+  if (mSocket >= 0) { close(mSocket); }
+  mSocket = -1;
+
+  Log::getLog().write(Log::CONSOLE|Log::SYSLOG,
+                      mState == CONNECTED ? LOG_WARNING : LOG_INFO,
+                      "MQTT broker %s:%u: %s", mHost.c_str(), mPort, reason);
+
+  mState = IDLE;
+  reset();
+
+  mNextConnect = time(0) + mReconnectDelay;
+  mReconnectDelay = mReconnectDelay < 32 ? mReconnectDelay * 2 : 60;
+}
+
+void
+Mqtt::process(bool readable, bool writable)
+{
+  if (mState == DISABLED) { return; }
+  time_t now = time(0);
+
+  if (mState == IDLE)
+  {
+    if (now >= mNextConnect) { connect(); }
+    return;
+  }
+
+  if (mState == CONNECTING)
+  {
+    if (!writable)
+    {
+      if (now - mLastSent > mKeepAlive) { disconnect("connect timed out"); }
+      return;
+    }
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(mSocket, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error)
+    {
+      disconnect(strerror(error));
+      return;
+    }
+
+    // Clean session, and a retained will saying we've gone
+    std::string body;
+    appendString(body, "MQTT");
+    body += (char)4;
+    int flags = 0x02 | 0x04 | (mQos << 3) | 0x20;
+    // A password without a user name isn't allowed (and validate()
+    // won't have one)
+    if (mUser.length()) { flags |= 0x80; }
+    if (mUser.length() && mPassword.length()) { flags |= 0x40; }
+    body += (char)flags;
+    body += (char)(mKeepAlive >> 8);
+    body += (char)(mKeepAlive & 0xff);
+    appendString(body, mClientId);
+    appendString(body, mPrefix + "/status");
+    appendString(body, "offline");
+    if (mUser.length()) { appendString(body, mUser); }
+    if (mUser.length() && mPassword.length())
+    {
+      appendString(body, mPassword);
+    }
+    mOutput = makePacket(CONNECT, body);
+    mState = AWAITING_CONNACK;
+    mLastReceived = now;
+  }
+
+  if (readable)
+  {
+    readPackets();
+    if (mSocket < 0) { return; }
+  }
+
+  if (mState == AWAITING_CONNACK && now - mLastReceived > mKeepAlive)
+  {
+    disconnect("no CONNACK");
+    return;
+  }
+
+  if (mState == CONNECTED)
+  {
+    if (now - mLastReceived > mKeepAlive + mKeepAlive / 2)
+    {
+      disconnect("broker stopped answering");
+      return;
+    }
+    if (now - mLastSent >= mKeepAlive / 2 && mOutput.empty())
+    {
+      mOutput.append(PING, sizeof(PING));
+    }
+    fill();
+  }
+
+  write();
+}
+
+void
+Mqtt::readPackets()
+{
+  char buffer[512];
+  ssize_t n;
+  while ((n = read(mSocket, buffer, sizeof(buffer))) > 0)
+  {
+    mInput.append(buffer, n);
+  }
+  if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+  {
+    disconnect(n == 0 ? "connection closed" : strerror(errno));
+    return;
+  }
+
+  while (mInput.length() >= 2)
+  {
+    // Remaining length: up to four bytes, seven bits at a time
+    size_t length = 0;
+    size_t i = 1;
+    int shift = 0;
+    unsigned char byte;
+    do
+    {
+      if (i >= mInput.length()) { return; }
+      if (i > 4)
+      {
+        disconnect("malformed packet");
+        return;
+      }
+      byte = mInput[i++];
+      length |= (size_t)(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    if (mInput.length() < i + length) { return; }
+
+    const unsigned char *body =
+      reinterpret_cast<const unsigned char *>(mInput.data()) + i;
+    mLastReceived = time(0);
+
+    switch ((unsigned char)mInput[0] & 0xf0)
+    {
+      case CONNACK:
+        if (length < 2 || body[1] != 0)
+        {
+          char reason[32];
+          snprintf(reason, sizeof(reason), "refused (%d)",
+                   length < 2 ? -1 : body[1]);
+          disconnect(reason);
+          return;
+        }
+        else
+        {
+          Log::getLog().write(Log::CONSOLE|Log::SYSLOG, LOG_NOTICE,
+                              "Connected to MQTT broker %s:%u",
+                              mHost.c_str(), mPort);
+          mState = CONNECTED;
+          mReconnectDelay = 1;
+          mConnected->set(1);
+          mConnects->increment();
+
+          // Whatever wasn't acknowledged last time, then everything
+          // the broker should know about now
+          std::map<uint16_t, std::string>::iterator f;
+          for (f = mInFlight.begin(); f != mInFlight.end(); f++)
+          {
+            f->second[0] |= DUP;
+            mOutput += f->second;
+            mPublished->increment();
+          }
+          queueState(mPrefix + "/status", "online");
+          std::map<int, const It100 *>::iterator p;
+          for (p = mPanels.begin(); p != mPanels.end(); p++)
+          {
+            publishState(*p->second);
+          }
+        }
+        break;
+
+      case PUBACK:
+        if (length >= 2) { mInFlight.erase(body[0] << 8 | body[1]); }
+        break;
+
+      case PINGRESP:
+      default:
+        break;
+    }
+    mInput.erase(0, i + length);
+  }
+}
+
+/**
+  Move queued messages into the output, as far as the window of
+  unacknowledged messages and the output buffer allow. State goes
+  first: it's small, and coalesced, so it can't starve the events for
+  long.
+*/
+void
+Mqtt::fill()
+{
+  while (mOutput.length() < MAX_OUTPUT &&
+         (mQos == 0 || mInFlight.size() < MAX_IN_FLIGHT))
+  {
+    Message message;
+    bool retain;
+    if (!mPendingState.empty())
+    {
+      std::map<std::string, std::string>::iterator s = mPendingState.begin();
+      message.topic = s->first;
+      message.payload = s->second;
+      retain = true;
+      mPendingState.erase(s);
+    }
+    else if (!mPendingEvents.empty())
+    {
+      message = mPendingEvents.front();
+      mPendingEvents.pop_front();
+      mPendingBytes -= message.topic.length() + message.payload.length();
+      retain = false;
+    }
+    else
+    {
+      break;
+    }
+    appendPublish(message, retain);
+  }
+  mQueued->set(mPendingBytes);
+}
+
+void
+Mqtt::appendPublish(const Message &message, bool retain)
+{
+  std::string body;
+  appendString(body, message.topic);
+  uint16_t id = 0;
+  if (mQos)
+  {
+    id = mNextId++;
+    if (!mNextId) { mNextId = 1; }
+    body += (char)(id >> 8);
+    body += (char)(id & 0xff);
+  }
+  body += message.payload;
+
+  std::string packet = makePacket(PUBLISH | mQos << 1 | (retain ? RETAIN : 0),
+                                  body);
+  if (mQos) { mInFlight[id] = packet; }
+  mOutput += packet;
+  mPublished->increment();
+
+  // At QoS 0 nothing else remembers an event until it's written
+  if (!mQos && !retain)
+  {
+    Unsent unsent;
+    unsent.message = message;
+    unsent.end = mWritten + mOutput.length();
+    mUnsent.push_back(unsent);
+  }
+}
+
+void
+Mqtt::write()
+{
+  while (mOutput.length())
+  {
+    ssize_t n = ::write(mSocket, mOutput.data(), mOutput.length());
+    if (n < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) { return; }
+      disconnect(strerror(errno));
+      return;
+    }
+    mOutput.erase(0, n);
+    mWritten += n;
+    mLastSent = time(0);
+    while (mUnsent.size() && mUnsent.front().end <= mWritten)
+    {
+      mUnsent.pop_front();
+    }
+  }
+}
+
+/** Forget the connection's buffers, keeping every event not yet sent */
+void
+Mqtt::reset()
+{
+  if (mConnected) { mConnected->set(0); }
+  mOutput.clear();
+  mInput.clear();
+  mPendingState.clear();
+
+  std::deque<Unsent>::reverse_iterator u;
+  for (u = mUnsent.rbegin(); u != mUnsent.rend(); u++)
+  {
+    mPendingEvents.push_front(u->message);
+    mPendingBytes += u->message.topic.length() + u->message.payload.length();
+  }
+  mUnsent.clear();
+
+  std::map<int, Snapshot>::iterator s;
+  for (s = mSnapshots.begin(); s != mSnapshots.end(); s++)
+  {
+    s->second.valid = false;
+  }
+}
+
+void
+Mqtt::stop()
+{
+  if (mState == CONNECTED)
+  {
+    Message message;
+    message.topic = mPrefix + "/status";
+    message.payload = "offline";
+    appendPublish(message, true);
+    mOutput += makePacket(DISCONNECT, "");
+    write();
+  }
+  if (mSocket >= 0) { close(mSocket); }
+  mSocket = -1;
+  mState = DISABLED;
+  reset();
+}
+
+/* ***************************************************************************
+  What gets published
+*************************************************************************** */
+
+void
+Mqtt::event(const It100 &it100, const Journal::Record &record, bool passed)
+{
+  if (mState == DISABLED) { return; }
+
+  // While disconnected, the whole state goes out on the next connect
+  if (mState == CONNECTED) { publishState(it100); }
+  if (!passed) { return; }
+
+  char buffer[96];
+  snprintf(buffer, sizeof(buffer),
+           "{\"time_ms\":%llu,\"code\":%d,\"name\":",
+           (unsigned long long)(record.time / 1000000), record.code);
+  std::string payload = buffer;
+  const char *name = Config::getConfig().commandIntToName(record.code);
+  appendJson(payload, name, strlen(name));
+  snprintf(buffer, sizeof(buffer), ",\"zone\":%d,\"partition\":%d,"
+           "\"etag\":%u,\"data\":", record.zone, record.partition,
+           record.etag);
+  payload += buffer;
+  appendJson(payload, record.data, record.length);
+  payload += ",\"names\":[";
+  appendJson(payload, record.name[0], Journal::NAME_LENGTH);
+  payload += ',';
+  appendJson(payload, record.name[1], Journal::NAME_LENGTH);
+  payload += "]}";
+  queueEvent(topic(record.panel, "event"), payload);
+}
+
+/**
+  Queue whatever has changed since the broker was last told about this
+  panel, or all of it after a connect.
+*/
+void
+Mqtt::publishState(const It100 &it100)
+{
+  int panel = it100.getPanel();
+  Snapshot &s = mSnapshots[panel];
+  char buffer[160];
+
+  const ZoneState &zones = it100.getZones();
+  uint64_t changed = 0;
+  for (int c = 0; c < ZoneState::NUM_CONDITIONS; c++)
+  {
+    changed |= zones.mask[c] ^ s.zones[c];
+    if (!s.valid) { changed |= zones.mask[c]; }
+  }
+  if (!s.valid)
+  {
+    changed |= s.known;
+    for (int p = 1; p <= ZoneState::NUM_PARTITIONS; p++)
+    {
+      changed |= zones.members[p];
+    }
+  }
+  for (int zone = 1; changed; zone++, changed >>= 1)
+  {
+    if (!(changed & 1)) { continue; }
+    uint64_t bit = ZoneState::bit(zone);
+    std::string payload = "{\"name\":";
+    const std::string &name = it100.getZoneName(zone);
+    appendJson(payload, name.data(), name.length());
+    snprintf(buffer, sizeof(buffer), ",\"open\":%d,\"alarm\":%d,"
+             "\"tamper\":%d,\"fault\":%d,\"bypass\":%d}",
+             !!(zones.mask[ZoneState::OPEN] & bit),
+             !!(zones.mask[ZoneState::ALARM] & bit),
+             !!(zones.mask[ZoneState::TAMPER] & bit),
+             !!(zones.mask[ZoneState::FAULT] & bit),
+             !!(zones.mask[ZoneState::BYPASS] & bit));
+    payload += buffer;
+    queueState(topic(panel, "zone", zone), payload);
+    s.known |= bit;
+  }
+  memcpy(s.zones, zones.mask, sizeof(s.zones));
+
+  for (int p = 1; p <= ZoneState::NUM_PARTITIONS; p++)
+  {
+    const PartitionState &state = it100.getPartitionState(p);
+    if (s.valid ? !memcmp(&state, &s.partitions[p], sizeof(state))
+                : state.state == PartitionState::UNKNOWN)
+    {
+      continue;
+    }
+    std::string payload = "{\"name\":";
+    const std::string &name = it100.getPartitionName(p);
+    appendJson(payload, name.data(), name.length());
+    snprintf(buffer, sizeof(buffer), ",\"state\":\"%s\",\"ready\":%d,"
+             "\"armed\":%d,\"mode\":%d,\"user\":%d,\"since\":%u}",
+             PartitionState::getStateName(state.state), state.ready,
+             state.armed, state.armMode, state.user, state.since);
+    payload += buffer;
+    queueState(topic(panel, "partition", p), payload);
+    s.partitions[p] = state;
+  }
+
+  if (!s.valid || it100.getKeypadEtag() != s.etag)
+  {
+    std::string payload = "{\"lcd\":";
+    const char *lcd = it100.getLcd();
+    appendJson(payload, lcd, strnlen(lcd, 32));
+    payload += ",\"leds\":[";
+    for (int led = It100::READY; led <= It100::AC; led++)
+    {
+      snprintf(buffer, sizeof(buffer), "%s%d", led == It100::READY ? "" : ",",
+               it100.getLedState(static_cast<It100::led_t>(led)));
+      payload += buffer;
+    }
+    snprintf(buffer, sizeof(buffer), "],\"etag\":%u}",
+             it100.getKeypadEtag());
+    payload += buffer;
+    queueState(topic(panel, "keypad"), payload);
+    s.etag = it100.getKeypadEtag();
+  }
+  s.valid = true;
+}
+
+void
+Mqtt::queueState(const std::string &topic, const std::string &payload)
+{
+  mPendingState[topic] = payload;
+}
+
+void
+Mqtt::queueEvent(const std::string &topic, const std::string &payload)
+{
+  Message message;
+  message.topic = topic;
+  message.payload = payload;
+  mPendingEvents.push_back(message);
+  mPendingBytes += topic.length() + payload.length();
+
+  while (mPendingBytes > mQueueLimit && !mPendingEvents.empty())
+  {
+    const Message &oldest = mPendingEvents.front();
+    mPendingBytes -= oldest.topic.length() + oldest.payload.length();
+    mPendingEvents.pop_front();
+    mDropped->increment();
+  }
+}
+
+std::string
+Mqtt::topic(int panel, const char *kind, int n) const
+{
+  char buffer[48];
+  if (n)
+  {
+    snprintf(buffer, sizeof(buffer), "/%d/%s/%d", panel, kind, n);
+  }
+  else
+  {
+    snprintf(buffer, sizeof(buffer), "/%d/%s", panel, kind);
+  }
+  return mPrefix + buffer;
+}
@@ -0,0 +1,186 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _MQTT_H
+#define _MQTT_H 1
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+
+#include "Journal.h"
+#include "Metrics.h"
+#include "PartitionState.h"
+#include "ZoneState.h"
+
+class Config;
+class It100;
+
+/**
+  Publishes state and events to an MQTT broker, as configured in
+  [mqtt], using just enough of MQTT 3.1.1 for that: CONNECT with a
+  last will, PUBLISH at QoS 0 or 1, PUBACK and PINGREQ. The socket is
+  non-blocking and driven from the main loop, and one connection is
+  kept for as long as the broker allows.
+
+  Topics, under the configured prefix:
+
+    PREFIX/status                online or offline (retained; the will)
+    PREFIX/N/zone/Z              {"name":..,"open":0,"alarm":0,...}
+    PREFIX/N/partition/P         {"state":"ready","ready":1,...}
+    PREFIX/N/keypad              {"lcd":"..","leds":[..],"etag":N}
+    PREFIX/N/event               one message per event, not retained
+
+  for panel N. State topics are retained and published only when they
+  change. A state topic that changes again before it has gone out is
+  sent once, with the newest value, and state isn't queued while
+  disconnected: after each connect, the whole state is published
+  afresh. Events are queued in order, up to queue_size bytes; when the
+  queue is full the oldest are dropped and counted.
+
+  At QoS 1, a message is kept until its PUBACK and is sent again (as
+  a duplicate) after a reconnect. At QoS 0, an event that hadn't been
+  written when the connection dropped goes back on the queue. Whatever is ready goes out in one
+  write per pass of the main loop, so a burst of events shares a few
+  TCP segments rather than taking one each.
+*/
+
+class Mqtt
+{
+  public:
+    static Mqtt &getMqtt();
+
+    // Read [mqtt] at startup and on reload; does nothing without a host
+    void configure(Config &config);
+    void addPanel(const It100 *it100);
+
+    int getDescriptor() const { return mSocket; }
+    bool wantsWrite() const
+      { return mState == CONNECTING || mOutput.length() > 0; }
+
+    // Once per pass of the main loop
+    void process(bool readable, bool writable);
+
+    // After each event a panel records: state is published whether or
+    // not [debounce] passed the event, the event itself only if it did
+    void event(const It100 &it100, const Journal::Record &record,
+               bool passed);
+
+    // Say goodbye on the way out
+    void stop();
+
+  private:
+    enum state_t { DISABLED, IDLE, CONNECTING, AWAITING_CONNACK, CONNECTED };
+    enum { MAX_IN_FLIGHT = 64, MAX_OUTPUT = 64 * 1024 };
+
+    struct Message
+    {
+      std::string topic;
+      std::string payload;
+    };
+
+    // A QoS 0 event in mOutput, until the byte at end has been written
+    struct Unsent
+    {
+      Message message;
+      uint64_t end;
+    };
+
+    // What the broker has been told about a panel
+    struct Snapshot
+    {
+      bool valid;
+      uint64_t zones[ZoneState::NUM_CONDITIONS];
+      uint64_t known;           // zones ever published
+      PartitionState partitions[ZoneState::NUM_PARTITIONS + 1];
+      unsigned int etag;
+    };
+
+    Mqtt();
+    ~Mqtt() {;}
+
+    void connect();
+    void disconnect(const char *reason);
+    void reset();
+    void readPackets();
+    void fill();
+    void write();
+
+    void publishState(const It100 &it100);
+    void queueState(const std::string &topic, const std::string &payload);
+    void queueEvent(const std::string &topic, const std::string &payload);
+    void appendPublish(const Message &message, bool retain);
+    std::string topic(int panel, const char *kind, int n = 0) const;
+
+  private:
+    state_t mState;
+    int mSocket;
+    std::string mHost;
+    unsigned short mPort;
+    std::string mClientId;
+    std::string mUser;
+    std::string mPassword;
+    std::string mPrefix;
+    int mQos;
+    int mKeepAlive;
+    size_t mQueueLimit;
+
+    time_t mNextConnect;
+    int mReconnectDelay;
+    time_t mLastSent;
+    time_t mLastReceived;
+
+    std::map<int, const It100 *> mPanels;
+    std::map<int, Snapshot> mSnapshots;
+
+    // Waiting to go out: state by topic, newest value only, and events
+    // in order
+    std::map<std::string, std::string> mPendingState;
+    std::deque<Message> mPendingEvents;
+    size_t mPendingBytes;
+
+    // QoS 1 packets sent and not yet acknowledged, by packet id
+    std::map<uint16_t, std::string> mInFlight;
+    uint16_t mNextId;
+
+    std::string mOutput;
+    std::string mInput;
+    std::deque<Unsent> mUnsent;
+    uint64_t mWritten;          // bytes of mOutput written, ever
+
+    Metrics::Gauge *mConnected;
+    Metrics::Gauge *mQueued;
+    Metrics::Counter *mPublished;
+    Metrics::Counter *mDropped;
+    Metrics::Counter *mConnects;
+};
+
+#endif
@@ -0,0 +1,103 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "NameTable.h"
+#include "Config.h"
+
+#include <string.h>
+
+const std::string NameTable::sEmpty;
+
+NameTable::NameTable()
+{
+  memset(mZoneConfigured, 0, sizeof(mZoneConfigured));
+  memset(mPartitionConfigured, 0, sizeof(mPartitionConfigured));
+}
+
+void
+NameTable::resolve(Config &config, int panel,
+                   const StateFile::PanelState *state)
+{
+  int i;
+
+  for (i = 0; i < NUM_ZONES; i++)
+  {
+    mZone[i] = config.getZoneName(i, panel);
+    mZoneConfigured[i] = (mZone[i].length() != 0);
+    if (!mZoneConfigured[i] && state)
+    {
+      mZone[i] = state->label[i];
+    }
+  }
+
+  for (i = 0; i < NUM_PARTITIONS; i++)
+  {
+    mPartition[i] = config.getPartitionName(i, panel);
+    mPartitionConfigured[i] = (mPartition[i].length() != 0);
+    if (!mPartitionConfigured[i] && state)
+    {
+      mPartition[i] = state->label[100 + i];
+    }
+  }
+
+  for (i = 0; i < NUM_USERS; i++)
+  {
+    mUser[i] = config.getUserName(i, panel);
+  }
+
+  for (i = 0; i < NUM_KEYS; i++)
+  {
+    mKey[i] = config.getKeyName(i, panel);
+  }
+
+  for (i = 0; i < NUM_KEYPADS; i++)
+  {
+    mKeypad[i] = config.getKeypadName(i, panel);
+  }
+}
+
+/**
+  A label broadcast by the panel. Label slots 100-108 are shared
+  between the zones of the same number and the partitions.
+*/
+void
+NameTable::setLabel(int num, const char *label)
+{
+  if (num >= 0 && num < NUM_ZONES && !mZoneConfigured[num])
+  {
+    mZone[num] = label;
+  }
+
+  int partition = num - 100;
+  if (partition >= 0 && partition < NUM_PARTITIONS &&
+      !mPartitionConfigured[partition])
+  {
+    mPartition[partition] = label;
+  }
+}
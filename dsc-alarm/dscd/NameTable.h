@@ -0,0 +1,98 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _NAME_TABLE_H
+#define _NAME_TABLE_H 1
+
+#include <string>
+
+#include "StateFile.h"
+
+class Config;
+
+/**
+  Display names for one panel's zones, partitions, users, wireless keys
+  and handheld keypads, resolved once into flat arrays.
+
+  A name configured in dscd.conf wins; otherwise zones and partitions
+  fall back to the labels the panel broadcasts. The table is rebuilt
+  when the configuration is (re)loaded and patched one slot at a time
+  as labels arrive, so lookups never touch the configuration maps.
+*/
+
+class NameTable
+{
+  public:
+    enum
+    {
+      NUM_ZONES = StateFile::NUM_LABELS,  // zone N uses label N
+      NUM_PARTITIONS = 9,                 // partition N uses label 100+N
+      NUM_USERS = 43,
+      NUM_KEYS = 17,
+      NUM_KEYPADS = 5
+    };
+
+    NameTable();
+
+    void resolve(Config &config, int panel,
+                 const StateFile::PanelState *state);
+    void setLabel(int num, const char *label);
+
+    const std::string &getZoneName(int zone) const
+      { return pick(mZone, NUM_ZONES, zone); }
+    const std::string &getPartitionName(int partition) const
+      { return pick(mPartition, NUM_PARTITIONS, partition); }
+    const std::string &getUserName(int user) const
+      { return pick(mUser, NUM_USERS, user); }
+    const std::string &getKeyName(int key) const
+      { return pick(mKey, NUM_KEYS, key); }
+    const std::string &getKeypadName(int keypad) const
+      { return pick(mKeypad, NUM_KEYPADS, keypad); }
+
+  private:
+    static const std::string &pick(const std::string *table, int size,
+                                   int index)
+      { return (index >= 0 && index < size) ? table[index] : sEmpty; }
+
+  private:
+    static const std::string sEmpty;
+
+    std::string mZone[NUM_ZONES];
+    std::string mPartition[NUM_PARTITIONS];
+    std::string mUser[NUM_USERS];
+    std::string mKey[NUM_KEYS];
+    std::string mKeypad[NUM_KEYPADS];
+
+    // Set where dscd.conf supplied the name, so labels leave it alone
+    bool mZoneConfigured[NUM_ZONES];
+    bool mPartitionConfigured[NUM_PARTITIONS];
+};
+
+#endif
@@ -0,0 +1,122 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "PartitionState.h"
+#include "It100.h"
+
+static const char *stateNames[PartitionState::NUM_STATES] =
+{
+  "unknown", "ready", "not-ready", "exit-delay", "armed-stay",
+  "armed-away", "entry-delay", "alarm", "busy"
+};
+
+const char *
+PartitionState::getStateName(int state)
+{
+  if (state < 0 || state >= NUM_STATES) { return stateNames[UNKNOWN]; }
+  return stateNames[state];
+}
+
+void
+PartitionState::apply(int code, int detail, uint32_t now)
+{
+  int next = state;
+  bool disarmed = (state == UNKNOWN || state == READY ||
+                   state == NOT_READY || state == BUSY);
+
+  switch (code)
+  {
+    case It100::PARTITION_READY:
+    case It100::PARTITION_IN_READY_TO_FORCE_ARM:
+      ready = 1;
+      if (disarmed) { next = READY; }
+      break;
+
+    case It100::PARTITION_NOT_READY:
+      ready = 0;
+      if (disarmed) { next = NOT_READY; }
+      break;
+
+    case It100::PARTITION_BUSY:
+      if (disarmed) { next = BUSY; }
+      break;
+
+    case It100::EXIT_DELAY_IN_PROGRESS:
+      next = EXIT_DELAY;
+      break;
+
+    case It100::PARTITION_ARMED_DESCRIPTIVE_MODE:
+      // Modes 1 and 3 are stay, 0 and 2 away (3 and 2 without delay)
+      armMode = detail;
+      armed = 1;
+      next = (detail & 1) ? ARMED_STAY : ARMED_AWAY;
+      break;
+
+    case It100::ENTRY_DELAY_IN_PROGRESS:
+      next = ENTRY_DELAY;
+      break;
+
+    case It100::PARTITION_IN_ALARM:
+      next = ALARM;
+      break;
+
+    // Sent once the partition has armed; 652 follows with the mode
+    case It100::USER_CLOSING:
+      user = detail;
+      armed = 1;
+      break;
+
+    case It100::SPECIAL_CLOSING:
+      user = 0;
+      armed = 1;
+      break;
+
+    // Armed with zones bypassed; says nothing about who armed it
+    case It100::PARTIAL_CLOSING:
+      armed = 1;
+      break;
+
+    case It100::USER_OPENING:
+    case It100::SPECIAL_OPENING:
+    case It100::PARTITION_DISARMED:
+      if (code != It100::PARTITION_DISARMED)
+      {
+        user = (code == It100::USER_OPENING) ? detail : 0;
+      }
+      armed = 0;
+      next = ready ? READY : NOT_READY;
+      break;
+  }
+
+  if (next != state)
+  {
+    state = next;
+    since = now;
+  }
+}
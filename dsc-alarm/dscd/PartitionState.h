@@ -0,0 +1,74 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _PARTITION_STATE_H
+#define _PARTITION_STATE_H 1
+
+#include <stdint.h>
+
+/**
+  Where one partition stands, worked out from the partition status
+  (650-673), closing (700-702) and opening (750-751) reports, so that
+  nobody has to read it off the LCD.
+
+  Ready and not ready only count while the partition is disarmed: the
+  panel keeps reporting them as doors open during the exit delay, and
+  they mustn't knock an armed partition back to disarmed. Whether it's
+  armed is kept apart from the state, since a fire or 24 hour zone can
+  put a disarmed partition in alarm. Like ZoneState, this is plain data
+  kept in the state file.
+*/
+
+struct PartitionState
+{
+  enum state_t
+  {
+    UNKNOWN, READY, NOT_READY, EXIT_DELAY, ARMED_STAY, ARMED_AWAY,
+    ENTRY_DELAY, ALARM, BUSY, NUM_STATES
+  };
+
+  uint8_t state;
+  uint8_t ready;        // from the last 650/651, whatever the state
+  uint8_t armMode;      // 652's mode: away, stay, either without delay
+  uint8_t armed;        // from 652 and the closing reports until disarmed
+  uint16_t user;        // who last armed or disarmed it; 0 if unknown
+  uint16_t pad2;
+  uint32_t since;       // time() of the last change of state
+
+  // code is the report's command number, detail its second parameter
+  // (arming mode or user) where it has one
+  void apply(int code, int detail, uint32_t now);
+
+  bool isArmed() const { return armed != 0; }
+
+  static const char *getStateName(int state);
+};
+
+#endif
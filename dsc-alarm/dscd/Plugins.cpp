@@ -0,0 +1,244 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "Plugins.h"
+#include "Capture.h"
+#include "Config.h"
+#include "It100.h"
+#include "Log.h"
+
+#include <dlfcn.h>
+#include <string.h>
+
+/* ***************************************************************************
+  What plugins can call back into; a dscd_panel is really an It100
+*************************************************************************** */
+
+static const It100 &
+panelOf(const struct dscd_panel *panel)
+{
+  return *reinterpret_cast<const It100 *>(panel);
+}
+
+static void
+hostLog(int priority, const char *message)
+{
+  Log::getLog().write(Log::CONSOLE|Log::SYSLOG, priority, "%s", message);
+}
+
+static int
+hostPanelNumber(const struct dscd_panel *panel)
+{
+  return panelOf(panel).getPanel();
+}
+
+static uint64_t
+hostZones(const struct dscd_panel *panel, int condition, int partition)
+{
+  if (condition < 0 || condition >= ZoneState::NUM_CONDITIONS ||
+      partition < 0 || partition > ZoneState::NUM_PARTITIONS)
+  {
+    return 0;
+  }
+  return panelOf(panel).getZones().get(
+    static_cast<ZoneState::condition_t>(condition), partition);
+}
+
+static int
+hostPartition(const struct dscd_panel *panel, int partition,
+              struct dscd_partition *state)
+{
+  if (partition < 1 || partition > ZoneState::NUM_PARTITIONS) { return 0; }
+  const PartitionState &p = panelOf(panel).getPartitionState(partition);
+  state->state = p.state;
+  state->ready = p.ready;
+  state->arm_mode = p.armMode;
+  state->user = p.user;
+  state->since = p.since;
+  return 1;
+}
+
+static struct dscd_view
+hostLcd(const struct dscd_panel *panel)
+{
+  struct dscd_view view;
+  view.data = panelOf(panel).getLcd();
+  view.length = strnlen(view.data, 32);
+  return view;
+}
+
+static int
+hostLed(const struct dscd_panel *panel, int led)
+{
+  if (led < It100::READY || led > It100::AC) { return 0; }
+  return panelOf(panel).getLedState(static_cast<It100::led_t>(led));
+}
+
+static int
+hostArmed(const struct dscd_panel *panel, int partition)
+{
+  if (partition < 1 || partition > ZoneState::NUM_PARTITIONS) { return 0; }
+  return panelOf(panel).getPartitionState(partition).isArmed();
+}
+
+static const struct dscd_host host =
+{
+  DSCD_PLUGIN_ABI,
+  hostLog,
+  hostPanelNumber,
+  hostZones,
+  hostPartition,
+  hostLcd,
+  hostLed,
+  hostArmed,
+};
+
+/* ************************************************************************ */
+
+Plugins &
+Plugins::getPlugins()
+{
+  static Plugins plugins;
+  return plugins;
+}
+
+void
+Plugins::load(Config &config)
+{
+  Log &log = Log::getLog();
+  std::map<std::string, std::string> plugins = config.getPlugins();
+  std::map<std::string, std::string>::iterator i;
+  for (i = plugins.begin(); i != plugins.end(); i++)
+  {
+    std::string::size_type space = i->second.find(' ');
+    std::string path = i->second.substr(0, space);
+    std::string argument;
+    if (space != std::string::npos)
+    {
+      argument = i->second.substr(i->second.find_first_not_of(' ', space));
+    }
+
+    Plugin p;
+    p.name = i->first;
+    p.handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!p.handle)
+    {
+      log.write(Log::CONSOLE|Log::SYSLOG, LOG_ERR,
+                "Could not load plugin %s: %s", p.name.c_str(), dlerror());
+      continue;
+    }
+
+    dscd_plugin_t describe =
+      reinterpret_cast<dscd_plugin_t>(dlsym(p.handle, DSCD_PLUGIN_SYMBOL));
+    p.plugin = describe ? describe() : 0;
+    const char *problem = 0;
+    if (!p.plugin) { problem = "no " DSCD_PLUGIN_SYMBOL "()"; }
+    else if (p.plugin->abi != DSCD_PLUGIN_ABI)
+    {
+      problem = "built for another ABI";
+    }
+    else if (!p.plugin->open || !p.plugin->event)
+    {
+      problem = "no open() or event()";
+    }
+    if (problem)
+    {
+      log.write(Log::CONSOLE|Log::SYSLOG, LOG_ERR,
+                "Not loading plugin %s: %s", p.name.c_str(), problem);
+      dlclose(p.handle);
+      continue;
+    }
+
+    p.context = p.plugin->open(&host, argument.c_str());
+    if (!p.context)
+    {
+      log.write(Log::CONSOLE|Log::SYSLOG, LOG_ERR,
+                "Plugin %s declined to start", p.name.c_str());
+      dlclose(p.handle);
+      continue;
+    }
+
+    std::string labels = "plugin=\"" + p.name + "\"";
+    p.time = &Metrics::getMetrics().histogram("dscd_plugin_seconds",
+      "Time spent in each plugin's event handler", labels);
+    mPlugins.push_back(p);
+    log.write(Log::CONSOLE|Log::SYSLOG, LOG_INFO, "Loaded plugin %s (%s)",
+              p.name.c_str(), p.plugin->name ? p.plugin->name : "");
+  }
+}
+
+void
+Plugins::unload()
+{
+  for (size_t i = 0; i < mPlugins.size(); i++)
+  {
+    if (mPlugins[i].plugin->close)
+    {
+      mPlugins[i].plugin->close(mPlugins[i].context);
+    }
+    dlclose(mPlugins[i].handle);
+  }
+  mPlugins.clear();
+}
+
+/**
+  The event is a view of the journal record: nothing is copied but the
+  fixed-size fields.
+*/
+void
+Plugins::event(const It100 &it100, const Journal::Record &record)
+{
+  if (mPlugins.empty()) { return; }
+
+  struct dscd_event e;
+  e.time = record.time;
+  e.etag = record.etag;
+  e.code = record.code;
+  e.panel = record.panel;
+  e.zone = record.zone;
+  e.partition = record.partition;
+  e.flags = (record.flags & Journal::SUPPRESSED) ? DSCD_EVENT_SUPPRESSED : 0;
+  e.name = Config::getConfig().commandIntToName(record.code);
+  e.data.data = record.data;
+  e.data.length = record.length;
+  for (int n = 0; n < Journal::NUM_NAMES; n++)
+  {
+    e.names[n].data = record.name[n];
+    e.names[n].length = strnlen(record.name[n], Journal::NAME_LENGTH);
+  }
+
+  const struct dscd_panel *panel =
+    reinterpret_cast<const struct dscd_panel *>(&it100);
+  for (size_t i = 0; i < mPlugins.size(); i++)
+  {
+    uint64_t start = Capture::now();
+    mPlugins[i].plugin->event(mPlugins[i].context, panel, &e);
+    mPlugins[i].time->observe(Capture::now() - start);
+  }
+}
@@ -0,0 +1,84 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _PLUGINS_H
+#define _PLUGINS_H 1
+
+#include <string>
+#include <vector>
+
+#include "Journal.h"
+#include "Metrics.h"
+#include "dscd_plugin.h"
+
+class Config;
+class It100;
+
+/**
+  The action plugins listed in [plugins], loaded with dlopen() once at
+  startup (a reload doesn't load or drop any). See dscd_plugin.h for
+  what a plugin sees.
+
+    NAME = /path/to/plugin.so [ARGUMENT]
+
+  A plugin that can't be loaded, was built for another ABI or declines
+  in open() is logged and left out; the rest carry on.
+*/
+
+class Plugins
+{
+  public:
+    static Plugins &getPlugins();
+
+    void load(Config &config);
+    void unload();
+    bool isEmpty() const { return mPlugins.empty(); }
+
+    // An event that has got past [debounce], after its rules
+    void event(const It100 &it100, const Journal::Record &record);
+
+  private:
+    struct Plugin
+    {
+      std::string name;
+      void *handle;
+      const struct dscd_plugin *plugin;
+      void *context;
+      Metrics::Histogram *time;
+    };
+
+    Plugins() {;}
+    ~Plugins() {;}
+
+  private:
+    std::vector<Plugin> mPlugins;
+};
+
+#endif
@@ -0,0 +1,253 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "Rule.h"
+#include "Config.h"
+#include "It100.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const struct
+{
+  const char *name;
+  Rule::sink_t sink;
+} sinks[] =
+{
+  { "log",     Rule::LOG },
+  { "journal", Rule::JOURNAL },
+  { "push",    Rule::PUSH },
+  { "command", Rule::COMMAND },
+  { "run",     Rule::RUN },
+};
+
+/**
+  "3,12,14" into bits 2, 11 and 13 of mask; every number must be
+  between 1 and max.
+*/
+static bool
+parseList(const char *list, int max, uint64_t &mask)
+{
+  const char *p = list;
+  while (*p)
+  {
+    char *end;
+    long n = strtol(p, &end, 10);
+    if (end == p || n < 1 || n > max) { return false; }
+    mask |= (uint64_t)1 << (n - 1);
+    if (*end == ',') { end++; }
+    else if (*end) { return false; }
+    p = end;
+  }
+  return p != list;
+}
+
+static bool
+parseClock(const char *text, int &minutes)
+{
+  int hours, mins;
+  char extra;
+  if (sscanf(text, "%d:%d%c", &hours, &mins, &extra) != 2 ||
+      hours < 0 || hours > 23 || mins < 0 || mins > 59)
+  {
+    return false;
+  }
+  minutes = hours * 60 + mins;
+  return true;
+}
+
+Rule::Rule()
+  : mPanel(0), mArmed(0), mDisarmed(0), mOpen(0), mClosed(0),
+    mFrom(-1), mTo(-1), mSink(LOG)
+{
+}
+
+bool
+Rule::parse(Config &config, const std::string &name,
+            const std::string &text, std::string &error)
+{
+  mName = name;
+  error = "rule " + name + ": ";
+
+  std::string::size_type arrow = text.find("->");
+  if (arrow == std::string::npos)
+  {
+    error += "no -> SINK";
+    return false;
+  }
+
+  // Conditions
+  std::string conditions = text.substr(0, arrow);
+  char *save;
+  for (char *word = strtok_r(&conditions[0], " \t", &save); word;
+       word = strtok_r(0, " \t", &save))
+  {
+    if (!strchr(word, '='))
+    {
+      int code = config.commandNameToInt(word);
+      char term[16];
+      snprintf(term, sizeof(term), "code=%d", code);
+      if (code < 0 || !mEvent.parse(term))
+      {
+        error += std::string("unknown event ") + word;
+        return false;
+      }
+    }
+    else if (!parseTerm(word) && !mEvent.parse(word))
+    {
+      error += std::string("bad condition ") + word;
+      return false;
+    }
+  }
+
+  // Sink and its argument
+  std::string::size_type start = text.find_first_not_of(" \t", arrow + 2);
+  if (start == std::string::npos)
+  {
+    error += "no sink after ->";
+    return false;
+  }
+  std::string::size_type end = text.find_first_of(" \t", start);
+  std::string sink = text.substr(start, end - start);
+  if (end != std::string::npos)
+  {
+    end = text.find_first_not_of(" \t", end);
+  }
+  mArgument = end == std::string::npos ? "" : text.substr(end);
+
+  size_t i;
+  for (i = 0; i < sizeof(sinks) / sizeof(sinks[0]); i++)
+  {
+    if (sink == sinks[i].name) { break; }
+  }
+  if (i == sizeof(sinks) / sizeof(sinks[0]))
+  {
+    error += "unknown sink " + sink;
+    return false;
+  }
+  mSink = sinks[i].sink;
+
+  if (mSink == COMMAND &&
+      (mArgument.length() < 3 || !isdigit(mArgument[0]) ||
+       !isdigit(mArgument[1]) || !isdigit(mArgument[2])))
+  {
+    error += "command needs a three digit code";
+    return false;
+  }
+  if (mSink == COMMAND &&
+      !It100::isOutboundCommand(atoi(mArgument.substr(0, 3).c_str())))
+  {
+    error += "command " + mArgument.substr(0, 3) +
+             " isn't one the panel accepts";
+    return false;
+  }
+  if (mSink == COMMAND && mArgument.length() > 3 + It100::MAX_COMMAND_DATA)
+  {
+    error += "command data is too long";
+    return false;
+  }
+  if (mSink == RUN && mArgument.empty())
+  {
+    error += "run needs a command";
+    return false;
+  }
+  if (mArgument.empty()) { mArgument = "%c"; }
+
+  error.clear();
+  return true;
+}
+
+/** The terms that are about state rather than the event itself */
+bool
+Rule::parseTerm(const char *term)
+{
+  const char *value = strchr(term, '=') + 1;
+  std::string key(term, value - 1 - term);
+  uint64_t mask = 0;
+
+  if (key == "panel")
+  {
+    mPanel = atoi(value);
+    return mPanel > 0;
+  }
+  if (key == "armed" || key == "disarmed")
+  {
+    if (!parseList(value, ZoneState::NUM_PARTITIONS, mask)) { return false; }
+    (key == "armed" ? mArmed : mDisarmed) |= mask;
+    return true;
+  }
+  if (key == "open" || key == "closed")
+  {
+    if (!parseList(value, ZoneState::NUM_ZONES, mask)) { return false; }
+    (key == "open" ? mOpen : mClosed) |= mask;
+    return true;
+  }
+  if (key == "time")
+  {
+    const char *dash = strchr(value, '-');
+    return dash && parseClock(std::string(value, dash).c_str(), mFrom) &&
+           parseClock(dash + 1, mTo);
+  }
+  return false;
+}
+
+bool
+Rule::matches(const Journal::Record &record, int priority,
+              const It100 &it100) const
+{
+  if (mPanel && record.panel != mPanel) { return false; }
+  if (!mEvent.matches(record, priority)) { return false; }
+
+  uint64_t open = it100.getZones().get(ZoneState::OPEN);
+  if ((open & mOpen) != mOpen || (open & mClosed)) { return false; }
+
+  for (int p = 1; p <= ZoneState::NUM_PARTITIONS; p++)
+  {
+    int bit = 1 << (p - 1);
+    if (!((mArmed | mDisarmed) & bit)) { continue; }
+    bool armed = it100.getPartitionState(p).isArmed();
+    if (armed ? (mDisarmed & bit) : (mArmed & bit)) { return false; }
+  }
+
+  return mFrom < 0 || inWindow(record.time);
+}
+
+bool
+Rule::inWindow(uint64_t time) const
+{
+  time_t seconds = time / 1000000000ULL;
+  struct tm t;
+  localtime_r(&seconds, &t);
+  int minutes = t.tm_hour * 60 + t.tm_min;
+  if (mFrom <= mTo) { return minutes >= mFrom && minutes < mTo; }
+  return minutes >= mFrom || minutes < mTo;
+}
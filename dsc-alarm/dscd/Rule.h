@@ -0,0 +1,119 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _RULE_H
+#define _RULE_H 1
+
+#include <stdint.h>
+#include <string>
+
+#include "Journal.h"
+#include "Subscription.h"
+
+class Config;
+class It100;
+
+/**
+  One entry from the [rules] section: conditions on an event and on
+  the panel's state, and what to do when they all hold. Rules are
+  compiled when the configuration is read and checked in-process for
+  every event, so a rule that only logs or sends a command costs no
+  more than a few comparisons and a string expansion.
+
+    NAME = [EVENT ...] [TERM ...] -> SINK [ARGUMENT]
+
+  EVENTs are command names as in [actions] (ZONE_OPEN); TERMs are the
+  code=, class=, zone=, partition= and priority= filters of
+  "subscribe", plus
+
+    panel=N            only for this panel
+    armed=P[,P...]     these partitions are armed (including entry
+                       delay and alarm)
+    disarmed=P[,P...]  these partitions are not
+    open=Z[,Z...]      these zones are all open
+    closed=Z[,Z...]    none of these zones is open
+    time=HH:MM-HH:MM   local time of the event is in this window,
+                       which may wrap past midnight
+
+  State is as it stands after the event has been applied. SINK is one
+  of
+
+    log TEXT           syslog at NOTICE
+    journal TEXT       a RULE_NOTE event in the journal and history,
+                       which also reaches subscribed clients
+    push TEXT          the same event, but only in memory: clients
+                       see it, the journal doesn't
+    command NNNDATA    send command NNN to the panel; NNN must be one
+                       the panel accepts, and DATA at most 32
+                       characters once expanded
+    run COMMAND        the shell command, as [actions] would
+
+  ARGUMENT takes the same placeholders as [actions]. log, journal and
+  push default to %c, the event's name.
+*/
+
+class Rule
+{
+  public:
+    typedef enum { LOG, JOURNAL, PUSH, COMMAND, RUN } sink_t;
+
+    Rule();
+
+    // False, with error set, if text isn't a valid rule
+    bool parse(Config &config, const std::string &name,
+               const std::string &text, std::string &error);
+
+    // priority is the event's, from Config::getSyslogPriority
+    bool matches(const Journal::Record &record, int priority,
+                 const It100 &it100) const;
+
+    const std::string &getName() const { return mName; }
+    sink_t getSink() const { return mSink; }
+    const std::string &getArgument() const { return mArgument; }
+
+  private:
+    bool parseTerm(const char *term);
+    bool inWindow(uint64_t time) const;
+
+  private:
+    std::string mName;
+    Subscription mEvent;
+    int mPanel;
+    uint8_t mArmed;
+    uint8_t mDisarmed;
+    uint64_t mOpen;
+    uint64_t mClosed;
+    int mFrom;          // minutes past midnight; -1 for any time
+    int mTo;
+    sink_t mSink;
+    std::string mArgument;
+};
+
+#endif
@@ -0,0 +1,149 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#include "StateFile.h"
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <syslog.h>
+#include <iostream>
+
+StateFile::StateFile() : mState(0), mRestored(false), mPersistent(false)
+{
+}
+
+StateFile::~StateFile()
+{
+  close();
+}
+
+void
+StateFile::close()
+{
+  if (mState)
+  {
+    if (mPersistent)
+    {
+      msync(mState, sizeof(PanelState), MS_SYNC);
+    }
+    munmap(mState, sizeof(PanelState));
+    mState = 0;
+  }
+  mRestored = false;
+  mPersistent = false;
+}
+
+bool
+StateFile::open(const std::string &filename)
+{
+  close();
+
+  void *map = MAP_FAILED;
+
+  if (filename.length())
+  {
+    int descriptor = ::open(filename.c_str(), O_RDWR | O_CREAT, 0600);
+    if (descriptor < 0)
+    {
+      std::cerr << "Could not open state file: " << filename << std::endl;
+    }
+    else
+    {
+      struct stat st;
+      bool sized = (fstat(descriptor, &st) == 0 &&
+                    st.st_size == sizeof(PanelState));
+      if (sized || ftruncate(descriptor, sizeof(PanelState)) == 0)
+      {
+        map = mmap(0, sizeof(PanelState), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, descriptor, 0);
+      }
+      ::close(descriptor);
+
+      if (map == MAP_FAILED)
+      {
+        std::cerr << "Could not map state file: " << filename << std::endl;
+      }
+      else
+      {
+        mPersistent = true;
+        mState = static_cast<PanelState*>(map);
+
+        // A file of the wrong size was just truncated, so it fails
+        // the size check below along with any other stale layout.
+        mRestored = sized &&
+                    mState->magic == MAGIC &&
+                    mState->version == VERSION &&
+                    mState->size == sizeof(PanelState) &&
+                    (mState->generation & 1) == 0;
+      }
+    }
+  }
+
+  if (!mState)
+  {
+    map = mmap(0, sizeof(PanelState), PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (map == MAP_FAILED)
+    {
+      perror("mmap()");
+      return false;
+    }
+    mState = static_cast<PanelState*>(map);
+  }
+
+  if (!mRestored)
+  {
+    if (mPersistent)
+    {
+      syslog(LOG_NOTICE, "Discarding stale state in %s", filename.c_str());
+    }
+    reset();
+  }
+
+  return true;
+}
+
+void
+StateFile::reset()
+{
+  memset(mState, 0, sizeof(PanelState));
+  mState->version = VERSION;
+  mState->size = sizeof(PanelState);
+  mState->keypadEtag = 1;
+  memset(mState->lcd, ' ', 32);
+  mState->lcd[32] = 0;
+
+  // Written last, so a crash part way through leaves an invalid file
+  mState->magic = MAGIC;
+}
@@ -0,0 +1,106 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _STATE_FILE_H
+#define _STATE_FILE_H 1
+
+#include <stdint.h>
+#include <string>
+
+#include "ZoneState.h"
+#include "PartitionState.h"
+#include "ZoneStats.h"
+
+/**
+  Fixed-layout snapshot of everything the It100 class has learned from
+  the panel, kept in a memory-mapped file so that a restarted daemon can
+  pick up exactly where the previous one left off.
+
+  Updates are made in place. The generation counter is odd while an
+  update is in progress and even otherwise; a snapshot found with an odd
+  generation at startup was torn by a crash and is discarded.
+*/
+
+class StateFile
+{
+  public:
+    enum { MAGIC = 0x53435344, VERSION = 4 };   // "DSCS"
+    enum { NUM_LABELS = 152, LABEL_LENGTH = 33, NUM_LEDS = 10 };
+
+    struct PanelState
+    {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t size;
+      volatile uint32_t generation;
+
+      uint32_t keypadEtag;
+      uint8_t  hasLabels;
+      uint8_t  cursorType;
+      uint8_t  cursorLine;
+      uint8_t  cursorColumn;
+      uint8_t  ledState[NUM_LEDS];
+      char     lcd[33];
+      char     pad[5];
+
+      ZoneState zones;
+      PartitionState partitions[ZoneState::NUM_PARTITIONS + 1];
+
+      char     label[NUM_LABELS][LABEL_LENGTH];
+
+      ZoneStats zoneStats;
+    };
+
+    StateFile();
+    ~StateFile();
+
+    // Maps the named file, creating it if needed. With an empty
+    // filename (or if the file can't be used) the state lives in
+    // anonymous memory and is lost on exit.
+    bool open(const std::string &filename);
+
+    PanelState *getState() { return mState; }
+    bool isRestored() const { return mRestored; }
+    bool isPersistent() const { return mPersistent; }
+
+    void beginUpdate() { mState->generation++; }
+    void endUpdate() { mState->generation++; }
+
+  private:
+    void reset();
+    void close();
+
+  private:
+    PanelState *mState;
+    bool mRestored;
+    bool mPersistent;
+};
+
+#endif
@@ -0,0 +1,104 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "Subscription.h"
+#include "Config.h"
+#include "History.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+Subscription::Subscription()
+  : mAllCodes(true), mZones(0), mPartitions(0), mPriority(-1)
+{
+  memset(mCodes, 0xff, sizeof(mCodes));
+}
+
+/**
+  code=, class=, zone= and partition= are spelled as for history
+  queries, so History::Filter does the parsing and this just widens
+  the masks; priority= takes a [syslog] level name. Values can also be
+  a comma-separated list, as in zone=3,12,14, since a command line is
+  only so long.
+*/
+bool
+Subscription::parse(const char *term)
+{
+  if (!strncmp(term, "priority=", 9))
+  {
+    mPriority = Config::levelToPriority(term + 9);
+    return mPriority >= 0;
+  }
+
+  const char *value = strchr(term, '=');
+  if (value && strchr(value, ','))
+  {
+    std::string key(term, value + 1 - term);
+    for (const char *v = value + 1; ; v = strchr(v, ',') + 1)
+    {
+      const char *end = strchr(v, ',');
+      std::string one = key + (end ? std::string(v, end - v) : v);
+      if (!parse(one.c_str())) { return false; }
+      if (!end) { return true; }
+    }
+  }
+
+  History::Filter filter;
+  if (!filter.parse(term)) { return false; }
+
+  if (filter.zone)
+  {
+    if (filter.zone > MAX_ZONE) { return false; }
+    mZones |= (uint64_t)1 << (filter.zone - 1);
+  }
+  else if (filter.partition)
+  {
+    if (filter.partition > MAX_PARTITION) { return false; }
+    mPartitions |= 1 << (filter.partition - 1);
+  }
+  else
+  {
+    if (filter.low < 0 || filter.high >= NUM_CODES ||
+        filter.low > filter.high)
+    {
+      return false;
+    }
+    if (mAllCodes)
+    {
+      memset(mCodes, 0, sizeof(mCodes));
+      mAllCodes = false;
+    }
+    for (int code = filter.low; code <= filter.high; code++)
+    {
+      mCodes[code >> 6] |= (uint64_t)1 << (code & 63);
+    }
+  }
+  return true;
+}
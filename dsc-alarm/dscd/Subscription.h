@@ -0,0 +1,91 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _SUBSCRIPTION_H
+#define _SUBSCRIPTION_H 1
+
+#include <stdint.h>
+
+#include "Journal.h"
+
+/**
+  What a "subscribe" client wants pushed to it, compiled from its
+  filters into bitmasks so each new event is checked with a few loads
+  and shifts.
+
+  Terms of the same kind add to each other (code=609 code=610, or
+  code=609,610, is either code); different kinds must all match.
+  Codes come from code= and class=, zones from zone=, partitions from
+  partition=; a kind with no terms matches anything. priority=LEVEL
+  passes only events whose [syslog] priority is LEVEL or more severe,
+  which leaves out those set to NONE. Events held back by [debounce]
+  never match.
+*/
+
+class Subscription
+{
+  public:
+    enum { NUM_CODES = 1000, MAX_ZONE = 64, MAX_PARTITION = 8 };
+
+    Subscription();
+
+    bool parse(const char *term);
+
+    // priority is the event's, from Config::getSyslogPriority
+    bool matches(const Journal::Record &record, int priority) const
+    {
+      if ((record.flags & Journal::SUPPRESSED) || record.code >= NUM_CODES ||
+          !(mCodes[record.code >> 6] >> (record.code & 63) & 1))
+      {
+        return false;
+      }
+      if (mZones && (!record.zone || record.zone > MAX_ZONE ||
+                     !(mZones >> (record.zone - 1) & 1)))
+      {
+        return false;
+      }
+      if (mPartitions && (!record.partition ||
+                          record.partition > MAX_PARTITION ||
+                          !(mPartitions >> (record.partition - 1) & 1)))
+      {
+        return false;
+      }
+      return mPriority < 0 || (priority >= 0 && priority <= mPriority);
+    }
+
+  private:
+    uint64_t mCodes[(NUM_CODES + 63) / 64];
+    bool mAllCodes;
+    uint64_t mZones;
+    uint8_t mPartitions;
+    int mPriority;
+};
+
+#endif
@@ -0,0 +1,143 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+#include "Trace.h"
+
+#include <syslog.h>
+
+const char *
+Trace::getStageName(int stage)
+{
+  static const char *names[NUM_STAGES] =
+  {
+    "parse", "apply", "record", "action", "total", "client"
+  };
+  return (stage >= 0 && stage < NUM_STAGES) ? names[stage] : "";
+}
+
+Trace &
+Trace::getTrace()
+{
+  static Trace theTrace;
+  return theTrace;
+}
+
+Trace::Trace() : mFile(0), mSample(0), mCountdown(0), mFirst(true)
+{
+}
+
+Trace::~Trace()
+{
+  close();
+}
+
+bool
+Trace::open(const std::string &filename, int sample)
+{
+  close();
+  if (!filename.length()) { return false; }
+
+  mFile = fopen(filename.c_str(), "w");
+  if (!mFile)
+  {
+    perror(filename.c_str());
+    syslog(LOG_ERR, "Could not open trace file %s", filename.c_str());
+    return false;
+  }
+
+  // Plenty of buffer: sampled frames shouldn't mean a write() each
+  setvbuf(mFile, 0, _IOFBF, 65536);
+  mSample = sample > 0 ? sample : 1;
+  mCountdown = 0;
+  mFirst = true;
+
+  // The closing bracket is optional in this format, which is just as
+  // well for a file that's cut off when the daemon is killed
+  fputs("[\n", mFile);
+  return true;
+}
+
+void
+Trace::close()
+{
+  if (mFile)
+  {
+    fputs("\n]\n", mFile);
+    fclose(mFile);
+    mFile = 0;
+  }
+}
+
+bool
+Trace::sample()
+{
+  if (!mFile) { return false; }
+  if (mCountdown-- > 0) { return false; }
+  mCountdown = mSample - 1;
+  return true;
+}
+
+/**
+  One complete ("X") slice for the frame, with its stages nested
+  beneath it. Timestamps are in microseconds.
+*/
+void
+Trace::frame(int panel, const char *name, const uint64_t *stamps)
+{
+  if (!mFile) { return; }
+
+  fprintf(mFile, "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\","
+          "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":1}",
+          mFirst ? "" : ",\n", name, stamps[READ] / 1e3,
+          (stamps[NUM_STAMPS - 1] - stamps[READ]) / 1e3, panel);
+  mFirst = false;
+
+  for (int s = 0; s + 1 < NUM_STAMPS; s++)
+  {
+    fprintf(mFile, ",\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\","
+            "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":1}",
+            getStageName(s), stamps[s] / 1e3,
+            (stamps[s + 1] - stamps[s]) / 1e3, panel);
+  }
+}
+
+/**
+  A long-polling client got the keypad status that a traced frame
+  changed; shown on its own track, from the read to the write.
+*/
+void
+Trace::clientWoken(int panel, uint64_t read, uint64_t written)
+{
+  if (!mFile) { return; }
+
+  fprintf(mFile, "%s{\"name\":\"client\",\"cat\":\"client\",\"ph\":\"X\","
+          "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":2}",
+          mFirst ? "" : ",\n", read / 1e3, (written - read) / 1e3, panel);
+  mFirst = false;
+}
@@ -0,0 +1,89 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _TRACE_H
+#define _TRACE_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+/**
+  Timing of an inbound frame through the daemon, for working out where
+  the time goes between the serial line and a client's keypad.
+
+  Each frame is stamped when it is read, and again as it is parsed,
+  applied to the panel state, recorded and acted on. The differences
+  feed per-stage histograms (see It100). A sampled subset of frames is
+  also written out in the Chrome trace event format, which loads in
+  chrome://tracing and Perfetto: one slice per frame on the panel's
+  track, split into its stages, plus a slice for each long-polling
+  client woken by the frame.
+*/
+
+class Trace
+{
+  public:
+    // Stamps taken along the way, in order
+    enum stamp_t { READ, PARSED, STATE, RECORDED, ACTED, NUM_STAMPS };
+
+    // Per-stage histograms: the span between consecutive stamps,
+    // the whole frame, and read-to-client for long-poll wakeups
+    enum stage_t { PARSE, APPLY, RECORD, ACTION, TOTAL, CLIENT,
+                   NUM_STAGES };
+    static const char *getStageName(int stage);
+
+    static Trace &getTrace();
+
+    // Trace one frame in every sample to the named file
+    bool open(const std::string &filename, int sample);
+    void close();
+    void flush() { if (mFile) { fflush(mFile); } }
+    void setSample(int sample) { mSample = sample > 0 ? sample : 1; }
+    bool isOpen() const { return mFile != 0; }
+
+    // Decides whether the next frame is traced
+    bool sample();
+
+    void frame(int panel, const char *name, const uint64_t *stamps);
+    void clientWoken(int panel, uint64_t read, uint64_t written);
+
+  private:
+    Trace();
+    ~Trace();
+
+  private:
+    FILE *mFile;
+    int mSample;
+    int mCountdown;
+    bool mFirst;
+};
+
+#endif
@@ -0,0 +1,557 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#include "Transport.h"
+#include "Config.h"
+#include "Capture.h"
+#include "Log.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+
+Transport *
+Transport::create(int panel)
+{
+  Config &config = Config::getConfig();
+  std::string type = config.getTransport(panel);
+  std::string device = config.getDevice(panel);
+
+  if (type == "tcp") { return new TcpTransport(device); }
+  if (type == "pty") { return new PtyTransport(device); }
+  if (type == "replay")
+  {
+    return new ReplayTransport(device, config.getReplaySpeed(panel));
+  }
+  return new SerialTransport(device, config.getBaud(panel));
+}
+
+Transport::~Transport()
+{
+  close();
+}
+
+void
+Transport::close()
+{
+  if (mDescriptor >= 0)
+  {
+    ::close(mDescriptor);
+    mDescriptor = -1;
+  }
+  mConnecting = false;
+  mOutput.clear();
+}
+
+int
+Transport::read(char *buffer, size_t length)
+{
+  if (mDescriptor < 0) { return 0; }
+
+  int s = ::read(mDescriptor, buffer, length);
+  if (s > 0) { return s; }
+  if (s < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+  {
+    return -1;
+  }
+
+  // EOF, or a hard error such as EIO from an unplugged USB adapter.
+  // Either way, the descriptor is useless to us now.
+  Log::getLog().write(Log::SYSLOG, LOG_WARNING,
+                      "Lost connection to %s", mName.c_str());
+  close();
+  return 0;
+}
+
+/**
+  Sends what the device will take now and keeps the rest for flush().
+  Commands are tiny, so a backlog past MAX_OUTPUT means the device has
+  stopped reading altogether.
+*/
+int
+Transport::write(const char *buffer, size_t length)
+{
+  if (mDescriptor < 0 || mConnecting) { return -1; }
+
+  mOutput.append(buffer, length);
+  if (!flush()) { return -1; }
+  if (mOutput.length() > MAX_OUTPUT)
+  {
+    Log::getLog().write(Log::SYSLOG, LOG_WARNING,
+                        "%s isn't taking any output", mName.c_str());
+    close();
+    return -1;
+  }
+  return length;
+}
+
+/**
+  Write as much of the held output as the device will take without
+  blocking. False (and the transport closed) on a hard error.
+*/
+bool
+Transport::flush()
+{
+  while (mOutput.length() && mDescriptor >= 0)
+  {
+    int s = ::write(mDescriptor, mOutput.data(), mOutput.length());
+    if (s < 0)
+    {
+      if (errno == EINTR) { continue; }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) { return true; }
+      Log::getLog().write(Log::SYSLOG, LOG_WARNING,
+                          "Write to %s failed", mName.c_str());
+      close();
+      return false;
+    }
+    mOutput.erase(0, s);
+  }
+  return true;
+}
+
+void
+Transport::setNonBlocking()
+{
+  int flags = fcntl(mDescriptor, F_GETFL, 0);
+  fcntl(mDescriptor, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* ***************************************************************************
+  Serial port
+*************************************************************************** */
+
+SerialTransport::SerialTransport(const std::string &device, int baud)
+  : Transport(device), mBaud(baud)
+{
+}
+
+bool
+SerialTransport::open()
+{
+  close();
+  mDescriptor = ::open(mName.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (mDescriptor < 0)
+  {
+    return false;
+  }
+
+  speed_t speed;
+  switch (mBaud)
+  {
+    case 9600: speed = B9600; break;
+    case 19200: speed = B19200; break;
+    case 38400: speed = B38400; break;
+    case 57600: speed = B57600; break;
+    case 115200: speed = B115200; break;
+    default:
+      // Config::validate() turns away anything else that's set
+      speed = B9600;
+  }
+
+  // TODO -- make sure the IT-100 is set to the selected speed
+  struct termios desc;
+  tcgetattr(mDescriptor, &desc);
+  cfmakeraw(&desc);
+  desc.c_cflag |= (CLOCAL | CREAD);
+  cfsetspeed(&desc, speed);
+  tcsetattr(mDescriptor, TCSANOW, &desc);
+
+  return true;
+}
+
+/* ***************************************************************************
+  TCP serial server
+*************************************************************************** */
+
+TcpTransport::TcpTransport(const std::string &address)
+  : Transport(address), mAddresses(0), mNextAddress(0), mConnectStarted(0)
+{
+  std::string::size_type colon = address.rfind(':');
+  if (colon != std::string::npos)
+  {
+    mHost = address.substr(0, colon);
+    mPort = address.substr(colon + 1);
+  }
+  else
+  {
+    mHost = address;
+    mPort = "4999";
+  }
+}
+
+/**
+  Start a non-blocking connect; finishOpen() carries on from there.
+*/
+bool
+TcpTransport::open()
+{
+  close();
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(mHost.c_str(), mPort.c_str(), &hints, &mAddresses))
+  {
+    mAddresses = 0;
+    return false;
+  }
+  mNextAddress = mAddresses;
+  return connectNext();
+}
+
+void
+TcpTransport::close()
+{
+  if (mAddresses)
+  {
+    freeaddrinfo(mAddresses);
+    mAddresses = 0;
+    mNextAddress = 0;
+  }
+  Transport::close();
+}
+
+/**
+  Start connecting to the next address, skipping those that fail
+  straight away. False once there are none left.
+*/
+bool
+TcpTransport::connectNext()
+{
+  while (mNextAddress)
+  {
+    struct addrinfo *ai = mNextAddress;
+    mNextAddress = ai->ai_next;
+
+    mDescriptor = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (mDescriptor < 0) { continue; }
+    setNonBlocking();
+
+    if (connect(mDescriptor, ai->ai_addr, ai->ai_addrlen) == 0)
+    {
+      connected();
+      return true;
+    }
+    if (errno == EINPROGRESS)
+    {
+      mConnecting = true;
+      mConnectStarted = time(0);
+      return true;
+    }
+    ::close(mDescriptor);
+    mDescriptor = -1;
+  }
+  close();
+  return false;
+}
+
+void
+TcpTransport::connected()
+{
+  mConnecting = false;
+  freeaddrinfo(mAddresses);
+  mAddresses = 0;
+  mNextAddress = 0;
+
+  int one = 1;
+  setsockopt(mDescriptor, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  setsockopt(mDescriptor, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+}
+
+/**
+  The connect is done when the socket turns writable; a bridge that
+  never answers gets CONNECT_TIMEOUT seconds before we move on.
+*/
+int
+TcpTransport::finishOpen(bool writable)
+{
+  if (!mConnecting) { return mDescriptor >= 0 ? 1 : -1; }
+
+  int err = 0;
+  if (writable)
+  {
+    socklen_t len = sizeof(err);
+    if (getsockopt(mDescriptor, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+    {
+      err = errno;
+    }
+  }
+  else if (time(0) - mConnectStarted >= CONNECT_TIMEOUT)
+  {
+    err = ETIMEDOUT;
+  }
+  else
+  {
+    return 0;
+  }
+
+  if (!err)
+  {
+    connected();
+    return 1;
+  }
+
+  ::close(mDescriptor);
+  mDescriptor = -1;
+  mConnecting = false;
+  if (!connectNext()) { return -1; }
+  return mConnecting ? 0 : 1;
+}
+
+/* ***************************************************************************
+  Pseudo-terminal
+*************************************************************************** */
+
+PtyTransport::PtyTransport(const std::string &link)
+  : Transport(link), mSlave(-1)
+{
+}
+
+bool
+PtyTransport::open()
+{
+  close();
+
+  mDescriptor = posix_openpt(O_RDWR | O_NOCTTY);
+  if (mDescriptor < 0) { return false; }
+
+  if (grantpt(mDescriptor) || unlockpt(mDescriptor) || !ptsname(mDescriptor))
+  {
+    close();
+    return false;
+  }
+  std::string slave = ptsname(mDescriptor);
+
+  // We keep a slave descriptor of our own open; otherwise the master
+  // reports EIO whenever the peer isn't attached.
+  mSlave = ::open(slave.c_str(), O_RDWR | O_NOCTTY);
+  if (mSlave >= 0)
+  {
+    struct termios desc;
+    tcgetattr(mSlave, &desc);
+    cfmakeraw(&desc);
+    tcsetattr(mSlave, TCSANOW, &desc);
+  }
+  setNonBlocking();
+
+  // Only ever replace a symlink; never clobber a real device node
+  struct stat st;
+  if (lstat(mName.c_str(), &st) == 0 && S_ISLNK(st.st_mode))
+  {
+    unlink(mName.c_str());
+  }
+  if (symlink(slave.c_str(), mName.c_str()))
+  {
+    syslog(LOG_WARNING, "Could not link %s to %s",
+           mName.c_str(), slave.c_str());
+  }
+
+  return true;
+}
+
+void
+PtyTransport::close()
+{
+  if (mSlave >= 0)
+  {
+    ::close(mSlave);
+    mSlave = -1;
+  }
+  Transport::close();
+}
+
+/* ***************************************************************************
+  Capture replay
+*************************************************************************** */
+
+ReplayTransport::ReplayTransport(const std::string &filename, double speed)
+  : Transport(filename), mSpeed(speed), mChild(-1), mFinished(false)
+{
+}
+
+/**
+  The capture is fed through a pipe by a child process, so the event
+  loop sees an ordinary readable descriptor and the timing doesn't
+  depend on how often we get around to select().
+
+  The log writer thread doesn't survive the fork, so the child must not
+  allocate or touch stdio: the capture is read here, into one buffer of
+  frames and their due times, and the child only sleeps and writes.
+*/
+bool
+ReplayTransport::open()
+{
+  if (mFinished) { return false; }
+  close();
+
+  Capture capture;
+  if (!capture.open(mName))
+  {
+    mFinished = true;
+    return false;
+  }
+
+  std::string frames;
+  std::vector<uint64_t> due;
+  std::vector<size_t> ends;
+  Capture::Record r;
+  while (capture.next(r))
+  {
+    if (r.direction != Capture::INBOUND) { continue; }
+    frames += r.frame;
+    frames += "\r\n";
+    ends.push_back(frames.length());
+    due.push_back(mSpeed > 0 ? (uint64_t)(r.offset / mSpeed) : 0);
+  }
+  long maxDescriptor = sysconf(_SC_OPEN_MAX);
+  if (maxDescriptor < 0) { maxDescriptor = 1024; }
+
+  int fds[2];
+  if (pipe(fds))
+  {
+    return false;
+  }
+
+  mChild = fork();
+  if (mChild == 0)
+  {
+    play(fds[1], maxDescriptor, frames, due, ends);
+    _exit(0);
+  }
+
+  ::close(fds[1]);
+  if (mChild < 0)
+  {
+    ::close(fds[0]);
+    return false;
+  }
+
+  mDescriptor = fds[0];
+  setNonBlocking();
+  return true;
+}
+
+/** In the child: async-signal-safe calls only */
+void
+ReplayTransport::play(int descriptor, int maxDescriptor,
+                      const std::string &frames,
+                      const std::vector<uint64_t> &due,
+                      const std::vector<size_t> &ends)
+{
+  // Nothing of the daemon's but our end of the pipe
+  for (int fd = 3; fd < maxDescriptor; fd++)
+  {
+    if (fd != descriptor) { ::close(fd); }
+  }
+
+  uint64_t start = Capture::now();
+  size_t begin = 0;
+  for (size_t i = 0; i < ends.size(); i++)
+  {
+    uint64_t t;
+    while ((t = Capture::now()) < start + due[i])
+    {
+      struct timespec ts;
+      ts.tv_sec = (start + due[i] - t) / 1000000000ULL;
+      ts.tv_nsec = (start + due[i] - t) % 1000000000ULL;
+      nanosleep(&ts, 0);
+    }
+
+    if (::write(descriptor, frames.data() + begin, ends[i] - begin) < 0)
+    {
+      return;
+    }
+    begin = ends[i];
+  }
+}
+
+void
+ReplayTransport::close()
+{
+  if (mChild > 0)
+  {
+    kill(mChild, SIGTERM);
+    waitpid(mChild, 0, 0);
+    mChild = -1;
+  }
+  Transport::close();
+}
+
+/**
+  The end of the pipe is the end of the capture, which isn't a lost
+  connection; only a real error is reported as one.
+*/
+int
+ReplayTransport::read(char *buffer, size_t length)
+{
+  if (mDescriptor < 0) { return 0; }
+
+  int s = ::read(mDescriptor, buffer, length);
+  if (s > 0) { return s; }
+  if (s < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+  {
+    return -1;
+  }
+
+  if (s == 0)
+  {
+    Log::getLog().write(Log::SYSLOG, LOG_NOTICE,
+                        "Replay of %s complete", mName.c_str());
+  }
+  else
+  {
+    Log::getLog().write(Log::SYSLOG, LOG_WARNING,
+                        "Replay of %s failed", mName.c_str());
+  }
+  mFinished = true;
+  close();
+  return 0;
+}
+
+int
+ReplayTransport::write(const char *, size_t length)
+{
+  return isOpen() ? length : -1;
+}
@@ -0,0 +1,192 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _TRANSPORT_H
+#define _TRANSPORT_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <time.h>
+
+struct addrinfo;
+
+/**
+  Byte stream to and from an IT-100. The It100 class handles framing
+  and everything above it; a Transport only moves bytes, so the same
+  daemon can talk to a local serial port, a serial-over-IP bridge, or
+  a pseudo-terminal with a stand-in panel on the other end.
+
+  All transports are non-blocking. read() returns 0 when the far end
+  has gone away, after which the transport is closed and the owner is
+  expected to call open() again at its leisure.
+
+  open() may only start the job: while isConnecting(), the owner waits
+  for the descriptor to be writable and calls finishOpen() each time
+  around the event loop until it says the link is up or has failed.
+  Whatever write() can't hand over at once is kept until the device
+  drains, signalled the same way by wantsWrite() and flush().
+*/
+
+class Transport
+{
+  public:
+    // Builds the transport configured for the given panel
+    static Transport *create(int panel);
+
+    virtual ~Transport();
+
+    virtual bool open() = 0;
+    virtual void close();
+
+    // 1 once connected, 0 while still going, -1 if it failed
+    virtual int finishOpen(bool writable) { (void)writable; return 1; }
+
+    virtual int read(char *buffer, size_t length);
+    virtual int write(const char *buffer, size_t length);
+    bool flush();
+
+    int getDescriptor() const { return mDescriptor; }
+    bool isOpen() const { return mDescriptor >= 0 && !mConnecting; }
+    bool isConnecting() const { return mConnecting; }
+    bool wantsWrite() const { return mConnecting || mOutput.length() > 0; }
+    virtual bool isFinished() const { return false; }
+    const std::string &getName() const { return mName; }
+
+  protected:
+    Transport(const std::string &name)
+      : mDescriptor(-1), mConnecting(false), mName(name) {;}
+
+    void setNonBlocking();
+
+  protected:
+    // Unwritten output past this means the device has stopped reading
+    enum { MAX_OUTPUT = 4096 };
+
+    int mDescriptor;
+    bool mConnecting;
+    std::string mName;
+    std::string mOutput;
+};
+
+/**
+  Local serial port (e.g., a USB serial adapter)
+*/
+
+class SerialTransport : public Transport
+{
+  public:
+    SerialTransport(const std::string &device, int baud);
+    virtual bool open();
+
+  private:
+    int mBaud;
+};
+
+/**
+  Raw TCP connection to a serial server (ser2net and friends), given
+  as "host:port". The connect finishes from the event loop, trying each
+  address the host has in turn. The name is looked up synchronously, so
+  an address is the better choice if DNS might be slow.
+*/
+
+class TcpTransport : public Transport
+{
+  public:
+    TcpTransport(const std::string &address);
+    virtual ~TcpTransport() { close(); }
+    virtual bool open();
+    virtual void close();
+    virtual int finishOpen(bool writable);
+
+  private:
+    enum { CONNECT_TIMEOUT = 5 };
+
+    bool connectNext();
+    void connected();
+
+  private:
+    std::string mHost;
+    std::string mPort;
+    struct addrinfo *mAddresses;
+    struct addrinfo *mNextAddress;
+    time_t mConnectStarted;
+};
+
+/**
+  Pseudo-terminal. We hold the master side and publish the slave's
+  name as a symlink at the configured path, where an emulator or test
+  harness can open it as if it were a serial port.
+*/
+
+class PtyTransport : public Transport
+{
+  public:
+    PtyTransport(const std::string &link);
+    virtual ~PtyTransport() { close(); }
+    virtual bool open();
+    virtual void close();
+
+  private:
+    int mSlave;
+};
+
+/**
+  Plays back the inbound side of a capture file (see Capture.h), at the
+  original timing, scaled by a speed factor, or as fast as possible
+  when the speed is 0. Anything we send is discarded. Once the capture
+  runs out, the transport stays closed for good.
+*/
+
+class ReplayTransport : public Transport
+{
+  public:
+    ReplayTransport(const std::string &filename, double speed);
+    virtual ~ReplayTransport() { close(); }
+    virtual bool open();
+    virtual void close();
+    virtual int read(char *buffer, size_t length);
+    virtual int write(const char *buffer, size_t length);
+    virtual bool isFinished() const { return mFinished; }
+
+  private:
+    void play(int descriptor, int maxDescriptor, const std::string &frames,
+              const std::vector<uint64_t> &due,
+              const std::vector<size_t> &ends);
+
+  private:
+    double mSpeed;
+    pid_t mChild;
+    bool mFinished;
+};
+
+#endif
@@ -0,0 +1,90 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _ZONE_STATE_H
+#define _ZONE_STATE_H 1
+
+#include <stdint.h>
+
+/**
+  What we know about a panel's zones, as bitmasks with zone N in bit
+  N-1, together with the zones that belong to each partition. Asking
+  about one partition is then a single AND, and counting zones a single
+  popcount.
+
+  Plain data with no constructor, so that it can live in the state
+  file along with the rest of the panel state.
+*/
+
+struct ZoneState
+{
+  enum condition_t { OPEN, ALARM, TAMPER, FAULT, BYPASS, NUM_CONDITIONS };
+  enum { NUM_ZONES = 64, NUM_PARTITIONS = 8 };
+
+  uint64_t mask[NUM_CONDITIONS];
+
+  // Zones in partition N are at [N]; [0] is unused
+  uint64_t members[NUM_PARTITIONS + 1];
+
+  static uint64_t bit(int zone)
+    { return (zone < 1 || zone > NUM_ZONES) ? 0 : (uint64_t)1 << (zone - 1); }
+
+  void set(condition_t condition, int zone, bool on)
+  {
+    if (on) { mask[condition] |= bit(zone); }
+    else { mask[condition] &= ~bit(zone); }
+  }
+
+  void join(int partition, int zone)
+  {
+    if (partition >= 1 && partition <= NUM_PARTITIONS)
+    {
+      members[partition] |= bit(zone);
+    }
+  }
+
+  // Partition 0 stands for every zone
+  uint64_t getMembers(int partition) const
+  {
+    if (partition >= 1 && partition <= NUM_PARTITIONS)
+    {
+      return members[partition];
+    }
+    return ~(uint64_t)0;
+  }
+
+  uint64_t get(condition_t condition, int partition = 0) const
+    { return mask[condition] & getMembers(partition); }
+
+  int count(condition_t condition, int partition = 0) const
+    { return __builtin_popcountll(get(condition, partition)); }
+};
+
+#endif
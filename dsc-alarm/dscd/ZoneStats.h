@@ -0,0 +1,72 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _ZONE_STATS_H
+#define _ZONE_STATS_H 1
+
+#include <stdint.h>
+
+/**
+  Running activity figures for each zone: how often it has opened, how
+  long it has spent open, when it last changed and at what hours of
+  the day it opens. Updated in constant time as zones open and close,
+  and kept in the state file (so time the daemon spent down while a
+  zone was open is counted as open).
+
+  Times are ns since the epoch; the hour is local time.
+*/
+
+struct ZoneStats
+{
+  enum { NUM_ZONES = 64, HOURS = 24 };
+
+  struct Zone
+  {
+    uint64_t opens;
+    uint64_t openTime;      // closed spells only; add the current one
+    uint64_t lastChange;
+    uint32_t hourly[HOURS]; // opens by hour of day
+  };
+
+  Zone zone[NUM_ZONES];
+
+  // Call on changes only, not repeated reports of the same state
+  void changed(int zone, bool open, uint64_t now);
+
+  // How long the zone has been open, if it is
+  uint64_t getOpenFor(int zone, bool open, uint64_t now) const
+  {
+    const Zone &z = this->zone[zone - 1];
+    return (open && z.lastChange && now > z.lastChange) ?
+           now - z.lastChange : 0;
+  }
+};
+
+#endif
@@ -0,0 +1,512 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+/**
+  Microbenchmarks for the paths every panel frame goes through. Each
+  benchmark is run for long enough to get a stable figure, and reports
+  the time and the number of heap allocations per operation:
+
+    dscbench [-v] [-t seconds] [name...]
+
+  Only benchmarks whose names contain one of the given strings are
+  run. -v adds a line per command type for the per-frame benchmarks.
+*/
+
+#include "Command.h"
+#include "CommandProcessor.h"
+#include "Config.h"
+#include "It100.h"
+#include "Capture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* ***************************************************************************
+  Allocation counting
+*************************************************************************** */
+
+static unsigned long long gAllocations = 0;
+
+void *
+operator new(size_t size)
+{
+  gAllocations++;
+  void *p = malloc(size ? size : 1);
+  if (!p) { throw std::bad_alloc(); }
+  return p;
+}
+
+void *
+operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void
+operator delete(void *p)
+{
+  free(p);
+}
+
+void
+operator delete[](void *p)
+{
+  free(p);
+}
+
+/* ***************************************************************************
+  Harness
+*************************************************************************** */
+
+typedef void (*bench_t)(void *context, unsigned long iterations);
+
+static double gSeconds = 0.5;
+static bool gVerbose = false;
+static std::vector<std::string> gPatterns;
+
+static bool
+selected(const std::string &name)
+{
+  if (gPatterns.empty()) { return true; }
+  for (size_t i = 0; i < gPatterns.size(); i++)
+  {
+    if (name.find(gPatterns[i]) != std::string::npos) { return true; }
+  }
+  return false;
+}
+
+/**
+  Runs a benchmark with growing iteration counts until one pass takes
+  at least the target time, then reports that pass. Each operation is
+  one call of the benchmark body; "per" is how many units of work an
+  operation covers (frames, codes), and the figures are divided by it.
+*/
+static void
+run(const std::string &name, bench_t bench, void *context, int per = 1)
+{
+  if (!selected(name)) { return; }
+
+  uint64_t target = (uint64_t)(gSeconds * 1e9);
+  unsigned long iterations = 1;
+  uint64_t elapsed;
+  unsigned long long allocations;
+  bench(context, 1);   // warm up caches and lazy registrations
+  for (;;)
+  {
+    allocations = gAllocations;
+    uint64_t start = Capture::now();
+    bench(context, iterations);
+    elapsed = Capture::now() - start;
+    allocations = gAllocations - allocations;
+
+    if (elapsed >= target || iterations >= 1000000000UL) { break; }
+    // Aim a little past the target so the last pass is the long one
+    double scale = elapsed ? (double)target * 1.2 / elapsed : 100;
+    if (scale > 100) { scale = 100; }
+    if (scale < 2) { scale = 2; }
+    iterations = (unsigned long)(iterations * scale);
+  }
+
+  double ops = (double)iterations * per;
+  printf("%-40s %12.0f %12.1f ns/op %8.2f allocs/op\n", name.c_str(), ops,
+         elapsed / ops, allocations / ops);
+  fflush(stdout);
+}
+
+/* ***************************************************************************
+  Fixtures
+*************************************************************************** */
+
+/** Gets at the registry of command types, which is protected */
+class Registry : public Command
+{
+  public:
+    static std::vector<int> codes()
+    {
+      std::vector<int> result;
+      std::map<int,creator_t>::iterator i;
+      for (i = creators().begin(); i != creators().end(); i++)
+      {
+        result.push_back(i->first);
+      }
+      return result;
+    }
+};
+
+/** A plausible payload for each command the panel can send or receive */
+static std::string
+samplePayload(int code)
+{
+  switch (code)
+  {
+    case Command::POLL:
+    case Command::STATUS_REQUEST:
+    case Command::LABELS_REQUEST:
+    case Command::COMMAND_ERROR:
+    case Command::RING_DETECTED:
+    case Command::BUFFER_NEAR_FULL:
+      return "";
+    case Command::SET_TIME_AND_DATE:
+    case Command::TIME_DATE_BROADCAST:
+      return "2130101926";
+    case Command::PARTITION_ARM_CONTROL_WITH_CODE:
+    case Command::PARTITION_DISARM_CONTROL_WITH_CODE:
+      return "1123456";
+    case Command::KEY_PRESSED:
+      return "5";
+    case Command::CODE_SEND:
+      return "123456";
+    case Command::COMMAND_ACKNOWLEDGE:
+      return "070";
+    case Command::SYSTEM_ERROR:
+      return "023";
+    case Command::THERMOSTAT_SET_POINTS:
+      return "01068072";
+    case Command::BROADCAST_LABELS:
+      return "001Front Door                      ";
+    case Command::LCD_UPDATE:
+      return "10016System is Ready ";
+    case Command::LCD_CURSOR:
+      return "2100";
+    case Command::BYPASSED_ZONES_BITFIELD_DUMP:
+      return "0500000000000080";
+    case Command::LED_STATUS:
+      return "11";
+    case Command::SOFTWARE_VERSION:
+      return "040200";
+    case Command::TIME_STAMP_CONTROL:
+    case Command::TIME_DATE_BROADCAST_CONTROL:
+    case Command::TEMPERATURE_BROADCAST_CONTROL:
+    case Command::VIRTUAL_KEYPAD_CONTROL:
+    case Command::TRIGGER_PANIC_ALARM:
+    case Command::BAUD_RATE_CHANGE:
+    case Command::BAUD_RATE_SET:
+      return "1";
+    default:
+      // Partition and zone, which is what most events carry
+      return "1005";
+  }
+}
+
+static std::string
+withChecksum(const std::string &frame)
+{
+  unsigned char checksum = 0;
+  for (size_t i = 0; i < frame.length(); i++) { checksum += frame[i]; }
+  char hex[3];
+  snprintf(hex, sizeof(hex), "%02X", checksum);
+  return frame + hex;
+}
+
+struct Fixture
+{
+  It100 *it100;
+  std::vector<std::string> frames;
+  std::vector<Command*> commands;
+  CommandProcessor *processor;
+  int client;
+};
+
+/* ***************************************************************************
+  Benchmarks
+*************************************************************************** */
+
+static void
+benchMakeCommand(void *context, unsigned long n)
+{
+  Fixture &f = *(Fixture*)context;
+  for (unsigned long i = 0; i < n; i++)
+  {
+    for (size_t j = 0; j < f.frames.size(); j++)
+    {
+      delete Command::makeCommand(*f.it100, f.frames[j]);
+    }
+  }
+}
+
+struct One
+{
+  Fixture *fixture;
+  size_t index;
+};
+
+static void
+benchMakeOne(void *context, unsigned long n)
+{
+  One &o = *(One*)context;
+  for (unsigned long i = 0; i < n; i++)
+  {
+    delete Command::makeCommand(*o.fixture->it100,
+                                o.fixture->frames[o.index]);
+  }
+}
+
+static void
+benchDump(void *context, unsigned long n)
+{
+  Fixture &f = *(Fixture*)context;
+  std::ostringstream out;
+  for (unsigned long i = 0; i < n; i++)
+  {
+    for (size_t j = 0; j < f.commands.size(); j++)
+    {
+      out.str(std::string());
+      f.commands[j]->dump(out);
+    }
+  }
+}
+
+static void
+benchFormat(void *context, unsigned long n)
+{
+  Fixture &f = *(Fixture*)context;
+  char text[256];
+  for (unsigned long i = 0; i < n; i++)
+  {
+    for (size_t j = 0; j < f.commands.size(); j++)
+    {
+      f.commands[j]->format(text, sizeof(text));
+    }
+  }
+}
+
+static void
+benchShellAction(void *context, unsigned long n)
+{
+  Command *c = (Command*)context;
+  for (unsigned long i = 0; i < n; i++)
+  {
+    c->getShellAction();
+  }
+}
+
+static volatile int gSink;
+
+static void
+benchSyslogPriority(void *context, unsigned long n)
+{
+  Config &config = Config::getConfig();
+  int sum = 0;
+  for (unsigned long i = 0; i < n; i++)
+  {
+    for (int code = 0; code < 1000; code++)
+    {
+      sum += config.getSyslogPriority(code);
+    }
+  }
+  gSink = sum;
+}
+
+static void
+benchEventAction(void *context, unsigned long n)
+{
+  Config &config = Config::getConfig();
+  int sum = 0;
+  for (unsigned long i = 0; i < n; i++)
+  {
+    for (int code = 0; code < 1000; code++)
+    {
+      sum += config.getEventAction(code).length();
+    }
+  }
+  gSink = sum;
+}
+
+// Every configured rule against a ZONE_OPEN, as runRules() does
+static void
+benchRules(void *context, unsigned long n)
+{
+  It100 *it100 = (It100*)context;
+  const std::vector<Rule> &rules = Config::getConfig().getRules();
+  Journal::Record record;
+  memset(&record, 0, sizeof(record));
+  record.time = Journal::now();
+  record.code = 609;
+  record.panel = 1;
+  record.zone = 5;
+  int sum = 0;
+  for (unsigned long i = 0; i < n; i++)
+  {
+    for (size_t r = 0; r < rules.size(); r++)
+    {
+      sum += rules[r].matches(record, LOG_WARNING, *it100);
+    }
+  }
+  gSink = sum;
+}
+
+static void
+benchZoneStatus(void *context, unsigned long n)
+{
+  It100 *it100 = (It100*)context;
+  uint64_t sum = 0;
+  for (unsigned long i = 0; i < n; i++)
+  {
+    sum += it100->getZoneStatus();
+  }
+  gSink = (int)sum;
+}
+
+static void
+benchKeypadStatus(void *context, unsigned long n)
+{
+  Fixture &f = *(Fixture*)context;
+  char reply[512];
+  for (unsigned long i = 0; i < n; i++)
+  {
+    write(f.client, "?\n", 2);
+    f.processor->process();
+    read(f.client, reply, sizeof(reply));
+  }
+}
+
+/* ***************************************************************************
+  Setup
+*************************************************************************** */
+
+static const char *CONFIG =
+  "[main]\n"
+  "transport = pty\n"
+  "device = %s\n"
+  "state_file =\n"
+  "journal_dir =\n"
+  "capture_file =\n"
+  "[syslog]\n"
+  "facility = LOCAL2\n"
+  "ZONE_ALARM = EMERG\n"
+  "ZONE_OPEN = WARNING\n"
+  "LCD_UPDATE = NONE\n"
+  "[actions]\n"
+  "ZONE_ALARM = echo \"Alarm: %%2s\" | /usr/bin/mail -s "
+    "\"[dscd] Alarm: %%2s\" root\n"
+  "ZONE_OPEN = logger -t dscd \"%%c (%%n) on panel %%{panel}: zone %%2i, "
+    "%%2s; open zones %%z; ready %%1l armed %%2l; %%d\"\n"
+  "[zones]\n"
+  "5 = Front Door\n"
+  "[rules]\n"
+  "chime = ZONE_OPEN zone=5,6 disarmed=1 -> log %%2s opened\n"
+  "night = ZONE_OPEN time=22:00-06:00 closed=1,2 -> command 0301\n"
+  "alarm = class=alarm priority=CRIT -> journal %%c\n";
+
+static void
+usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-v] [-t seconds] [name...]\n", name);
+  exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "vt:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'v': gVerbose = true; break;
+      case 't': gSeconds = strtod(optarg, 0); break;
+      default: usage(argv[0]);
+    }
+  }
+  for (int i = optind; i < argc; i++) { gPatterns.push_back(argv[i]); }
+
+  // A throwaway configuration with a few realistic actions, and a
+  // panel on a pty nobody reads from
+  char configFile[] = "/tmp/dscbench-XXXXXX";
+  int fd = mkstemp(configFile);
+  if (fd < 0) { perror("mkstemp"); return 1; }
+  std::string device = std::string(configFile) + ".pty";
+  FILE *file = fdopen(fd, "w");
+  fprintf(file, CONFIG, device.c_str());
+  fclose(file);
+
+  Config::getConfig(configFile);
+  Fixture f;
+  f.it100 = new It100(1);
+
+  std::vector<int> codes = Registry::codes();
+  for (size_t i = 0; i < codes.size(); i++)
+  {
+    char code[4];
+    snprintf(code, sizeof(code), "%03d", codes[i]);
+    f.frames.push_back(withChecksum(code + samplePayload(codes[i])));
+    f.commands.push_back(Command::makeCommand(*f.it100, f.frames.back()));
+  }
+
+  int sockets[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+  std::vector<It100*> panels(1, f.it100);
+  f.processor = new CommandProcessor(sockets[0], panels);
+  f.client = sockets[1];
+
+  printf("%-40s %12s %12s %18s\n", "benchmark", "ops", "time", "allocations");
+
+  run("Command::makeCommand", benchMakeCommand, &f, f.frames.size());
+  if (gVerbose)
+  {
+    for (size_t i = 0; i < f.frames.size(); i++)
+    {
+      One one = {&f, i};
+      char name[64];
+      snprintf(name, sizeof(name), "Command::makeCommand/%03d", codes[i]);
+      run(name, benchMakeOne, &one);
+    }
+  }
+  run("Command::dump", benchDump, &f, f.commands.size());
+  run("Command::format", benchFormat, &f, f.commands.size());
+
+  Command *zoneAlarm = Command::makeCommand(*f.it100,
+                                            withChecksum("6011005"));
+  Command *zoneOpen = Command::makeCommand(*f.it100,
+                                           withChecksum("609005"));
+  Command *lcd = Command::makeCommand(*f.it100,
+                                      withChecksum("90110016System is Ready "));
+  run("Command::getShellAction/mail", benchShellAction, zoneAlarm);
+  run("Command::getShellAction/all", benchShellAction, zoneOpen);
+  run("Command::getShellAction/none", benchShellAction, lcd);
+
+  run("Config::getSyslogPriority", benchSyslogPriority, 0, 1000);
+  run("Config::getEventAction", benchEventAction, 0, 1000);
+  run("Rule::matches", benchRules, f.it100);
+  run("It100::getZoneStatus", benchZoneStatus, f.it100);
+  run("CommandProcessor::sendKeypadStatus", benchKeypadStatus, &f);
+
+  delete f.processor;
+  delete f.it100;
+  unlink(configFile);
+  unlink(device.c_str());
+  return 0;
+}
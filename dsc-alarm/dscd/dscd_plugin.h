@@ -0,0 +1,174 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _DSCD_PLUGIN_H
+#define _DSCD_PLUGIN_H 1
+
+/*
+  Interface for action plugins: shared objects that dscd loads at
+  startup from the [plugins] section and calls, in-process, for every
+  event it would run [actions] for. This header is plain C and is the
+  whole of the interface; plugins don't need (or get) any of dscd's
+  C++ classes.
+
+  A plugin exports one function, dscd_plugin(), returning a static
+  description of itself. dscd checks its abi against DSCD_PLUGIN_ABI,
+  calls open() once with the rest of the plugin's configuration line,
+  then event() for each event and close() on the way out. Everything
+  happens on dscd's event loop thread, so a plugin must not block: hand
+  slow work to a thread of its own.
+
+  The dscd_host functions, log() included, are only safe on that same
+  thread, from inside open(), event() or close(): none of them lock
+  anything. A plugin's own threads must copy what they need out of the
+  event first, and report back through the plugin rather than the host.
+
+  Events and state are passed as views of dscd's own memory rather
+  than copies, and are only valid for the duration of the call.
+  Strings in a dscd_view are not NUL-terminated.
+
+  The ABI only grows: new fields go at the end of these structures and
+  new host functions after the last one, and a plugin may rely on
+  those present in the DSCD_PLUGIN_ABI it was built against. The
+  number changes only when something incompatible does, and dscd then
+  refuses plugins built for another one.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DSCD_PLUGIN_ABI 1
+#define DSCD_PLUGIN_SYMBOL "dscd_plugin"
+
+struct dscd_view
+{
+  const char *data;
+  size_t length;
+};
+
+/* flags */
+#define DSCD_EVENT_SUPPRESSED 1
+
+struct dscd_event
+{
+  uint64_t time;                /* ns since the epoch */
+  uint32_t etag;                /* keypad etag after the event */
+  uint16_t code;                /* IT-100 command code */
+  uint8_t panel;
+  uint8_t zone;                 /* 0 if the event isn't about one */
+  uint8_t partition;            /* 0 if the event isn't about one */
+  uint8_t flags;
+  const char *name;             /* as in [actions]; static */
+  struct dscd_view data;        /* raw parameters, after the code */
+  struct dscd_view names[2];    /* resolved zone, partition, user... */
+};
+
+/* Zone conditions, for dscd_host.zones() */
+enum
+{
+  DSCD_ZONE_OPEN, DSCD_ZONE_ALARM, DSCD_ZONE_TAMPER, DSCD_ZONE_FAULT,
+  DSCD_ZONE_BYPASS
+};
+
+/* Partition states, as in the "partitions" query */
+enum
+{
+  DSCD_PARTITION_UNKNOWN, DSCD_PARTITION_READY, DSCD_PARTITION_NOT_READY,
+  DSCD_PARTITION_EXIT_DELAY, DSCD_PARTITION_ARMED_STAY,
+  DSCD_PARTITION_ARMED_AWAY, DSCD_PARTITION_ENTRY_DELAY,
+  DSCD_PARTITION_ALARM, DSCD_PARTITION_BUSY
+};
+
+struct dscd_partition
+{
+  int state;
+  int ready;
+  int arm_mode;                 /* 0 away, 1 stay, 2-3 without delay */
+  int user;                     /* who last armed or disarmed it */
+  uint32_t since;               /* time() of the last change */
+};
+
+/* The panel an event came from; only dscd_host functions look inside */
+struct dscd_panel;
+
+struct dscd_host
+{
+  uint32_t abi;
+
+  /* Console and syslog, at a syslog priority */
+  void (*log)(int priority, const char *message);
+
+  int (*panel_number)(const struct dscd_panel *panel);
+
+  /* Zone N in bit N-1; partition 0 for the whole panel */
+  uint64_t (*zones)(const struct dscd_panel *panel, int condition,
+                    int partition);
+
+  /* Partitions 1-8; 0 if there's no such partition */
+  int (*partition)(const struct dscd_panel *panel, int partition,
+                   struct dscd_partition *state);
+
+  /* The keypad's two 16-character lines, as one view */
+  struct dscd_view (*lcd)(const struct dscd_panel *panel);
+
+  /* LEDs 1-9 (ready, armed, memory, bypass, trouble, program, fire,
+     backlight, AC): 0 off, 1 on, 2 flashing */
+  int (*led)(const struct dscd_panel *panel, int led);
+
+  /* Whether partition 1-8 is armed. A partition in
+     DSCD_PARTITION_ALARM needn't be: fire and 24 hour zones go off
+     whatever the arming. */
+  int (*armed)(const struct dscd_panel *panel, int partition);
+};
+
+struct dscd_plugin
+{
+  uint32_t abi;                 /* DSCD_PLUGIN_ABI */
+  const char *name;
+
+  /* Returns the context passed to the other two, or NULL to decline */
+  void *(*open)(const struct dscd_host *host, const char *argument);
+  void (*event)(void *context, const struct dscd_panel *panel,
+                const struct dscd_event *event);
+  void (*close)(void *context);
+};
+
+typedef const struct dscd_plugin *(*dscd_plugin_t)(void);
+const struct dscd_plugin *dscd_plugin(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -31,17 +31,34 @@
 #include "Config.h"
 #include "It100.h"
 #include "CommandProcessor.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Plugins.h"
+#include "Mqtt.h"
+#include "Trace.h"
 
 #include <iostream>
 #include <termios.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <netinet/in.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <list>
+#include <vector>
 #include <libgen.h>
+#include <signal.h>
+
+static volatile sig_atomic_t reloadRequested = 0;
+
+static void
+requestReload(int)
+{
+  reloadRequested = 1;
+}
 
 int
 main(int argc, char **argv)
@@ -52,8 +69,12 @@ main(int argc, char **argv)
       configFile = argv[1];
    }
    
-  Config::Config &config = Config::getConfig( configFile );
-  // TODO -- validate configuration
+  Config &config = Config::getConfig( configFile );
+  if (!config.validate())
+  {
+    // validate() or the parser has already said what's wrong
+    return 1;
+  }
 
   //==================
   // Initialize syslog logging
@@ -64,6 +85,10 @@ main(int argc, char **argv)
   memmove(processName, temp, strlen(temp)+1);
   openlog(processName, 0, config.getSyslogFacility());
 
+  // From here on, console and syslog output is written by a separate
+  // thread so it can't hold up the panels.
+  Log::getLog().start(config.getLogFile());
+
   //==================
   // Initialize the command socket
   // TODO -- Send errors to syslog
@@ -86,35 +111,106 @@ main(int argc, char **argv)
   if (listen(listenSocket, 10)) {perror("listen()"); return -1;}
 
   //==================
-  // Initialize the IT-100 board
-  It100 it;
-  it.timeStampControl(false);
-  if (config.syncTime())
+  // Optional metrics endpoint for Prometheus
+  Metrics &metrics = Metrics::getMetrics();
+  if (config.getMetricsPort())
   {
-    it.setTimeAndDate(time(0));
+    metrics.listen(config.getMetricsPort());
   }
-  it.labelsRequest();
-  it.virtualKeypadControl(true);
-  it.timeDateBroadcastControl(true);
-  
-  bool statusRequested = false;
+  Metrics::Gauge &clients = metrics.gauge("dscd_clients",
+    "Clients connected to the command socket");
+  Metrics::Gauge &waiters = metrics.gauge("dscd_waiting_clients",
+    "Clients waiting on a keypad change or for a followed event");
+
+  // Sampled frame timings, for chrome://tracing or Perfetto
+  std::string traceFile = config.getTraceFile();
+  Trace::getTrace().open(traceFile, config.getTraceSample());
+
+  // In-process actions from [plugins]
+  Plugins::getPlugins().load(config);
+
+  //==================
+  // Initialize the IT-100 boards -- one per configured panel, all
+  // sharing this event loop.
+  std::vector<int> panelIds = config.getPanels();
+  std::vector<It100*> panels;
+  std::vector<bool> statusRequested;
+  std::vector<It100*>::iterator p;
+
+  for (size_t n = 0; n < panelIds.size(); n++)
+  {
+    It100 *it = new It100(panelIds[n]);
+    it->timeStampControl(false);
+    if (config.syncTime())
+    {
+      it->setTimeAndDate(time(0));
+    }
+    it->labelsRequest();
+    it->virtualKeypadControl(true);
+    it->timeDateBroadcastControl(true);
+    panels.push_back(it);
+    statusRequested.push_back(false);
+  }
+
+  // State and events to an MQTT broker, if [mqtt] names one
+  Mqtt &mqtt = Mqtt::getMqtt();
+  mqtt.configure(config);
+  for (p = panels.begin(); p != panels.end(); p++)
+  {
+    mqtt.addPanel(*p);
+  }
+
+  //==================
+  // Re-read the configuration on SIGHUP, or when the file changes
+  signal(SIGHUP, requestReload);
+
+  // A client that hangs up mid-reply shows up as a failed write
+  signal(SIGPIPE, SIG_IGN);
+  time_t lastConfigCheck = time(0);
 
   //==================
   // Process incoming information
   std::list<CommandProcessor> cp;
   std::list<CommandProcessor>::iterator i;
 
-  while(1)
+  // Runs until every replayed capture is exhausted; forever otherwise
+  while (1)
   {
+    bool finished = true;
+    for (p = panels.begin(); p != panels.end(); p++)
+    {
+      if (!(*p)->isFinished()) { finished = false; }
+    }
+    if (finished) { break; }
+
     fd_set set;
+    fd_set writeSet;
     struct timeval timeout;
     timeout.tv_sec = 0;
     timeout.tv_usec = 100000;
     int maxFd = listenSocket;
-    if (it.getDescriptor() > maxFd) { maxFd = it.getDescriptor(); }
     FD_ZERO(&set);
+    FD_ZERO(&writeSet);
     FD_SET(listenSocket, &set);
-    FD_SET(it.getDescriptor(), &set);
+
+    // If the link to an IT-100 is down, try to bring it back
+    for (p = panels.begin(); p != panels.end(); p++)
+    {
+      (*p)->checkConnection();
+      (*p)->reapActions();
+      (*p)->reportSuppressed();
+      if ((*p)->isConnected())
+      {
+        FD_SET((*p)->getDescriptor(), &set);
+      }
+      if ((*p)->wantsWrite())
+      {
+        FD_SET((*p)->getDescriptor(), &writeSet);
+      }
+      if ((*p)->getDescriptor() > maxFd) { maxFd = (*p)->getDescriptor(); }
+    }
+
+    maxFd = metrics.setDescriptors(&set, &writeSet, maxFd);
 
     for (i = cp.begin(); i != cp.end(); i++)
     {
@@ -122,12 +218,32 @@ main(int argc, char **argv)
       if (i->getDescriptor() > maxFd) { maxFd = i->getDescriptor(); }
     }
 
-    select(maxFd + 1, &set, 0, 0, &timeout);
+    int mqttFd = mqtt.getDescriptor();
+    if (mqttFd >= 0)
+    {
+      FD_SET(mqttFd, &set);
+      if (mqtt.wantsWrite()) { FD_SET(mqttFd, &writeSet); }
+      if (mqttFd > maxFd) { maxFd = mqttFd; }
+    }
+
+    select(maxFd + 1, &set, &writeSet, 0, &timeout);
+
+    // Links still connecting, or with output they couldn't take yet
+    for (p = panels.begin(); p != panels.end(); p++)
+    {
+      if ((*p)->wantsWrite())
+      {
+        (*p)->processWrite(FD_ISSET((*p)->getDescriptor(), &writeSet));
+      }
+    }
 
     // Inbound message from IT-100 board -- process it.
-    if (FD_ISSET(it.getDescriptor(), &set))
+    for (p = panels.begin(); p != panels.end(); p++)
     {
-      it.processMessage();
+      if ((*p)->isConnected() && FD_ISSET((*p)->getDescriptor(), &set))
+      {
+        (*p)->processMessage();
+      }
     }
 
     // Check command channels for new commands
@@ -139,6 +255,10 @@ main(int argc, char **argv)
       i->process();
     }
 
+    // Whatever the panels produced goes to the broker in one write
+    mqtt.process(mqttFd >= 0 && FD_ISSET(mqttFd, &set),
+                 mqttFd >= 0 && FD_ISSET(mqttFd, &writeSet));
+
     // Remove "done" comand channels
     for (i = cp.begin(); i != cp.end(); i++)
     {
@@ -157,17 +277,81 @@ main(int argc, char **argv)
       struct sockaddr_in remoteAddr;
       socklen_t addrSize = sizeof(remoteAddr);
       newSock = accept(listenSocket, (struct sockaddr*)&remoteAddr, &addrSize);
-      cp.push_back(CommandProcessor(newSock,it));
+      cp.push_back(CommandProcessor(newSock,panels));
+    }
+
+    // Scrapes of the metrics endpoint
+    if (metrics.getDescriptor() >= 0)
+    {
+      int waiting = 0;
+      for (i = cp.begin(); i != cp.end(); i++)
+      {
+        if (i->isWaiting()) { waiting++; }
+      }
+      clients.set(cp.size());
+      waiters.set(waiting);
+      metrics.serve(&set, &writeSet);
+    }
+
+    // Configuration reload happens here, between events, so nothing
+    // is in the middle of using the old snapshot.
+    if (time(0) != lastConfigCheck)
+    {
+      lastConfigCheck = time(0);
+      Trace::getTrace().flush();
+      if (Config::getConfig().hasChanged()) { reloadRequested = 1; }
+    }
+    if (reloadRequested)
+    {
+      reloadRequested = 0;
+      if (Config::reload())
+      {
+        Config &newConfig = Config::getConfig();
+        closelog();
+        openlog(processName, 0, newConfig.getSyslogFacility());
+
+        // Trace settings apply straight away; what can't is listed
+        // by Config::reload()
+        Trace &trace = Trace::getTrace();
+        if (newConfig.getTraceFile() != traceFile)
+        {
+          traceFile = newConfig.getTraceFile();
+          trace.open(traceFile, newConfig.getTraceSample());
+        }
+        else
+        {
+          trace.setSample(newConfig.getTraceSample());
+        }
+
+        mqtt.configure(newConfig);
+
+        for (p = panels.begin(); p != panels.end(); p++)
+        {
+          (*p)->configChanged();
+        }
+      }
     }
 
     // After the labels have been transferred, we ask for the
     // overall alarm panel status
-    if (it.hasLabels() && !statusRequested)
+    for (size_t n = 0; n < panels.size(); n++)
     {
-      it.statusRequest();
-      statusRequested = true;
+      if (panels[n]->hasLabels() && !statusRequested[n])
+      {
+        panels[n]->statusRequest();
+        statusRequested[n] = true;
+      }
     }
   }
 
+  mqtt.stop();
+  for (p = panels.begin(); p != panels.end(); p++)
+  {
+    delete *p;
+  }
+
+  Plugins::getPlugins().unload();
+  Trace::getTrace().close();
+  Log::getLog().stop();
   return 0;
 }
@@ -0,0 +1,203 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+/**
+  An example action plugin: appends a line to a file for every event
+  about a zone, with the zone's partition state alongside.
+
+    [plugins]
+    example = /path/to/example.so /tmp/dscd-zones.log
+
+  A write to a file can block, so event() only formats the line, using
+  the host while it's allowed to, and queues it; a thread of the
+  plugin's own does the writing. Lines are dropped, and counted, while
+  the queue is full.
+
+  Build it with "make" in this directory; it only needs dscd_plugin.h.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "dscd_plugin.h"
+
+#define QUEUE_LINES 256
+#define LINE_LENGTH 160
+
+struct context
+{
+  const struct dscd_host *host;
+  FILE *file;
+
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  char lines[QUEUE_LINES][LINE_LENGTH];
+  unsigned head;                /* next line to queue */
+  unsigned tail;                /* next line to write */
+  unsigned dropped;
+  int closing;
+};
+
+static void *
+example_writer(void *context)
+{
+  struct context *c = context;
+  char line[LINE_LENGTH];
+  unsigned dropped;
+
+  pthread_mutex_lock(&c->lock);
+  while (1)
+  {
+    while (c->head == c->tail && !c->closing)
+    {
+      pthread_cond_wait(&c->wake, &c->lock);
+    }
+    if (c->head == c->tail) { break; }
+
+    memcpy(line, c->lines[c->tail % QUEUE_LINES], LINE_LENGTH);
+    c->tail++;
+    dropped = c->dropped;
+    c->dropped = 0;
+    pthread_mutex_unlock(&c->lock);
+
+    if (dropped) { fprintf(c->file, "(%u lines dropped)\n", dropped); }
+    fputs(line, c->file);
+
+    pthread_mutex_lock(&c->lock);
+  }
+  pthread_mutex_unlock(&c->lock);
+  return NULL;
+}
+
+static void *
+example_open(const struct dscd_host *host, const char *argument)
+{
+  struct context *c;
+  FILE *file = fopen(argument[0] ? argument : "/dev/stdout", "a");
+  if (!file)
+  {
+    host->log(LOG_ERR, "example plugin: can't open its file");
+    return NULL;
+  }
+  setvbuf(file, NULL, _IOLBF, 0);
+
+  c = calloc(1, sizeof(*c));
+  if (!c)
+  {
+    fclose(file);
+    return NULL;
+  }
+  c->host = host;
+  c->file = file;
+  pthread_mutex_init(&c->lock, NULL);
+  pthread_cond_init(&c->wake, NULL);
+  if (pthread_create(&c->writer, NULL, example_writer, c) != 0)
+  {
+    host->log(LOG_ERR, "example plugin: can't start its writer");
+    pthread_cond_destroy(&c->wake);
+    pthread_mutex_destroy(&c->lock);
+    fclose(file);
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+static void
+example_event(void *context, const struct dscd_panel *panel,
+              const struct dscd_event *event)
+{
+  struct context *c = context;
+  struct dscd_partition partition;
+  char line[LINE_LENGTH];
+  int state = -1;
+
+  if (!event->zone) { return; }
+  if (event->partition &&
+      c->host->partition(panel, event->partition, &partition))
+  {
+    state = partition.state;
+  }
+
+  snprintf(line, sizeof(line), "panel %d %s zone %d (%.*s) partition "
+           "state %d open %016llx\n", event->panel, event->name,
+           event->zone, (int)event->names[0].length, event->names[0].data,
+           state,
+           (unsigned long long)c->host->zones(panel, DSCD_ZONE_OPEN, 0));
+
+  pthread_mutex_lock(&c->lock);
+  if (c->head - c->tail < QUEUE_LINES)
+  {
+    memcpy(c->lines[c->head % QUEUE_LINES], line, LINE_LENGTH);
+    c->head++;
+    pthread_cond_signal(&c->wake);
+  }
+  else
+  {
+    c->dropped++;
+  }
+  pthread_mutex_unlock(&c->lock);
+}
+
+static void
+example_close(void *context)
+{
+  struct context *c = context;
+
+  /* The writer finishes what's queued before it stops */
+  pthread_mutex_lock(&c->lock);
+  c->closing = 1;
+  pthread_cond_signal(&c->wake);
+  pthread_mutex_unlock(&c->lock);
+  pthread_join(c->writer, NULL);
+
+  pthread_cond_destroy(&c->wake);
+  pthread_mutex_destroy(&c->lock);
+  fclose(c->file);
+  free(c);
+}
+
+static const struct dscd_plugin plugin =
+{
+  DSCD_PLUGIN_ABI,
+  "example",
+  example_open,
+  example_event,
+  example_close,
+};
+
+const struct dscd_plugin *
+dscd_plugin(void)
+{
+  return &plugin;
+}
@@ -0,0 +1,416 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#include "Emulator.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+
+static const char *lcdMessages[] =
+{
+  "System is Ready to Arm          ",
+  "Secure System   Before Arming   ",
+  "Enter Code to   Arm System      ",
+  "Exit Delay in   Progress        ",
+  "System Armed in Away Mode       ",
+  "Date     Time   Jan 01/11  2:00a",
+};
+
+uint64_t
+Emulator::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+Emulator::Emulator(const Options &options)
+  : mOptions(options), mDescriptor(-1), mSlave(-1), mRxLength(0),
+    mLineFreeAt(0), mScriptPos(0), mNextScript(0), mNextRandom(0),
+    mZoneOpen(0), mKeys(0), mFramesIn(0), mFramesOut(0), mBytesOut(0)
+{
+  if (mOptions.zones < 1) { mOptions.zones = 1; }
+  if (mOptions.zones > 64) { mOptions.zones = 64; }
+  if (mOptions.partitions < 1) { mOptions.partitions = 1; }
+  if (mOptions.partitions > 8) { mOptions.partitions = 8; }
+  memcpy(mLcd, lcdMessages[0], 32);
+  mLcd[32] = 0;
+  srandom(mOptions.seed);
+}
+
+Emulator::~Emulator()
+{
+  if (mSlave >= 0) { close(mSlave); }
+  if (mDescriptor >= 0) { close(mDescriptor); }
+}
+
+bool
+Emulator::open()
+{
+  mDescriptor = posix_openpt(O_RDWR | O_NOCTTY);
+  if (mDescriptor < 0 || grantpt(mDescriptor) || unlockpt(mDescriptor) ||
+      !ptsname(mDescriptor))
+  {
+    perror("posix_openpt()");
+    return false;
+  }
+  mSlaveName = ptsname(mDescriptor);
+
+  // Keep our own slave descriptor open so that the master doesn't
+  // return EIO between clients, and put the line in raw mode.
+  mSlave = ::open(mSlaveName.c_str(), O_RDWR | O_NOCTTY);
+  if (mSlave >= 0)
+  {
+    struct termios desc;
+    tcgetattr(mSlave, &desc);
+    cfmakeraw(&desc);
+    tcsetattr(mSlave, TCSANOW, &desc);
+  }
+
+  int flags = fcntl(mDescriptor, F_GETFL, 0);
+  fcntl(mDescriptor, F_SETFL, flags | O_NONBLOCK);
+
+  if (mOptions.link.length())
+  {
+    struct stat st;
+    if (lstat(mOptions.link.c_str(), &st) == 0 && S_ISLNK(st.st_mode))
+    {
+      unlink(mOptions.link.c_str());
+    }
+    if (symlink(mSlaveName.c_str(), mOptions.link.c_str()))
+    {
+      perror(mOptions.link.c_str());
+    }
+  }
+
+  if (mOptions.script.length() && !loadScript())
+  {
+    return false;
+  }
+
+  uint64_t t = now();
+  mNextScript = mScript.size() ? t + mScript[0].delay : 0;
+  mNextRandom = (mOptions.rate > 0) ? t : 0;
+
+  return true;
+}
+
+/**
+  Script files have one frame per line, preceded by the number of
+  milliseconds to wait after the previous frame:
+
+    # wait  frame (no checksum)
+    500     609003
+    2000    610003
+*/
+bool
+Emulator::loadScript()
+{
+  std::ifstream in(mOptions.script.c_str());
+  if (!in)
+  {
+    std::cerr << "Could not open script: " << mOptions.script << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(in, line))
+  {
+    std::string::size_type start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#') { continue; }
+
+    char *end;
+    double delay = strtod(line.c_str() + start, &end);
+    std::string frame(end);
+    frame.erase(0, frame.find_first_not_of(" \t"));
+    frame.erase(frame.find_last_not_of(" \t\r") + 1);
+    if (frame.length() < 3) { continue; }
+
+    ScriptEntry e;
+    e.delay = (uint64_t)(delay * 1000000.0);
+    e.frame = frame;
+    mScript.push_back(e);
+  }
+  return true;
+}
+
+void
+Emulator::process()
+{
+  char buffer[256];
+  int s = read(mDescriptor, buffer, sizeof(buffer));
+
+  for (int i = 0; i < s; i++)
+  {
+    if (buffer[i] == '\n')
+    {
+      if (mRxLength && mRxBuffer[mRxLength-1] == '\r') { mRxLength--; }
+      if (mRxLength >= 5)
+      {
+        handleCommand(std::string(mRxBuffer, mRxLength));
+      }
+      mRxLength = 0;
+    }
+    else if (mRxLength < sizeof(mRxBuffer))
+    {
+      mRxBuffer[mRxLength++] = buffer[i];
+    }
+  }
+}
+
+void
+Emulator::handleCommand(const std::string &line)
+{
+  mFramesIn++;
+  if (mOptions.verbose) { std::cout << ">>> " << line << std::endl; }
+
+  std::string body = line.substr(0, line.length() - 2);
+  unsigned char checksum = 0;
+  for (size_t i = 0; i < body.length(); i++) { checksum += body[i]; }
+
+  if (checksum != strtol(line.substr(line.length() - 2).c_str(), 0, 16))
+  {
+    send("501");
+    return;
+  }
+
+  std::string code = body.substr(0, 3);
+  send("500" + code);
+
+  switch (atoi(code.c_str()))
+  {
+    case 1:   // Status Request
+      sendStatus();
+      break;
+
+    case 2:   // Labels Request
+      sendLabels();
+      break;
+
+    case 70:  // Key Pressed
+      if (body.length() > 3)
+      {
+        // Room for any count; setLcd() keeps the first 16 characters
+        char text[32];
+        snprintf(text, sizeof(text), "Key %c  #%-7d", body[3], ++mKeys);
+        setLcd(0, text);
+      }
+      break;
+  }
+}
+
+void
+Emulator::sendStatus()
+{
+  char frame[16];
+  for (int z = 1; z <= mOptions.zones; z++)
+  {
+    if (mZoneOpen & ((uint64_t)1 << (z - 1)))
+    {
+      snprintf(frame, sizeof(frame), "609%03d", z);
+      send(frame);
+    }
+  }
+  for (int p = 1; p <= mOptions.partitions; p++)
+  {
+    snprintf(frame, sizeof(frame), "%3d%d", mZoneOpen ? 651 : 650, p);
+    send(frame);
+  }
+  send(mZoneOpen ? "90310" : "90311");
+}
+
+void
+Emulator::sendLabels()
+{
+  char frame[48];
+  char label[33];
+  for (int n = 0; n <= 151; n++)
+  {
+    if (n >= 1 && n <= 64) { snprintf(label, sizeof(label), "Zone %d", n); }
+    else if (n >= 101 && n <= 108)
+      { snprintf(label, sizeof(label), "Partition %d", n - 100); }
+    else { snprintf(label, sizeof(label), "Label %d", n); }
+    snprintf(frame, sizeof(frame), "570%03d%-32s", n, label);
+    send(frame);
+  }
+}
+
+void
+Emulator::setZoneOpen(int zone, bool open)
+{
+  uint64_t bit = (uint64_t)1 << (zone - 1);
+  if (open) { mZoneOpen |= bit; } else { mZoneOpen &= ~bit; }
+
+  char frame[16];
+  snprintf(frame, sizeof(frame), "%3d%03d", open ? 609 : 610, zone);
+  send(frame);
+}
+
+void
+Emulator::setLcd(int line, const std::string &text)
+{
+  char frame[48];
+  std::string t = text.substr(0, 16);
+  memcpy(mLcd + line * 16, t.c_str(), t.length());
+  snprintf(frame, sizeof(frame), "901%d00%02d%s",
+           line, (int)t.length(), t.c_str());
+  send(frame);
+}
+
+void
+Emulator::randomFrame()
+{
+  int pick = random() % 10;
+  if (pick < 4)
+  {
+    const char *msg = lcdMessages[random() %
+                                  (sizeof(lcdMessages)/sizeof(*lcdMessages))];
+    int line = random() % 2;
+    setLcd(line, std::string(msg + line * 16, 16));
+  }
+  else if (pick < 7)
+  {
+    int zone = random() % mOptions.zones + 1;
+    setZoneOpen(zone, !(mZoneOpen & ((uint64_t)1 << (zone - 1))));
+  }
+  else if (pick < 9)
+  {
+    char frame[8];
+    snprintf(frame, sizeof(frame), "903%d%d",
+             (int)(random() % 9) + 1, (int)(random() % 3));
+    send(frame);
+  }
+  else
+  {
+    char frame[8];
+    snprintf(frame, sizeof(frame), "%3d%c", mZoneOpen ? 651 : 650,
+             (char)('1' + random() % mOptions.partitions));
+    send(frame);
+  }
+}
+
+std::string
+Emulator::makeFrame(const std::string &frame) const
+{
+  unsigned char checksum = 0;
+  for (size_t i = 0; i < frame.length(); i++) { checksum += frame[i]; }
+  char tail[8];
+  snprintf(tail, sizeof(tail), "%2.2X\r\n", checksum);
+  return frame + tail;
+}
+
+void
+Emulator::send(const std::string &frame)
+{
+  if (mOptions.verbose) { std::cout << "<<< " << frame << std::endl; }
+  mOutput.push_back(makeFrame(frame));
+  flush(now());
+}
+
+/**
+  Write queued frames, no faster than the configured baud rate could
+  carry them (10 bit times per byte: start, 8 data, stop).
+*/
+void
+Emulator::flush(uint64_t t)
+{
+  while (mOutput.size() && (mOptions.baud <= 0 || t >= mLineFreeAt))
+  {
+    const std::string &f = mOutput.front();
+    int s = write(mDescriptor, f.data(), f.length());
+    if (s < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { return; }
+    if (s > 0)
+    {
+      mFramesOut++;
+      mBytesOut += s;
+    }
+
+    if (mOptions.baud > 0)
+    {
+      if (mLineFreeAt < t) { mLineFreeAt = t; }
+      mLineFreeAt += (uint64_t)f.length() * 10 * 1000000000ULL /
+                     mOptions.baud;
+    }
+    mOutput.pop_front();
+  }
+}
+
+int64_t
+Emulator::tick()
+{
+  uint64_t t = now();
+
+  // Bounded to one pass over the script, in case every delay is zero
+  for (size_t n = 0; mNextScript && t >= mNextScript && n < mScript.size();
+       n++)
+  {
+    send(mScript[mScriptPos].frame);
+    if (++mScriptPos >= mScript.size())
+    {
+      if (!mOptions.loop) { mNextScript = 0; break; }
+      mScriptPos = 0;
+    }
+    mNextScript += mScript[mScriptPos].delay;
+  }
+
+  if (mNextRandom)
+  {
+    uint64_t interval = (uint64_t)(1000000000.0 / mOptions.rate);
+    while (t >= mNextRandom)
+    {
+      randomFrame();
+      mNextRandom += interval;
+    }
+  }
+
+  flush(t);
+
+  int64_t wait = -1;
+  if (mNextScript) { wait = mNextScript - t; }
+  if (mNextRandom && (wait < 0 || (int64_t)(mNextRandom - t) < wait))
+    { wait = mNextRandom - t; }
+  if (mOutput.size())
+  {
+    // Either pacing, or the pty is full and we need to retry shortly
+    int64_t w = (mLineFreeAt > t) ? (int64_t)(mLineFreeAt - t) : 1000000;
+    if (wait < 0 || w < wait) { wait = w; }
+  }
+  return wait;
+}
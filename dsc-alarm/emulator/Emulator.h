@@ -0,0 +1,138 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#ifndef _EMULATOR_H
+#define _EMULATOR_H 1
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+  Stand-in for an IT-100 and the panel behind it. Sits on the master
+  side of a pseudo-terminal and speaks the IT-100 serial protocol, so
+  dscd (or anything else) can open the slave as if it were real
+  hardware.
+
+  It acknowledges every command, answers status and label requests,
+  echoes key presses onto the LCD, and can generate scripted or random
+  traffic. Output is paced to what the configured baud rate could
+  actually carry.
+*/
+
+class Emulator
+{
+  public:
+    struct Options
+    {
+      Options() : zones(8), partitions(1), baud(0), rate(0), loop(false),
+                  seed(1), verbose(false) {;}
+
+      std::string link;       // symlink to publish the slave at
+      int zones;              // number of zones (1-64)
+      int partitions;         // number of partitions (1-8)
+      int baud;               // pacing; 0 means as fast as possible
+      double rate;            // random frames per second; 0 for none
+      std::string script;     // scripted traffic file
+      bool loop;              // replay the script when it ends
+      unsigned int seed;
+      bool verbose;
+    };
+
+    static uint64_t now();
+
+    Emulator(const Options &options);
+    ~Emulator();
+
+    bool open();
+    int getDescriptor() const { return mDescriptor; }
+    const std::string &getSlaveName() const { return mSlaveName; }
+
+    // Handle input from the far end; call when readable
+    void process();
+
+    // Generate traffic and flush paced output. Returns the number of
+    // nanoseconds until something else needs doing (or -1 for never).
+    int64_t tick();
+
+    // Send a frame (without checksum or line ending)
+    void send(const std::string &frame);
+
+    // Counters for benchmarks
+    uint64_t getFramesIn() const { return mFramesIn; }
+    uint64_t getFramesOut() const { return mFramesOut; }
+    uint64_t getBytesOut() const { return mBytesOut; }
+
+    void setZoneOpen(int zone, bool open);
+    void setLcd(int line, const std::string &text);
+
+  private:
+    struct ScriptEntry
+    {
+      uint64_t delay;
+      std::string frame;
+    };
+
+    void handleCommand(const std::string &line);
+    void sendStatus();
+    void sendLabels();
+    void randomFrame();
+    bool loadScript();
+    void flush(uint64_t now);
+    std::string makeFrame(const std::string &frame) const;
+
+  private:
+    Options mOptions;
+    int mDescriptor;
+    int mSlave;
+    std::string mSlaveName;
+
+    char mRxBuffer[128];
+    size_t mRxLength;
+
+    std::deque<std::string> mOutput;
+    uint64_t mLineFreeAt;
+
+    std::vector<ScriptEntry> mScript;
+    size_t mScriptPos;
+    uint64_t mNextScript;
+    uint64_t mNextRandom;
+
+    uint64_t mZoneOpen;
+    char mLcd[33];
+    int mKeys;
+
+    uint64_t mFramesIn;
+    uint64_t mFramesOut;
+    uint64_t mBytesOut;
+};
+
+#endif
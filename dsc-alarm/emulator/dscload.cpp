@@ -0,0 +1,470 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+/**
+  Load test for dscd: runs an emulated IT-100, starts dscd on it, and
+  connects a crowd of virtual keypads that long-poll for status the
+  way the web keypad does, pressing keys now and then.
+
+  Two latencies are measured. Keypress to LCD is from a client sending
+  a key until that client sees the emulator's "Key N #count" echo on
+  the LCD; only one key is in flight at a time so the echo can't be
+  mistaken. Status fan-out is from the emulator writing a marker LCD
+  frame ("Load #n" on line 2) until each long-polling client receives
+  a status carrying it. At the end dscd is stopped, and its CPU time
+  and peak RSS are taken from its rusage.
+*/
+
+#include "Emulator.h"
+
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static volatile bool done = false;
+
+static void
+stop(int)
+{
+  done = true;
+}
+
+static void
+usage(const char *name)
+{
+  std::cerr
+    << "Usage: " << name << " [options]\n"
+    << "  -d path   dscd binary (default ../dscd/dscd)\n"
+    << "  -P port   command port for dscd to listen on (default 53390)\n"
+    << "  -c n      number of virtual keypad clients (default 10)\n"
+    << "  -f rate   marker LCD frames per second (default 10)\n"
+    << "  -r rate   random background frames per second (default 0)\n"
+    << "  -k rate   key presses per second, across all clients "
+       "(default 2)\n"
+    << "  -t secs   how long to run (default 10)\n"
+    << "  -z n      number of zones (default 8)\n"
+    << "  -b baud   pace emulator output as on a serial line\n"
+    << "  -S seed   random seed\n";
+  exit(1);
+}
+
+/** One virtual keypad: a long poll always outstanding */
+struct Client
+{
+  Client() : descriptor(-1), etag(0), statuses(0), marker(-1) {;}
+
+  int descriptor;
+  std::string input;
+  unsigned long etag;
+  uint64_t statuses;
+  long marker;          // newest marker seen
+};
+
+struct Samples
+{
+  std::vector<uint64_t> values;
+
+  void add(uint64_t ns) { values.push_back(ns); }
+
+  double percentile(double p)
+  {
+    if (values.empty()) { return 0; }
+    size_t i = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+    return values[i] / 1e6;
+  }
+
+  void report(const char *name, uint64_t lost)
+  {
+    std::sort(values.begin(), values.end());
+    printf("%-18s n=%-8lu lost=%-6llu p50 %8.3fms  p90 %8.3fms  "
+           "p99 %8.3fms  max %8.3fms\n", name, (unsigned long)values.size(),
+           (unsigned long long)lost, percentile(50), percentile(90),
+           percentile(99), percentile(100));
+  }
+};
+
+// A key press is abandoned if its echo hasn't shown up by then
+static const uint64_t KEY_TIMEOUT = 2000000000ULL;
+
+static int
+connectClient(int port)
+{
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+  int s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (s < 0) { return -1; }
+  if (connect(s, (struct sockaddr*)&addr, sizeof(addr)))
+  {
+    close(s);
+    return -1;
+  }
+  return s;
+}
+
+static void
+sendLine(Client &c, const std::string &line)
+{
+  std::string l = line + "\n";
+  if (write(c.descriptor, l.data(), l.length()) != (int)l.length())
+  {
+    perror("write()");
+  }
+}
+
+/** The n'th quoted string in a status line (the LCD lines are 0 and 1) */
+static std::string
+quoted(const std::string &line, int n)
+{
+  std::string::size_type start = 0;
+  for (int i = 0; i <= n; i++)
+  {
+    start = line.find('\'', start);
+    if (start == std::string::npos) { return ""; }
+    std::string::size_type end = line.find('\'', start + 1);
+    if (end == std::string::npos) { return ""; }
+    if (i == n) { return line.substr(start + 1, end - start - 1); }
+    start = end + 1;
+  }
+  return "";
+}
+
+static pid_t
+startDaemon(const std::string &binary, const std::string &configFile)
+{
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    int null = open("/dev/null", O_RDWR);
+    dup2(null, 1);
+    dup2(null, 2);
+    execl(binary.c_str(), binary.c_str(), configFile.c_str(), (char*)0);
+    _exit(127);
+  }
+  return pid;
+}
+
+int
+main(int argc, char **argv)
+{
+  Emulator::Options options;
+  std::string binary = "../dscd/dscd";
+  int port = 53390;
+  int clientCount = 10;
+  double markerRate = 10;
+  double keyRate = 2;
+  double duration = 10;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "d:P:c:f:r:k:t:z:b:S:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'd': binary = optarg; break;
+      case 'P': port = atoi(optarg); break;
+      case 'c': clientCount = atoi(optarg); break;
+      case 'f': markerRate = atof(optarg); break;
+      case 'r': options.rate = atof(optarg); break;
+      case 'k': keyRate = atof(optarg); break;
+      case 't': duration = atof(optarg); break;
+      case 'z': options.zones = atoi(optarg); break;
+      case 'b': options.baud = atoi(optarg); break;
+      case 'S': options.seed = strtoul(optarg, 0, 10); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (clientCount < 1) { usage(argv[0]); }
+
+  // Each client holds a descriptor; leave room for them
+  struct rlimit files;
+  getrlimit(RLIMIT_NOFILE, &files);
+  if (files.rlim_cur < (rlim_t)clientCount + 64)
+  {
+    files.rlim_cur = std::min(files.rlim_max, (rlim_t)clientCount + 64);
+    setrlimit(RLIMIT_NOFILE, &files);
+  }
+  if (clientCount + 16 > FD_SETSIZE)
+  {
+    std::cerr << "At most " << FD_SETSIZE - 16 << " clients" << std::endl;
+    return 1;
+  }
+
+  Emulator emulator(options);
+  if (!emulator.open())
+  {
+    return -1;
+  }
+
+  char configFile[] = "/tmp/dscload-XXXXXX";
+  int fd = mkstemp(configFile);
+  if (fd < 0) { perror("mkstemp()"); return -1; }
+  FILE *config = fdopen(fd, "w");
+  fprintf(config, "[main]\ndevice = %s\nport = %d\nstate_file =\n"
+                  "sync_time = false\n",
+          emulator.getSlaveName().c_str(), port);
+  fclose(config);
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  pid_t daemon = startDaemon(binary, configFile);
+  if (daemon < 0) { perror("fork()"); return -1; }
+
+  // Give dscd a few seconds to come up, answering it meanwhile
+  std::vector<Client> clients(clientCount);
+  uint64_t giveUp = Emulator::now() + 5000000000ULL;
+  int s;
+  while ((s = connectClient(port)) < 0)
+  {
+    if (Emulator::now() > giveUp || waitpid(daemon, 0, WNOHANG) == daemon)
+    {
+      std::cerr << "dscd didn't start listening on port " << port
+                << std::endl;
+      kill(daemon, SIGTERM);
+      unlink(configFile);
+      return 1;
+    }
+    emulator.tick();
+    emulator.process();
+    usleep(10000);
+  }
+  clients[0].descriptor = s;
+  for (int i = 1; i < clientCount; i++)
+  {
+    clients[i].descriptor = connectClient(port);
+    if (clients[i].descriptor < 0)
+    {
+      perror("connect()");
+      kill(daemon, SIGTERM);
+      unlink(configFile);
+      return 1;
+    }
+  }
+  for (int i = 0; i < clientCount; i++) { sendLine(clients[i], "?"); }
+
+  Samples keyLatency;
+  Samples fanOut;
+  uint64_t keysLost = 0;
+  uint64_t markersMissed = 0;
+
+  std::vector<uint64_t> markerSentAt;
+  int keyClient = -1;
+  uint64_t keySentAt = 0;
+  int lastKeyCount = 0;
+  int nextKeyClient = 0;
+
+  uint64_t start = Emulator::now();
+  uint64_t end = start + (uint64_t)(duration * 1e9);
+  uint64_t markerInterval = markerRate > 0 ?
+                            (uint64_t)(1e9 / markerRate) : 0;
+  uint64_t keyInterval = keyRate > 0 ? (uint64_t)(1e9 / keyRate) : 0;
+  uint64_t nextMarker = markerInterval ? start : 0;
+  uint64_t nextKey = keyInterval ? start : 0;
+
+  while (!done)
+  {
+    uint64_t t = Emulator::now();
+    if (t >= end) { break; }
+
+    if (nextMarker && t >= nextMarker)
+    {
+      char text[17];
+      snprintf(text, sizeof(text), "Load #%-10lu",
+               (unsigned long)markerSentAt.size());
+      markerSentAt.push_back(Emulator::now());
+      emulator.setLcd(1, text);
+      nextMarker += markerInterval;
+    }
+
+    if (keyClient >= 0 && t - keySentAt > KEY_TIMEOUT)
+    {
+      keysLost++;
+      keyClient = -1;
+    }
+    if (nextKey && t >= nextKey)
+    {
+      if (keyClient < 0)
+      {
+        keyClient = nextKeyClient;
+        nextKeyClient = (nextKeyClient + 1) % clientCount;
+        keySentAt = Emulator::now();
+        sendLine(clients[keyClient], "5");
+      }
+      nextKey += keyInterval;
+    }
+
+    int64_t wait = emulator.tick();
+    t = Emulator::now();
+    if (nextMarker && (wait < 0 || (int64_t)(nextMarker - t) < wait))
+      { wait = nextMarker > t ? nextMarker - t : 0; }
+    if (nextKey && (wait < 0 || (int64_t)(nextKey - t) < wait))
+      { wait = nextKey > t ? nextKey - t : 0; }
+    if (wait < 0 || wait > 100000000) { wait = 100000000; }
+
+    fd_set set;
+    FD_ZERO(&set);
+    int maxFd = emulator.getDescriptor();
+    FD_SET(emulator.getDescriptor(), &set);
+    for (int i = 0; i < clientCount; i++)
+    {
+      FD_SET(clients[i].descriptor, &set);
+      if (clients[i].descriptor > maxFd) { maxFd = clients[i].descriptor; }
+    }
+    struct timeval timeout;
+    timeout.tv_sec = wait / 1000000000;
+    timeout.tv_usec = (wait % 1000000000) / 1000;
+
+    if (select(maxFd + 1, &set, 0, 0, &timeout) <= 0) { continue; }
+
+    if (FD_ISSET(emulator.getDescriptor(), &set)) { emulator.process(); }
+
+    for (int i = 0; i < clientCount; i++)
+    {
+      Client &c = clients[i];
+      if (!FD_ISSET(c.descriptor, &set)) { continue; }
+
+      char buffer[4096];
+      int n = read(c.descriptor, buffer, sizeof(buffer));
+      if (n <= 0)
+      {
+        std::cerr << "dscd dropped client " << i << std::endl;
+        done = true;
+        break;
+      }
+      uint64_t readAt = Emulator::now();
+      c.input.append(buffer, n);
+
+      std::string::size_type eol;
+      while ((eol = c.input.find('\n')) != std::string::npos)
+      {
+        std::string line = c.input.substr(0, eol);
+        c.input.erase(0, eol + 1);
+
+        // Echoes of our own key presses and long polls
+        if (line.empty() || line[0] != '[') { continue; }
+
+        c.statuses++;
+        c.etag = strtoul(line.c_str() + 1, 0, 10);
+        char poll[24];
+        snprintf(poll, sizeof(poll), "?%lu", c.etag);
+        sendLine(c, poll);
+
+        std::string top = quoted(line, 0);
+        std::string bottom = quoted(line, 1);
+
+        if (i == keyClient && top.compare(0, 4, "Key ") == 0)
+        {
+          std::string::size_type hash = top.find('#');
+          int count = hash == std::string::npos ? 0 :
+                      atoi(top.c_str() + hash + 1);
+          if (count > lastKeyCount)
+          {
+            keyLatency.add(readAt - keySentAt);
+            lastKeyCount = count;
+            keyClient = -1;
+          }
+        }
+
+        if (bottom.compare(0, 6, "Load #") == 0)
+        {
+          // Later statuses repeat it until the next marker
+          long marker = strtol(bottom.c_str() + 6, 0, 10);
+          if (marker > c.marker && marker < (long)markerSentAt.size())
+          {
+            fanOut.add(readAt - markerSentAt[marker]);
+            c.marker = marker;
+          }
+        }
+      }
+    }
+  }
+  uint64_t elapsed = Emulator::now() - start;
+
+  // Markers overwritten (by newer markers or random traffic) before
+  // a client got to see them
+  uint64_t statuses = 0;
+  for (int i = 0; i < clientCount; i++)
+  {
+    statuses += clients[i].statuses;
+    close(clients[i].descriptor);
+  }
+  if (markerSentAt.size() * clientCount > fanOut.values.size())
+  {
+    markersMissed = markerSentAt.size() * clientCount - fanOut.values.size();
+  }
+
+  kill(daemon, SIGTERM);
+  int status;
+  waitpid(daemon, &status, 0);
+  unlink(configFile);
+
+  struct rusage usage;
+  getrusage(RUSAGE_CHILDREN, &usage);
+  double user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+  double system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  long maxRss = usage.ru_maxrss;
+#ifdef __APPLE__
+  maxRss /= 1024;   // bytes there, kB everywhere else
+#endif
+
+  double seconds = elapsed / 1e9;
+  printf("%d clients, %.0f markers/s + %.0f random frames/s, "
+         "%.1f keys/s, %.1fs\n", clientCount, markerRate, options.rate,
+         keyRate, seconds);
+  printf("emulator: %llu frames out, %llu in\n",
+         (unsigned long long)emulator.getFramesOut(),
+         (unsigned long long)emulator.getFramesIn());
+  printf("clients: %llu status replies (%.0f/s)\n",
+         (unsigned long long)statuses, statuses / seconds);
+  keyLatency.report("keypress to LCD", keysLost);
+  fanOut.report("status fan-out", markersMissed);
+  printf("dscd: %.2fs user, %.2fs system (%.1f%% of a core), "
+         "max RSS %ld kB\n", user, system,
+         (user + system) / seconds * 100, maxRss);
+  return 0;
+}
@@ -0,0 +1,124 @@
+/* ---------------------------------------------------------------------------
+
+  Copyright (c) 2009-2010, Adam Roach
+  All rights reserved.
+  
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  
+      * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+  
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+  
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+--------------------------------------------------------------------------- */
+
+#include "Emulator.h"
+
+#include <sys/select.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+
+static volatile bool done = false;
+
+static void
+stop(int)
+{
+  done = true;
+}
+
+static void
+usage(const char *name)
+{
+  std::cerr
+    << "Usage: " << name << " [options]\n"
+    << "  -l path   publish the pty slave as a symlink at path\n"
+    << "  -z n      number of zones (default 8)\n"
+    << "  -p n      number of partitions (default 1)\n"
+    << "  -b baud   pace output as if on a serial line at this speed\n"
+    << "  -r rate   generate random traffic at rate frames per second\n"
+    << "  -s file   play scripted traffic from file\n"
+    << "  -L        loop the script\n"
+    << "  -S seed   random seed\n"
+    << "  -v        print every frame\n";
+  exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+  Emulator::Options options;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "l:z:p:b:r:s:LS:v")) != -1)
+  {
+    switch (opt)
+    {
+      case 'l': options.link = optarg; break;
+      case 'z': options.zones = atoi(optarg); break;
+      case 'p': options.partitions = atoi(optarg); break;
+      case 'b': options.baud = atoi(optarg); break;
+      case 'r': options.rate = atof(optarg); break;
+      case 's': options.script = optarg; break;
+      case 'L': options.loop = true; break;
+      case 'S': options.seed = strtoul(optarg, 0, 10); break;
+      case 'v': options.verbose = true; break;
+      default: usage(argv[0]);
+    }
+  }
+
+  Emulator emulator(options);
+  if (!emulator.open())
+  {
+    return -1;
+  }
+  std::cout << emulator.getSlaveName() << std::endl;
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  uint64_t start = Emulator::now();
+  while (!done)
+  {
+    int64_t wait = emulator.tick();
+
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(emulator.getDescriptor(), &set);
+    struct timeval timeout;
+    if (wait < 0 || wait > 1000000000) { wait = 1000000000; }
+    timeout.tv_sec = wait / 1000000000;
+    timeout.tv_usec = (wait % 1000000000) / 1000;
+
+    if (select(emulator.getDescriptor() + 1, &set, 0, 0, &timeout) > 0)
+    {
+      emulator.process();
+    }
+  }
+
+  double elapsed = (Emulator::now() - start) / 1e9;
+  std::cerr << emulator.getFramesIn() << " frames in, "
+            << emulator.getFramesOut() << " frames out ("
+            << emulator.getBytesOut() << " bytes) in "
+            << elapsed << "s" << std::endl;
+  return 0;
+}